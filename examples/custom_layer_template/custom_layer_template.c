@@ -1,11 +1,30 @@
 #include "data_desk.h"
 
+DATA_DESK_FUNC void
+DataDeskCustomServicesCallback(DataDeskServices *services)
+{
+	// Called before initialization. Keep services around to tell Data Desk
+	// about generated files (see DataDeskFOpenOutputFile).
+}
+
 DATA_DESK_FUNC void
 DataDeskCustomInitCallback(void)
 {
 	// Initialization code goes here.
 }
 
+DATA_DESK_FUNC void
+DataDeskCustomGraphCallback(DataDeskGraph *graph)
+{
+	// Called once all files have been parsed, with indices over the parsed graph.
+}
+
+DATA_DESK_FUNC void
+DataDeskCustomFileCallback(DataDeskGraph *graph, char *filename)
+{
+	// Optional. Called before the parse callbacks for each file.
+}
+
 DATA_DESK_FUNC void
 DataDeskCustomParseCallback(DataDeskNode *root, char *filename)
 {
@@ -1,18 +1,46 @@
 #include <stdio.h>
 #include "data_desk.h"
 
+static DataDeskServices *global_services = 0;
 static FILE *global_header_file = 0;
+static DataDeskGraph *global_graph = 0;
+
+DATA_DESK_FUNC void
+DataDeskCustomServicesCallback(DataDeskServices *services)
+{
+	global_services = services;
+}
 
 DATA_DESK_FUNC void
 DataDeskCustomInitCallback(void)
 {
-	global_header_file = fopen("generated.h", "w");
+	global_header_file = DataDeskFOpenOutputFile(global_services, "generated.h", "w");
+}
+
+DATA_DESK_FUNC void
+DataDeskCustomGraphCallback(DataDeskGraph *graph)
+{
+	global_graph = graph;
+	
+	// Queries are compiled once, and can then be run over the graph.
+	DataDeskQuery query;
+	if(DataDeskCompileQuery(graph, &query, "struct > member[type=float]"))
+	{
+		fprintf(global_header_file, "// Float members:\n");
+		DataDeskQueryIterator it = DataDeskQueryIterate(graph, &query);
+		for(DataDeskNode *member = DataDeskQueryNext(&it); member; member = DataDeskQueryNext(&it))
+		{
+			DataDeskNode *owner = it.matches[0];
+			fprintf(global_header_file, "//   %s.%s\n", owner->string ? owner->string : "(anonymous)", member->string);
+		}
+		fprintf(global_header_file, "\n");
+	}
 }
 
 DATA_DESK_FUNC void
 DataDeskCustomParseCallback(DataDeskNode *root, char *filename)
 {
-	DataDeskFWriteGraphAsC(global_header_file, root, 0);
+	DataDeskFWriteGraphAsCWithGraph(global_header_file, global_graph, root, 0);
 }
 
 DATA_DESK_FUNC void
@@ -1,3 +1,9 @@
+// Float members:
+//   MyStructA.b
+//   MyStructB.x
+//   MyStructB.y
+//   (anonymous).baz
+
 #define SOME_CONSTANT (16)
 // @TagB @TagA 
 typedef struct MyStructA MyStructA;
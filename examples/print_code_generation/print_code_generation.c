@@ -1,25 +1,73 @@
 #include <stdio.h>
 #include "data_desk.h"
 
+static DataDeskServices *global_services = 0;
 static FILE *global_header_file = 0;
 static FILE *global_implementation_file = 0;
+static DataDeskGraph *global_graph = 0;
+static DataDeskTypeMatcher global_print_type_matcher;
+static int global_no_print_tag = 0;
+
+// Arrays of char (with any number of pointers) are printed as strings before
+// these are checked; see GeneratePrintCode.
+static struct
+{
+	char *pattern;
+	char *format;
+}
+global_print_types[] =
+{
+	{ "int",      "%i" }, { "uint", "%i" },
+	{ "int32_t",  "%i" }, { "i32",  "%i" },
+	{ "int16_t",  "%i" }, { "i16",  "%i" },
+	{ "int8_t",   "%i" }, { "i8",   "%i" },
+	{ "uint32_t", "%i" }, { "u32",  "%i" },
+	{ "uint16_t", "%i" }, { "u16",  "%i" },
+	{ "uint8_t",  "%i" }, { "u8",   "%i" },
+	{ "float",    "%f" }, { "double", "%f" },
+	{ "f32",      "%f" }, { "f64",    "%f" },
+	{ "char",     "%c" },
+	{ "*char",    "%s" },
+	{ "*void",    "%p" },
+};
 
 // NOTE(rjf): "access_string" is basically a prefix to a member of a struct, so something like
 // "object." or "object->". This can be changed in recursive calls, so you can descend a struct
 // recursively.
 static void GeneratePrintCode(FILE *file, DataDeskNode *root, char *access_string);
 
+DATA_DESK_FUNC void
+DataDeskCustomServicesCallback(DataDeskServices *services)
+{
+	global_services = services;
+}
+
 DATA_DESK_FUNC void
 DataDeskCustomInitCallback(void)
 {
-	global_header_file = fopen("generated_print.h", "w");
-	global_implementation_file = fopen("generated_print.c", "w");
+	global_header_file = DataDeskFOpenOutputFile(global_services, "generated_print.h", "w");
+	global_implementation_file = DataDeskFOpenOutputFile(global_services, "generated_print.c", "w");
+}
+
+DATA_DESK_FUNC void
+DataDeskCustomGraphCallback(DataDeskGraph *graph)
+{
+	global_graph = graph;
+
+	char *patterns[sizeof(global_print_types) / sizeof(global_print_types[0])];
+	int pattern_count = sizeof(patterns) / sizeof(patterns[0]);
+	for(int i = 0; i < pattern_count; ++i)
+	{
+		patterns[i] = global_print_types[i].pattern;
+	}
+	DataDeskCompileTypeMatcher(graph, &global_print_type_matcher, patterns, pattern_count);
+	global_no_print_tag = DataDeskGetTagID(graph, "NoPrint");
 }
 
 DATA_DESK_FUNC void
 DataDeskCustomParseCallback(DataDeskNode *root, char *filename)
 {
-	DataDeskFWriteGraphAsC(global_header_file, root, 0);
+	DataDeskFWriteGraphAsCWithGraph(global_header_file, global_graph, root, 0);
 	if(root->type == DATA_DESK_NODE_TYPE_struct_declaration)
 	{
 		fprintf(global_header_file, "void Print%s(%s *object);\n", root->string, root->string);
@@ -42,55 +90,31 @@ GeneratePrintCode(FILE *file, DataDeskNode *root, char *access_string)
 	fprintf(file, "printf(\"{ \");\n");
 	for(DataDeskNode *node = root; node; node = node->next)
 	{
-		if(!DataDeskNodeHasTag(node, "NoPrint") && node->type == DATA_DESK_NODE_TYPE_declaration)
+		if(!DataDeskNodeHasTagID(node, global_no_print_tag) && node->type == DATA_DESK_NODE_TYPE_declaration)
 		{
-			if(DataDeskDeclarationIsType(node, "int"     ) || DataDeskDeclarationIsType(node, "uint") ||
-			   DataDeskDeclarationIsType(node, "int32_t" ) || DataDeskDeclarationIsType(node, "i32" ) ||
-			   DataDeskDeclarationIsType(node, "int16_t" ) || DataDeskDeclarationIsType(node, "i16" ) ||
-			   DataDeskDeclarationIsType(node, "int8_t"  ) || DataDeskDeclarationIsType(node, "i8"  ) ||
-			   DataDeskDeclarationIsType(node, "uint32_t") || DataDeskDeclarationIsType(node, "u32" ) ||
-			   DataDeskDeclarationIsType(node, "uint16_t") || DataDeskDeclarationIsType(node, "u16" ) ||
-			   DataDeskDeclarationIsType(node, "uint8_t" ) || DataDeskDeclarationIsType(node, "u8"  ))
-			{
-				fprintf(file, "printf(\"%%i\", %s%s);\n", access_string, node->string);
-			}
-
-			else if(DataDeskDeclarationIsType(node, "float" ) || DataDeskDeclarationIsType(node, "double") ||
-			        DataDeskDeclarationIsType(node, "f32"   ) || DataDeskDeclarationIsType(node, "f64"   ))
-			{
-				fprintf(file, "printf(\"%%f\", %s%s);\n", access_string, node->string);
-			}
-
-			else if(DataDeskStringHasSubString("char", node->declaration.type->string) &&
-				    node->declaration.type->type_usage.first_array_size_expression)
-			{
-				fprintf(file, "printf(\"%%s\", %s%s);\n", access_string, node->string);
-			}
-
-			else if(DataDeskDeclarationIsType(node, "char"))
-			{
-				fprintf(file, "printf(\"%%c\", %s%s);\n", access_string, node->string);
-			}
-
-			else if(DataDeskDeclarationIsType(node, "*char"))
+			int print_type = DataDeskMatchType(&global_print_type_matcher, node);
+			if(DataDeskStringHasSubString("char", node->declaration.type->string) &&
+			   node->declaration.type->type_usage.first_array_size_expression)
 			{
 				fprintf(file, "printf(\"%%s\", %s%s);\n", access_string, node->string);
 			}
 
-			else if(DataDeskDeclarationIsType(node, "*void"))
+			else if(print_type >= 0)
 			{
-				fprintf(file, "printf(\"%%p\", %s%s);\n", access_string, node->string);
+				fprintf(file, "printf(\"%s\", %s%s);\n", global_print_types[print_type].format,
+						access_string, node->string);
 			}
 
 			else
 			{
-				if(node->declaration.type->type_usage.type_definition &&
+				DataDeskNode *type_definition = DataDeskGetTypeDefinition(global_graph, node);
+				if(type_definition &&
 			  	   node->declaration.type->type_usage.pointer_count <= 1)
 				{
 					char next_access_string[128] = {0};
 					snprintf(next_access_string, sizeof(next_access_string), "%s%s%s", access_string, node->string,
 							 node->declaration.type->type_usage.pointer_count == 1 ? "->" : ".");
-					GeneratePrintCode(file, node->declaration.type->type_usage.type_definition->struct_declaration.first_member,
+					GeneratePrintCode(file, type_definition->struct_declaration.first_member,
 									  next_access_string);
 				}
 				else if(node->declaration.type->type_usage.struct_declaration &&
@@ -63,16 +63,48 @@ License : MIT, at end of file.
 */
 
 typedef struct DataDeskNode DataDeskNode;
+typedef struct DataDeskGraph DataDeskGraph;
 
 /* DataDeskCustomInitCallback */
 typedef void DataDeskInitCallback(void);
 
 /* DataDeskCustomParseCallback */
+// Called for each top-level node, once every file has been parsed and
+// patched (after the graph callback), rather than as each file is parsed.
 typedef void DataDeskParseCallback(DataDeskNode *root, char *filename);
 
 /* DataDeskCustomCleanUpCallback */
 typedef void DataDeskCleanUpCallback(void);
 
+/* DataDeskCustomGraphCallback */
+// Called once per run, before the first parse callback.
+typedef void DataDeskGraphCallback(DataDeskGraph *graph);
+
+/* DataDeskCustomFileCallback */
+// Called before the parse callbacks for each file. With --streaming, the
+// graph's indices only cover that file when this is called.
+typedef void DataDeskFileCallback(DataDeskGraph *graph, char *filename);
+
+/*
+| DataDeskCustomServicesCallback is called before
+| DataDeskCustomInitCallback, with services that stay valid until
+| after DataDeskCustomCleanUpCallback. Files that the custom layer
+| writes should be passed to AddOutputFile (or opened with
+| DataDeskFOpenOutputFile), so that Data Desk knows what it
+| generated; --stamp relies on this.
+*/
+typedef struct DataDeskServices DataDeskServices;
+typedef void DataDeskAddOutputFileFunction(DataDeskServices *services, char *path);
+struct DataDeskServices
+{
+    // data is private.
+    void *data;
+    DataDeskAddOutputFileFunction *AddOutputFile;
+};
+
+/* DataDeskCustomServicesCallback */
+typedef void DataDeskServicesCallback(DataDeskServices *services);
+
 
 
 
@@ -111,6 +143,8 @@ enum DataDeskNodeType
     DATA_DESK_NODE_TYPE_tag,
     DATA_DESK_NODE_TYPE_constant_definition,
     DATA_DESK_NODE_TYPE_procedure_header,
+    DATA_DESK_NODE_TYPE_namespace_declaration,
+    DATA_DESK_NODE_TYPE_MAX
 };
 
 // NOTE(rjf): The unary operator precedence table in UnaryOperatorPrecedence
@@ -147,10 +181,46 @@ enum DataDeskBinaryOperatorType
     DATA_DESK_BINARY_OPERATOR_TYPE_MAX
 };
 
+#define DATA_DESK_CHILD_TABLE_THRESHOLD 8
+
+// Flags describing which lazily computed fields of a node are
+// filled out.
+enum
+{
+    // identifier.declaration or type_usage.type_definition has
+    // been looked up (it may still be 0, if the symbol doesn't exist).
+    DATA_DESK_NODE_FLAG_symbol_resolved = (1<<0),
+    
+    // hash has been computed.
+    DATA_DESK_NODE_FLAG_hash_computed   = (1<<1),
+    
+    // The node has been added to the DataDeskGraph indices.
+    DATA_DESK_NODE_FLAG_indexed         = (1<<2),
+    
+    // With --share-nodes, type usages and operands of constant
+    // expressions that are structurally identical are shared, rather than
+    // allocated once per use. Shared nodes have this flag set, can have
+    // more than one parent, and must not be modified.
+    DATA_DESK_NODE_FLAG_shared          = (1<<3),
+    
+    // With --skim, the body of the node (its members, constants,
+    // or flags) hasn't been parsed yet. See DataDeskExpandNode.
+    DATA_DESK_NODE_FLAG_skimmed         = (1<<4),
+    
+    // With --streaming, the node stands in for a declaration
+    // from a file that has already been released. It keeps the name, type,
+    // atom, hash, and layout of the declaration, but has no ID or tags.
+    DATA_DESK_NODE_FLAG_summary         = (1<<5),
+};
+
 struct DataDeskNode
 {
     DataDeskNodeType type;
     DataDeskNode *next;
+    unsigned int flags;
+    
+    // Index of this node in DataDeskGraph.node_locations.
+    int id;
     
     int string_length;
     union
@@ -163,8 +233,31 @@ struct DataDeskNode
     char *name_upper_camel_case;
     char *name_lower_camel_case;
     
+    // Interned ID of this node's name (see DataDeskGraph), or 0
+    // for nodes without a name (operators, literals, and tags).
+    int atom;
+    
+    // Structural hash of this node and everything below it (but
+    // not of the nodes after it in its list). Read it with DataDeskGetNodeHash.
+    unsigned long long hash;
+    
     DataDeskNode *first_tag;
     
+    // Bit N is set if this node has the tag with ID N (see
+    // DataDeskGraph). Only tag IDs below 64 get a bit; nodes with higher
+    // tag IDs fall back to walking first_tag.
+    unsigned long long tag_mask;
+    
+    // For structs, unions, enums, flags, procedure headers, and
+    // tags, these hold random-access copies of the members, constants,
+    // flags, parameters, or tag parameters lists, in order. Nodes with more
+    // than DATA_DESK_CHILD_TABLE_THRESHOLD children also get an open-addressed
+    // table of children keyed by child atom (see DataDeskGetChildByAtom).
+    int child_count;
+    DataDeskNode **children;
+    unsigned int child_table_max;
+    DataDeskNode **child_table;
+    
     union
     {
         struct Identifier
@@ -232,6 +325,7 @@ struct DataDeskNode
         struct Tag
         {
             DataDeskNode *first_tag_parameter;
+            int id;
         }
         tag;
         
@@ -247,9 +341,415 @@ struct DataDeskNode
             DataDeskNode *first_parameter;
         }
         procedure_header;
+        
+        struct NamespaceDeclaration
+        {
+            DataDeskNode *first_member;
+            int scope;
+        }
+        namespace_declaration;
+    };
+};
+
+
+
+
+
+/*
+| /////////////////////////////////////////////////////////////////
+|  Graph Indices
+| /////////////////////////////////////////////////////////////////
+|
+| Data Desk builds indices over every node it parses, including
+| nested ones, in a DataDeskGraph. It is passed to the custom
+| layer's graph callback before the first parse callback. Strings
+| are interned into DataDeskStringTables, which map each distinct
+| string to an ID starting at 1 (0 is never a valid ID). Once the
+| graph is frozen, every function here that reads it can be called
+| from many threads at once. Custom layers must never write to it.
+| See the README for how the command line options change the graph.
+*/
+
+typedef struct DataDeskStringTable DataDeskStringTable;
+struct DataDeskStringTable
+{
+    int count;
+    int string_max;
+    char **strings;
+    int *string_lengths;
+    unsigned int slot_max;
+    int *slots;
+};
+
+typedef struct DataDeskTagInfo DataDeskTagInfo;
+struct DataDeskTagInfo
+{
+    int node_count;
+    int node_max;
+    DataDeskNode **nodes;
+};
+
+typedef struct DataDeskSourceFile DataDeskSourceFile;
+struct DataDeskSourceFile
+{
+    char *filename;
+    char *canonical_path;
+    char *contents;
+    int contents_length;
+    DataDeskNode *root;
+    
+    // IDs of the files that this file @Imports, in order.
+    int import_count;
+    int import_max;
+    int *imports;
+    
+    // Byte offset at which each line starts.
+    int line_count;
+    int *line_offsets;
+};
+
+// Indexed by node ID. The range runs from the node's first token to the end
+// of its last one (not including its tags). parent is 0 for top-level nodes.
+// Shared nodes have the location of the first place they were used.
+typedef struct DataDeskNodeLocation DataDeskNodeLocation;
+struct DataDeskNodeLocation
+{
+    int file;
+    int start_offset;
+    int end_offset;
+    DataDeskNode *parent;
+};
+
+typedef struct DataDeskSourceLocation DataDeskSourceLocation;
+struct DataDeskSourceLocation
+{
+    char *filename;
+    int file;
+    int start_offset;
+    int end_offset;
+    int line;
+    int column;
+};
+
+// reference is the node that uses the name; it decides which
+// namespace the lookup starts in.
+typedef DataDeskNode *DataDeskLookUpSymbolFunction(DataDeskGraph *graph, DataDeskNode *reference, char *name, int name_length);
+typedef int DataDeskExpandNodeFunction(DataDeskGraph *graph, DataDeskNode *node);
+
+struct DataDeskGraph
+{
+    // Services provided by Data Desk. parse_context is private.
+    void *parse_context;
+    DataDeskLookUpSymbolFunction *LookUpSymbol;
+    DataDeskExpandNodeFunction *ExpandNode;
+    
+    // Set once symbols and hashes are filled out for every node, after which
+    // nothing writes to the graph. Not set with --lazy-symbols and a single
+    // custom layer.
+    int frozen;
+    
+    // Tag names (without '@') and node names. tag_infos[id] lists the nodes
+    // with each tag, in the order they were parsed.
+    DataDeskStringTable tags;
+    DataDeskTagInfo *tag_infos;
+    DataDeskStringTable atoms;
+    
+    // Every node of each type, nested or not, in the order they were parsed.
+    int type_node_counts[DATA_DESK_NODE_TYPE_MAX];
+    int type_node_maxes[DATA_DESK_NODE_TYPE_MAX];
+    DataDeskNode **type_nodes[DATA_DESK_NODE_TYPE_MAX];
+    
+    int file_count;
+    int file_max;
+    DataDeskSourceFile *files;
+    
+    int node_count;
+    int node_location_max;
+    DataDeskNodeLocation *node_locations;
+};
+
+/*
+| A DataDeskTypeMatcher is compiled once from a list of type
+| patterns, and can then find which pattern a declaration's type
+| matches with a single hash probe, rather than comparing strings
+| for every pattern (as DataDeskDeclarationIsType does).
+|
+| Patterns have the form "name", "*name", "**name[]", and so on.
+| Leading '*'s give the pointer count. A trailing "[]" means the
+| pattern only matches array types; without it, a pattern matches
+| both array and non-array types, like DataDeskDeclarationIsType.
+| When more than one pattern matches, the earliest one wins.
+|
+| DataDeskMatchType returns the index of the matching pattern, or
+| -1 if no pattern matches. Matchers must be compiled after the
+| graph has been built (in or after DataDeskCustomGraphCallback),
+| because patterns are compiled to atoms.
+*/
+
+#define DATA_DESK_TYPE_MATCHER_SLOT_MAX 256
+
+typedef struct DataDeskTypeMatcherSlot DataDeskTypeMatcherSlot;
+struct DataDeskTypeMatcherSlot
+{
+    int atom;
+    int pointer_count;
+    int array;
+    int pattern_index;
+};
+
+typedef struct DataDeskTypeMatcher DataDeskTypeMatcher;
+struct DataDeskTypeMatcher
+{
+    DataDeskTypeMatcherSlot slots[DATA_DESK_TYPE_MATCHER_SLOT_MAX];
+};
+
+/*
+| Queries select nodes from the graph with a compact syntax, and
+| are compiled once into a DataDeskQuery. For example:
+|
+|   struct[@Serialize] > member[type=f32, !@NoPrint]
+|
+| A query is a list of steps separated by '>', where each step
+| must match a child (member, constant, flag, parameter) of the
+| node matched by the previous step. Each step has a node kind:
+|
+|   struct, union, enum, flags, proc, const, decl (or member),
+|   namespace, ident, or * (any kind)
+|
+| ...optionally followed by a bracketed, comma-separated list of
+| predicates, all of which must hold:
+|
+|   @Tag          the node has the tag
+|   type=pattern  the node's type matches a type matcher pattern
+|   name=name     the node's name is exactly this
+|
+| Any predicate can be negated with a leading '!'.
+|
+| The first step is run over the smallest tag index named by a
+| predicate, otherwise over the per-type index for its kind, and
+| only falls back to a scan of every node for "*" with no tags.
+| Later steps walk child arrays. Use DataDeskQueryIterate and
+| DataDeskQueryNext to read results; the iterator's "matches"
+| array holds the node matched by each step for the current
+| result (so matches[0] is the struct that a member belongs to).
+| A query can be kept and iterated again after nodes are expanded,
+| but nodes must not be expanded while an iteration is running.
+*/
+
+#define DATA_DESK_QUERY_STEP_MAX 8
+#define DATA_DESK_QUERY_PREDICATE_MAX 8
+
+typedef enum DataDeskQueryPredicateType DataDeskQueryPredicateType;
+enum DataDeskQueryPredicateType
+{
+    DATA_DESK_QUERY_PREDICATE_TYPE_invalid,
+    DATA_DESK_QUERY_PREDICATE_TYPE_tag,
+    DATA_DESK_QUERY_PREDICATE_TYPE_type,
+    DATA_DESK_QUERY_PREDICATE_TYPE_name,
+};
+
+typedef struct DataDeskQueryPredicate DataDeskQueryPredicate;
+struct DataDeskQueryPredicate
+{
+    DataDeskQueryPredicateType type;
+    int negate;
+    int id;
+    int pointer_count;
+    int array_only;
+};
+
+typedef struct DataDeskQueryStep DataDeskQueryStep;
+struct DataDeskQueryStep
+{
+    DataDeskNodeType node_type;
+    int predicate_count;
+    DataDeskQueryPredicate predicates[DATA_DESK_QUERY_PREDICATE_MAX];
+};
+
+typedef struct DataDeskQuery DataDeskQuery;
+struct DataDeskQuery
+{
+    int step_count;
+    DataDeskQueryStep steps[DATA_DESK_QUERY_STEP_MAX];
+    
+    // If empty is set, the query can never match (it requires a
+    // tag or name that appears nowhere).
+    int empty;
+};
+
+typedef struct DataDeskQueryIterator DataDeskQueryIterator;
+struct DataDeskQueryIterator
+{
+    DataDeskGraph *graph;
+    DataDeskQuery *query;
+    int step;
+    int source_type;
+    
+    // Chosen when iteration starts, since the indices can grow
+    // (and move) when nodes are expanded. If source_node_count is -1, the
+    // first step scans every node in the graph.
+    int source_node_count;
+    DataDeskNode **source_nodes;
+    
+    int indices[DATA_DESK_QUERY_STEP_MAX];
+    DataDeskNode *matches[DATA_DESK_QUERY_STEP_MAX];
+};
+
+
+
+
+
+/*
+| /////////////////////////////////////////////////////////////////
+|  Binary AST Files
+| /////////////////////////////////////////////////////////////////
+|
+| "data_desk --emit-ast path" writes the patched graph (after every
+| symbol and hash is filled out, and before it's sent to the custom
+| layer) to a binary file that other tools can use as it sits in
+| memory, without parsing it or fixing up pointers. Many processes
+| can map the same file and share its pages.
+|
+| A file starts with a DataDeskASTHeader. Every section is found by
+| its byte offset from the start of the file, and nothing in the
+| file is a pointer, so it can be mapped at any address:
+|
+|   - nodes: one DataDeskASTNode per node, indexed by node ID.
+|     Index 0 is unused, so that 0 can mean "no node". Nodes refer
+|     to each other by index, with the same field names as in
+|     DataDeskNode (next, first_tag, type_usage.type_definition,
+|     and so on). Shared nodes (see --share-nodes) are stored once.
+|   - strings: a pool of null-terminated strings, each stored once.
+|     Node names and other strings are offsets into it; offset 0
+|     is the empty string.
+|   - indices: a pool of node indices that lists refer to by their
+|     position in it (children, the per-type indices, and the nodes
+|     with each tag).
+|   - files: one DataDeskASTFile per source file, indexed by file
+|     ID (from 1), with its first top-level node.
+|   - atoms and tags: string table entries (as string offsets) for
+|     atom and tag IDs, which are the same as they were in the graph
+|     the file was written from.
+|
+| Everything is stored in the byte order of the machine that wrote
+| the file. DataDeskASTFromMemory checks the header and returns a
+| DataDeskAST with header set to 0 if the memory isn't a binary AST
+| file of this version. To map a file from disk, define
+| DATA_DESK_AST_LOADER before including this header (it pulls in
+| operating system headers), and use DataDeskLoadAST and
+| DataDeskUnloadAST.
+*/
+
+#define DATA_DESK_AST_MAGIC   0x54534444 /* "DDST" */
+#define DATA_DESK_AST_VERSION 1
+
+typedef struct DataDeskASTHeader DataDeskASTHeader;
+struct DataDeskASTHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int size;
+    unsigned int node_count;
+    unsigned int nodes;
+    unsigned int string_pool_size;
+    unsigned int strings;
+    unsigned int index_count;
+    unsigned int indices;
+    unsigned int file_count;
+    unsigned int files;
+    unsigned int atom_count;
+    unsigned int atoms;
+    unsigned int tag_count;
+    unsigned int tags;
+    unsigned int type_node_counts[DATA_DESK_NODE_TYPE_MAX];
+    unsigned int type_nodes[DATA_DESK_NODE_TYPE_MAX];
+};
+
+typedef struct DataDeskASTNode DataDeskASTNode;
+struct DataDeskASTNode
+{
+    unsigned int type;
+    unsigned int flags;
+    unsigned int next;
+    unsigned int parent;
+    
+    unsigned int string_length;
+    unsigned int string;
+    unsigned int name_lowercase_with_underscores;
+    unsigned int name_uppercase_with_underscores;
+    unsigned int name_upper_camel_case;
+    unsigned int name_lower_camel_case;
+    unsigned int atom;
+    
+    unsigned int first_tag;
+    unsigned int child_count;
+    unsigned int children;
+    
+    unsigned int file;
+    unsigned int start_offset;
+    unsigned int end_offset;
+    unsigned int pad;
+    
+    unsigned long long hash;
+    unsigned long long tag_mask;
+    
+    union
+    {
+        struct { unsigned int declaration; } identifier;
+        struct { unsigned int type; unsigned int operand; } unary_operator;
+        struct { unsigned int type; unsigned int left; unsigned int right; } binary_operator;
+        struct { unsigned int first_member; } struct_declaration;
+        struct { unsigned int first_member; } union_declaration;
+        struct { unsigned int first_constant; } enum_declaration;
+        struct { unsigned int first_flag; } flags_declaration;
+        struct { unsigned int type; unsigned int initialization; } declaration;
+        struct
+        {
+            unsigned int pointer_count;
+            unsigned int first_array_size_expression;
+            unsigned int struct_declaration;
+            unsigned int union_declaration;
+            unsigned int type_definition;
+        }
+        type_usage;
+        struct { unsigned int first_tag_parameter; unsigned int id; } tag;
+        struct { unsigned int expression; } constant_definition;
+        struct { unsigned int return_type; unsigned int first_parameter; } procedure_header;
+        struct { unsigned int first_member; unsigned int scope; } namespace_declaration;
     };
 };
 
+typedef struct DataDeskASTFile DataDeskASTFile;
+struct DataDeskASTFile
+{
+    unsigned int filename;
+    unsigned int first_root;
+};
+
+typedef struct DataDeskASTTag DataDeskASTTag;
+struct DataDeskASTTag
+{
+    unsigned int name;
+    unsigned int node_count;
+    unsigned int nodes;
+};
+
+typedef struct DataDeskAST DataDeskAST;
+struct DataDeskAST
+{
+    DataDeskASTHeader *header;
+    DataDeskASTNode *nodes;
+    char *strings;
+    unsigned int *indices;
+    DataDeskASTFile *files;
+    unsigned int *atoms;
+    DataDeskASTTag *tags;
+    
+    // Only used by DataDeskLoadAST/DataDeskUnloadAST.
+    void *mapping;
+    unsigned int mapping_size;
+};
+
 
 
 
@@ -272,9 +772,43 @@ DATA_DESK_HEADER_PROC int DataDeskDeclarationIsType(DataDeskNode *root, char *ty
 DATA_DESK_HEADER_PROC int DataDeskStructMemberIsType(DataDeskNode *root, char *type);
 DATA_DESK_HEADER_PROC int DataDeskInterpretNumericExpressionAsInteger(DataDeskNode *root);
 DATA_DESK_HEADER_PROC char *DataDeskGetBinaryOperatorString(int type);
+DATA_DESK_HEADER_PROC unsigned int DataDeskHashStringN(char *string, int string_length);
+DATA_DESK_HEADER_PROC int DataDeskStringTableLookUp(DataDeskStringTable *table, char *string, int string_length);
+DATA_DESK_HEADER_PROC int DataDeskGetAtom(DataDeskGraph *graph, char *string);
+DATA_DESK_HEADER_PROC int DataDeskGetAtomN(DataDeskGraph *graph, char *string, int string_length);
+DATA_DESK_HEADER_PROC int DataDeskGetTagID(DataDeskGraph *graph, char *tag);
+DATA_DESK_HEADER_PROC int DataDeskGetTagIDN(DataDeskGraph *graph, char *tag, int tag_length);
+DATA_DESK_HEADER_PROC DataDeskNode *DataDeskGetNodeTagByID(DataDeskNode *root, int tag_id);
+DATA_DESK_HEADER_PROC int DataDeskNodeHasTagID(DataDeskNode *root, int tag_id);
+DATA_DESK_HEADER_PROC DataDeskNode *DataDeskGetNodeTagWithGraph(DataDeskGraph *graph, DataDeskNode *root, char *tag);
+DATA_DESK_HEADER_PROC int DataDeskNodeHasTagWithGraph(DataDeskGraph *graph, DataDeskNode *root, char *tag);
+DATA_DESK_HEADER_PROC DataDeskNode **DataDeskGetNodesWithTag(DataDeskGraph *graph, char *tag, int *count);
+DATA_DESK_HEADER_PROC DataDeskNode **DataDeskGetAllNodesOfType(DataDeskGraph *graph, DataDeskNodeType type, int *count);
+DATA_DESK_HEADER_PROC DataDeskNode *DataDeskGetIdentifierDeclaration(DataDeskGraph *graph, DataDeskNode *root);
+DATA_DESK_HEADER_PROC DataDeskNode *DataDeskGetTypeDefinition(DataDeskGraph *graph, DataDeskNode *root);
+DATA_DESK_HEADER_PROC unsigned long long DataDeskGetNodeHash(DataDeskGraph *graph, DataDeskNode *root);
+DATA_DESK_HEADER_PROC DataDeskSourceLocation DataDeskGetNodeLocation(DataDeskGraph *graph, DataDeskNode *root);
+DATA_DESK_HEADER_PROC DataDeskNode *DataDeskGetNodeParent(DataDeskGraph *graph, DataDeskNode *root);
+DATA_DESK_HEADER_PROC int DataDeskExpandNode(DataDeskGraph *graph, DataDeskNode *root);
+DATA_DESK_HEADER_PROC DataDeskNode *DataDeskGetChild(DataDeskNode *root, int index);
+DATA_DESK_HEADER_PROC DataDeskNode *DataDeskGetChildByAtom(DataDeskNode *root, int atom);
+DATA_DESK_HEADER_PROC DataDeskNode *DataDeskGetChildByName(DataDeskGraph *graph, DataDeskNode *root, char *name);
+DATA_DESK_HEADER_PROC int DataDeskCompileTypeMatcher(DataDeskGraph *graph, DataDeskTypeMatcher *matcher, char **patterns, int pattern_count);
+DATA_DESK_HEADER_PROC int DataDeskMatchType(DataDeskTypeMatcher *matcher, DataDeskNode *root);
+DATA_DESK_HEADER_PROC int DataDeskCompileQuery(DataDeskGraph *graph, DataDeskQuery *query, char *query_string);
+DATA_DESK_HEADER_PROC DataDeskQueryIterator DataDeskQueryIterate(DataDeskGraph *graph, DataDeskQuery *query);
+DATA_DESK_HEADER_PROC DataDeskNode *DataDeskQueryNext(DataDeskQueryIterator *iterator);
+DATA_DESK_HEADER_PROC DataDeskAST DataDeskASTFromMemory(void *memory, unsigned int size);
+DATA_DESK_HEADER_PROC DataDeskASTNode *DataDeskASTGetNode(DataDeskAST *ast, unsigned int index);
+DATA_DESK_HEADER_PROC char *DataDeskASTGetString(DataDeskAST *ast, unsigned int offset);
+DATA_DESK_HEADER_PROC DataDeskASTNode *DataDeskASTGetChild(DataDeskAST *ast, DataDeskASTNode *root, unsigned int index);
+DATA_DESK_HEADER_PROC DataDeskASTNode *DataDeskASTGetFileRoot(DataDeskAST *ast, unsigned int file);
+DATA_DESK_HEADER_PROC unsigned int *DataDeskASTGetAllNodesOfType(DataDeskAST *ast, DataDeskNodeType type, unsigned int *count);
+DATA_DESK_HEADER_PROC unsigned int *DataDeskASTGetNodesWithTag(DataDeskAST *ast, char *tag, unsigned int *count);
 
 #ifndef DATA_DESK_NO_CRT
 DATA_DESK_HEADER_PROC void DataDeskFWriteGraphAsC(FILE *file, DataDeskNode *root, int follow_next);
+DATA_DESK_HEADER_PROC void DataDeskFWriteGraphAsCWithGraph(FILE *file, DataDeskGraph *graph, DataDeskNode *root, int follow_next);
 DATA_DESK_HEADER_PROC void DataDeskFWriteStringWithSpaces(FILE *file, char *string);
 DATA_DESK_HEADER_PROC void DataDeskFWriteStringAsLowercaseWithUnderscores(FILE *file, char *string);
 DATA_DESK_HEADER_PROC void DataDeskFWriteStringAsUppercaseWithUnderscores(FILE *file, char *string);
@@ -285,6 +819,7 @@ DATA_DESK_HEADER_PROC void DataDeskFWriteStringAsLowercaseWithUnderscoresN(FILE
 DATA_DESK_HEADER_PROC void DataDeskFWriteStringAsUppercaseWithUnderscoresN(FILE *file, char *string, int string_length);
 DATA_DESK_HEADER_PROC void DataDeskFWriteStringAsUpperCamelCaseN(FILE *file, char *string, int string_length);
 DATA_DESK_HEADER_PROC void DataDeskFWriteStringAsLowerCamelCaseN(FILE *file, char *string, int string_length);
+DATA_DESK_HEADER_PROC FILE *DataDeskFOpenOutputFile(DataDeskServices *services, char *path, char *mode);
 #endif
 
 
@@ -394,6 +929,10 @@ DataDeskStringHasSubString(char *string, char *substring)
     return DataDeskStringHasAlphanumericBlock(string, substring);
 }
 
+// Without a graph, tags can only be found by comparing names. With one, use
+// DataDeskGetNodeTagWithGraph and DataDeskNodeHasTagWithGraph, which go
+// through the interned tag IDs (or look the ID up once, and use the *ByID
+// functions).
 DATA_DESK_HEADER_PROC DataDeskNode *
 DataDeskGetNodeTag(DataDeskNode *root, char *tag)
 {
@@ -414,19 +953,10 @@ DATA_DESK_HEADER_PROC DataDeskNode *
 DataDeskGetTagParameter(DataDeskNode *tag, int parameter_number)
 {
     DataDeskNode *result = 0;
-    if(tag && tag->type == DATA_DESK_NODE_TYPE_tag)
+    if(tag && tag->type == DATA_DESK_NODE_TYPE_tag &&
+       parameter_number >= 0 && parameter_number < tag->child_count)
     {
-        int i = 0;
-        for(DataDeskNode *parameter = tag->tag.first_tag_parameter;
-            parameter; parameter = parameter->next)
-        {
-            if(i == parameter_number)
-            {
-                result = parameter;
-                break;
-            }
-            ++i;
-        }
+        result = tag->children[parameter_number];
     }
     return result;
 }
@@ -614,105 +1144,1285 @@ DataDeskGetBinaryOperatorString(int type)
     return strings[type];
 }
 
-DATA_DESK_HEADER_PROC char *
-DataDeskGetUnaryOperatorString(int type)
+DATA_DESK_HEADER_PROC unsigned int
+DataDeskHashStringN(char *string, int string_length)
 {
-    char *strings[] =
+    // FNV-1a.
+    unsigned int hash = 2166136261u;
+    for(int i = 0; i < string_length; ++i)
     {
-        "(invalid)",
-        "-",
-        "!",
-        "~",
-    };
-    return strings[type];
+        hash ^= (unsigned char)string[i];
+        hash *= 16777619u;
+    }
+    return hash;
 }
 
-#ifndef DATA_DESK_NO_CRT
-DATA_DESK_HEADER_PROC void
-_DataDeskFWriteGraphAsC(FILE *file, DataDeskNode *root, int follow_next, int nest)
+DATA_DESK_HEADER_PROC int
+DataDeskStringTableLookUp(DataDeskStringTable *table, char *string, int string_length)
 {
-    if(root)
+    int id = 0;
+    if(table && string && table->slot_max)
     {
-        if(root->first_tag)
-        {
-            fprintf(file, "// ");
-            for(DataDeskNode *tag = root->first_tag; tag; tag = tag->next)
-            {
-                fprintf(file, "%s", tag->string);
-                
-                if(tag->tag.first_tag_parameter)
-                {
-                    fprintf(file, "(");
-                    for(DataDeskNode *tag_arg = tag->tag.first_tag_parameter; tag_arg; tag_arg = tag_arg->next)
-                    {
-                        _DataDeskFWriteGraphAsC(file, tag_arg, 0, nest+1);
-                        if(tag_arg->next)
-                        {
-                            fprintf(file, ", ");
-                        }
-                    }
-                    fprintf(file, ")");
-                }
-                fprintf(file, " ");
-            }
-            fprintf(file, "\n");
-        }
-        
-        switch(root->type)
+        // String tables are never more than half full, so this
+        // always terminates on an empty slot.
+        unsigned int slot = DataDeskHashStringN(string, string_length) & (table->slot_max - 1);
+        for(;;)
         {
-            case DATA_DESK_NODE_TYPE_identifier:
-            case DATA_DESK_NODE_TYPE_numeric_constant:
-            case DATA_DESK_NODE_TYPE_string_constant:
-            case DATA_DESK_NODE_TYPE_char_constant:
+            int candidate = table->slots[slot];
+            if(candidate == 0)
             {
-                fprintf(file, "%s", root->string);
                 break;
             }
             
-            case DATA_DESK_NODE_TYPE_unary_operator:
+            if(table->string_lengths[candidate] == string_length)
             {
-                fprintf(file, "(");
-                char *unary_operator_string = DataDeskGetUnaryOperatorString(root->unary_operator.type);
-                fprintf(file, "%s", unary_operator_string);
-                fprintf(file, "(");
-                _DataDeskFWriteGraphAsC(file, root->unary_operator.operand, 0, nest+1);
-                fprintf(file, ")");
-                fprintf(file, ")");
-                break;
+                char *candidate_string = table->strings[candidate];
+                int i = 0;
+                for(; i < string_length && candidate_string[i] == string[i]; ++i);
+                if(i == string_length)
+                {
+                    id = candidate;
+                    break;
+                }
             }
             
-            case DATA_DESK_NODE_TYPE_binary_operator:
+            slot = (slot + 1) & (table->slot_max - 1);
+        }
+    }
+    return id;
+}
+
+DATA_DESK_HEADER_PROC int
+DataDeskGetAtomN(DataDeskGraph *graph, char *string, int string_length)
+{
+    return graph ? DataDeskStringTableLookUp(&graph->atoms, string, string_length) : 0;
+}
+
+DATA_DESK_HEADER_PROC int
+DataDeskGetAtom(DataDeskGraph *graph, char *string)
+{
+    int string_length = 0;
+    if(string)
+    {
+        for(; string[string_length]; ++string_length);
+    }
+    return DataDeskGetAtomN(graph, string, string_length);
+}
+
+DATA_DESK_HEADER_PROC int
+DataDeskGetTagIDN(DataDeskGraph *graph, char *tag, int tag_length)
+{
+    int id = 0;
+    if(graph && tag)
+    {
+        if(tag_length > 0 && tag[0] == '@')
+        {
+            ++tag;
+            --tag_length;
+        }
+        id = DataDeskStringTableLookUp(&graph->tags, tag, tag_length);
+    }
+    return id;
+}
+
+DATA_DESK_HEADER_PROC int
+DataDeskGetTagID(DataDeskGraph *graph, char *tag)
+{
+    int tag_length = 0;
+    if(tag)
+    {
+        for(; tag[tag_length]; ++tag_length);
+    }
+    return DataDeskGetTagIDN(graph, tag, tag_length);
+}
+
+DATA_DESK_HEADER_PROC DataDeskNode *
+DataDeskGetNodeTagByID(DataDeskNode *root, int tag_id)
+{
+    DataDeskNode *found_tag_node = 0;
+    if(root && tag_id > 0 &&
+       (tag_id >= 64 || (root->tag_mask & (1ull << tag_id))))
+    {
+        for(DataDeskNode *tag_node = root->first_tag;
+            tag_node; tag_node = tag_node->next)
+        {
+            if(tag_node->tag.id == tag_id)
             {
-                fprintf(file, "(");
-                _DataDeskFWriteGraphAsC(file, root->binary_operator.left, 0, nest);
-                char *binary_operator_string = DataDeskGetBinaryOperatorString(root->binary_operator.type);
-                fprintf(file, "%s", binary_operator_string);
-                _DataDeskFWriteGraphAsC(file, root->binary_operator.right, 0, nest+1);
-                fprintf(file, ")");
-                
+                found_tag_node = tag_node;
                 break;
             }
-            
-            case DATA_DESK_NODE_TYPE_struct_declaration:
-            {
-                if(nest == 0)
-                {
-                    fprintf(file, "typedef struct %s %s;\n", root->string, root->string);
-                }
-                
-                if(root->string)
-                {
-                    fprintf(file, "struct %s\n{\n", root->string);
-                }
-                else
-                {
+        }
+    }
+    return found_tag_node;
+}
+
+DATA_DESK_HEADER_PROC int
+DataDeskNodeHasTagID(DataDeskNode *root, int tag_id)
+{
+    int result = 0;
+    if(root && tag_id > 0)
+    {
+        if(tag_id < 64)
+        {
+            result = (root->tag_mask & (1ull << tag_id)) != 0;
+        }
+        else
+        {
+            result = DataDeskGetNodeTagByID(root, tag_id) != 0;
+        }
+    }
+    return result;
+}
+
+// Like DataDeskGetNodeTag and DataDeskNodeHasTag, but the tag is looked up
+// in the graph's tag table first, so the check on the node is a bit test
+// (for the first 63 tags). Tag names must match exactly (a leading '@' is
+// allowed).
+DATA_DESK_HEADER_PROC DataDeskNode *
+DataDeskGetNodeTagWithGraph(DataDeskGraph *graph, DataDeskNode *root, char *tag)
+{
+    return DataDeskGetNodeTagByID(root, DataDeskGetTagID(graph, tag));
+}
+
+DATA_DESK_HEADER_PROC int
+DataDeskNodeHasTagWithGraph(DataDeskGraph *graph, DataDeskNode *root, char *tag)
+{
+    return DataDeskNodeHasTagID(root, DataDeskGetTagID(graph, tag));
+}
+
+DATA_DESK_HEADER_PROC DataDeskNode **
+DataDeskGetNodesWithTag(DataDeskGraph *graph, char *tag, int *count)
+{
+    DataDeskNode **nodes = 0;
+    int node_count = 0;
+    int tag_id = DataDeskGetTagID(graph, tag);
+    if(tag_id)
+    {
+        nodes = graph->tag_infos[tag_id].nodes;
+        node_count = graph->tag_infos[tag_id].node_count;
+    }
+    if(count)
+    {
+        *count = node_count;
+    }
+    return nodes;
+}
+
+DATA_DESK_HEADER_PROC DataDeskNode **
+DataDeskGetAllNodesOfType(DataDeskGraph *graph, DataDeskNodeType type, int *count)
+{
+    DataDeskNode **nodes = 0;
+    int node_count = 0;
+    if(graph && type > DATA_DESK_NODE_TYPE_invalid && type < DATA_DESK_NODE_TYPE_MAX)
+    {
+        nodes = graph->type_nodes[type];
+        node_count = graph->type_node_counts[type];
+    }
+    if(count)
+    {
+        *count = node_count;
+    }
+    return nodes;
+}
+
+// When graph->frozen isn't set (--lazy-symbols with one custom
+// layer), this resolves the identifier and writes the result to it, so it
+// isn't thread-safe; call it from one thread at a time.
+DATA_DESK_HEADER_PROC DataDeskNode *
+DataDeskGetIdentifierDeclaration(DataDeskGraph *graph, DataDeskNode *root)
+{
+    DataDeskNode *declaration = 0;
+    if(root && root->type == DATA_DESK_NODE_TYPE_identifier)
+    {
+        if(!(root->flags & DATA_DESK_NODE_FLAG_symbol_resolved) && graph && graph->LookUpSymbol)
+        {
+            root->identifier.declaration = graph->LookUpSymbol(graph, root, root->string, root->string_length);
+            root->flags |= DATA_DESK_NODE_FLAG_symbol_resolved;
+        }
+        declaration = root->identifier.declaration;
+    }
+    return declaration;
+}
+
+// Like DataDeskGetIdentifierDeclaration, this writes to the node
+// (and isn't thread-safe) when graph->frozen isn't set.
+DATA_DESK_HEADER_PROC DataDeskNode *
+DataDeskGetTypeDefinition(DataDeskGraph *graph, DataDeskNode *root)
+{
+    DataDeskNode *definition = 0;
+    if(root && root->type == DATA_DESK_NODE_TYPE_declaration)
+    {
+        root = root->declaration.type;
+    }
+    if(root && root->type == DATA_DESK_NODE_TYPE_type_usage)
+    {
+        if(!(root->flags & DATA_DESK_NODE_FLAG_symbol_resolved) && graph && graph->LookUpSymbol &&
+           !root->type_usage.struct_declaration && !root->type_usage.union_declaration)
+        {
+            root->type_usage.type_definition = graph->LookUpSymbol(graph, root, root->string, root->string_length);
+            root->flags |= DATA_DESK_NODE_FLAG_symbol_resolved;
+        }
+        definition = root->type_usage.type_definition;
+    }
+    return definition;
+}
+
+DATA_DESK_HEADER_PROC unsigned long long
+_DataDeskHashMix(unsigned long long hash, unsigned long long value)
+{
+    hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+DATA_DESK_HEADER_PROC unsigned long long
+_DataDeskHashBytes(unsigned long long hash, char *string, int string_length)
+{
+    // FNV-1a, seeded with the incoming hash.
+    unsigned long long result = 14695981039346656037ull ^ hash;
+    for(int i = 0; i < string_length; ++i)
+    {
+        result ^= (unsigned char)string[i];
+        result *= 1099511628211ull;
+    }
+    return _DataDeskHashMix(result, (unsigned long long)string_length);
+}
+
+DATA_DESK_HEADER_PROC unsigned long long
+_DataDeskHashNodeList(DataDeskGraph *graph, unsigned long long hash, DataDeskNode *first)
+{
+    unsigned long long count = 0;
+    for(DataDeskNode *node = first; node; node = node->next)
+    {
+        hash = _DataDeskHashMix(hash, DataDeskGetNodeHash(graph, node));
+        ++count;
+    }
+    return _DataDeskHashMix(hash, count);
+}
+
+// When graph->frozen isn't set, hashes are computed (and stored
+// in the nodes) on demand, so this isn't thread-safe.
+DATA_DESK_HEADER_PROC unsigned long long
+DataDeskGetNodeHash(DataDeskGraph *graph, DataDeskNode *root)
+{
+    unsigned long long hash = 0;
+    if(root)
+    {
+        if(root->flags & DATA_DESK_NODE_FLAG_hash_computed)
+        {
+            hash = root->hash;
+        }
+        else
+        {
+            hash = _DataDeskHashMix(0, (unsigned long long)root->type);
+            hash = _DataDeskHashBytes(hash, root->string, root->string ? root->string_length : 0);
+            
+            for(DataDeskNode *tag = root->first_tag; tag; tag = tag->next)
+            {
+                hash = _DataDeskHashBytes(hash, tag->string, tag->string_length);
+                hash = _DataDeskHashNodeList(graph, hash, tag->tag.first_tag_parameter);
+            }
+            
+            switch(root->type)
+            {
+                case DATA_DESK_NODE_TYPE_unary_operator:
+                {
+                    hash = _DataDeskHashMix(hash, (unsigned long long)root->unary_operator.type);
+                    hash = _DataDeskHashMix(hash, DataDeskGetNodeHash(graph, root->unary_operator.operand));
+                    break;
+                }
+                case DATA_DESK_NODE_TYPE_binary_operator:
+                {
+                    hash = _DataDeskHashMix(hash, (unsigned long long)root->binary_operator.type);
+                    hash = _DataDeskHashMix(hash, DataDeskGetNodeHash(graph, root->binary_operator.left));
+                    hash = _DataDeskHashMix(hash, DataDeskGetNodeHash(graph, root->binary_operator.right));
+                    break;
+                }
+                case DATA_DESK_NODE_TYPE_struct_declaration:
+                {
+                    hash = _DataDeskHashNodeList(graph, hash, root->struct_declaration.first_member);
+                    break;
+                }
+                case DATA_DESK_NODE_TYPE_union_declaration:
+                {
+                    hash = _DataDeskHashNodeList(graph, hash, root->union_declaration.first_member);
+                    break;
+                }
+                case DATA_DESK_NODE_TYPE_enum_declaration:
+                {
+                    hash = _DataDeskHashNodeList(graph, hash, root->enum_declaration.first_constant);
+                    break;
+                }
+                case DATA_DESK_NODE_TYPE_flags_declaration:
+                {
+                    hash = _DataDeskHashNodeList(graph, hash, root->flags_declaration.first_flag);
+                    break;
+                }
+                case DATA_DESK_NODE_TYPE_declaration:
+                {
+                    hash = _DataDeskHashMix(hash, DataDeskGetNodeHash(graph, root->declaration.type));
+                    hash = _DataDeskHashMix(hash, DataDeskGetNodeHash(graph, root->declaration.initialization));
+                    break;
+                }
+                case DATA_DESK_NODE_TYPE_type_usage:
+                {
+                    hash = _DataDeskHashMix(hash, (unsigned long long)root->type_usage.pointer_count);
+                    hash = _DataDeskHashNodeList(graph, hash, root->type_usage.first_array_size_expression);
+                    hash = _DataDeskHashMix(hash, DataDeskGetNodeHash(graph, root->type_usage.struct_declaration));
+                    hash = _DataDeskHashMix(hash, DataDeskGetNodeHash(graph, root->type_usage.union_declaration));
+                    
+                    // Only the identity of the resolved type is hashed,
+                    // not its contents, so that self-referential types terminate.
+                    DataDeskNode *definition = DataDeskGetTypeDefinition(graph, root);
+                    if(definition)
+                    {
+                        hash = _DataDeskHashMix(hash, (unsigned long long)definition->type);
+                        hash = _DataDeskHashBytes(hash, definition->string, definition->string_length);
+                    }
+                    break;
+                }
+                case DATA_DESK_NODE_TYPE_constant_definition:
+                {
+                    hash = _DataDeskHashMix(hash, DataDeskGetNodeHash(graph, root->constant_definition.expression));
+                    break;
+                }
+                case DATA_DESK_NODE_TYPE_procedure_header:
+                {
+                    hash = _DataDeskHashNodeList(graph, hash, root->procedure_header.first_parameter);
+                    hash = _DataDeskHashMix(hash, DataDeskGetNodeHash(graph, root->procedure_header.return_type));
+                    break;
+                }
+                case DATA_DESK_NODE_TYPE_namespace_declaration:
+                {
+                    hash = _DataDeskHashNodeList(graph, hash, root->namespace_declaration.first_member);
+                    break;
+                }
+                default: break;
+            }
+            
+            root->hash = hash;
+            root->flags |= DATA_DESK_NODE_FLAG_hash_computed;
+        }
+    }
+    return hash;
+}
+
+DATA_DESK_HEADER_PROC DataDeskSourceLocation
+DataDeskGetNodeLocation(DataDeskGraph *graph, DataDeskNode *root)
+{
+    DataDeskSourceLocation location = {0};
+    if(graph && root && root->id > 0 && root->id <= graph->node_count)
+    {
+        DataDeskNodeLocation *entry = graph->node_locations + root->id;
+        if(entry->file > 0 && entry->file <= graph->file_count)
+        {
+            DataDeskSourceFile *file = graph->files + entry->file;
+            location.filename = file->filename;
+            location.file = entry->file;
+            location.start_offset = entry->start_offset;
+            location.end_offset = entry->end_offset;
+            
+            // Find the last line that starts at or before the node.
+            int low = 0;
+            int high = file->line_count - 1;
+            while(low < high)
+            {
+                int middle = (low + high + 1) / 2;
+                if(file->line_offsets[middle] <= entry->start_offset)
+                {
+                    low = middle;
+                }
+                else
+                {
+                    high = middle - 1;
+                }
+            }
+            location.line = low + 1;
+            location.column = entry->start_offset - (file->line_count ? file->line_offsets[low] : 0) + 1;
+        }
+    }
+    return location;
+}
+
+DATA_DESK_HEADER_PROC DataDeskNode *
+DataDeskGetNodeParent(DataDeskGraph *graph, DataDeskNode *root)
+{
+    DataDeskNode *parent = 0;
+    if(graph && root && root->id > 0 && root->id <= graph->node_count)
+    {
+        parent = graph->node_locations[root->id].parent;
+    }
+    return parent;
+}
+
+// Makes sure that the body of a node skimmed with --skim has been
+// parsed, parsing it if it hasn't (which writes to the graph, so it can only
+// happen while the graph isn't frozen, from one thread at a time). Returns 0
+// if the body still isn't available.
+DATA_DESK_HEADER_PROC int
+DataDeskExpandNode(DataDeskGraph *graph, DataDeskNode *root)
+{
+    int expanded = 1;
+    if(root && (root->flags & DATA_DESK_NODE_FLAG_skimmed))
+    {
+        expanded = 0;
+        if(graph && graph->ExpandNode && !graph->frozen)
+        {
+            expanded = graph->ExpandNode(graph, root);
+        }
+    }
+    return expanded;
+}
+
+DATA_DESK_HEADER_PROC DataDeskNode *
+DataDeskGetChild(DataDeskNode *root, int index)
+{
+    DataDeskNode *child = 0;
+    if(root && index >= 0 && index < root->child_count)
+    {
+        child = root->children[index];
+    }
+    return child;
+}
+
+DATA_DESK_HEADER_PROC DataDeskNode *
+DataDeskGetChildByAtom(DataDeskNode *root, int atom)
+{
+    DataDeskNode *child = 0;
+    if(root && atom)
+    {
+        if(root->child_table_max)
+        {
+            // Child tables are never more than half full, so this
+            // always terminates on an empty slot.
+            unsigned int slot = ((unsigned int)atom * 2654435761u) & (root->child_table_max - 1);
+            for(;;)
+            {
+                DataDeskNode *candidate = root->child_table[slot];
+                if(!candidate || candidate->atom == atom)
+                {
+                    child = candidate;
+                    break;
+                }
+                slot = (slot + 1) & (root->child_table_max - 1);
+            }
+        }
+        else
+        {
+            for(int i = 0; i < root->child_count; ++i)
+            {
+                if(root->children[i]->atom == atom)
+                {
+                    child = root->children[i];
+                    break;
+                }
+            }
+        }
+    }
+    return child;
+}
+
+DATA_DESK_HEADER_PROC DataDeskNode *
+DataDeskGetChildByName(DataDeskGraph *graph, DataDeskNode *root, char *name)
+{
+    return DataDeskGetChildByAtom(root, DataDeskGetAtom(graph, name));
+}
+
+DATA_DESK_HEADER_PROC unsigned int
+_DataDeskTypeMatcherSlot(int atom, int pointer_count, int array)
+{
+    unsigned int hash = (unsigned int)atom * 2654435761u;
+    hash ^= (unsigned int)pointer_count * 40503u;
+    hash ^= (unsigned int)array * 97u;
+    return hash & (DATA_DESK_TYPE_MATCHER_SLOT_MAX - 1);
+}
+
+DATA_DESK_HEADER_PROC void
+_DataDeskTypeMatcherInsert(DataDeskTypeMatcher *matcher, int atom, int pointer_count, int array, int pattern_index)
+{
+    unsigned int slot = _DataDeskTypeMatcherSlot(atom, pointer_count, array);
+    for(;;)
+    {
+        DataDeskTypeMatcherSlot *s = matcher->slots + slot;
+        if(s->atom == 0)
+        {
+            s->atom = atom;
+            s->pointer_count = pointer_count;
+            s->array = array;
+            s->pattern_index = pattern_index;
+            break;
+        }
+        
+        // Earlier patterns take precedence.
+        if(s->atom == atom && s->pointer_count == pointer_count && s->array == array)
+        {
+            break;
+        }
+        
+        slot = (slot + 1) & (DATA_DESK_TYPE_MATCHER_SLOT_MAX - 1);
+    }
+}
+
+DATA_DESK_HEADER_PROC int
+DataDeskCompileTypeMatcher(DataDeskGraph *graph, DataDeskTypeMatcher *matcher, char **patterns, int pattern_count)
+{
+    int success = 0;
+    
+    for(int i = 0; i < DATA_DESK_TYPE_MATCHER_SLOT_MAX; ++i)
+    {
+        matcher->slots[i].atom = 0;
+    }
+    
+    // Every pattern can take up two slots, and the table should be
+    // kept at most half full.
+    if(pattern_count * 4 <= DATA_DESK_TYPE_MATCHER_SLOT_MAX)
+    {
+        success = 1;
+        
+        for(int i = 0; i < pattern_count; ++i)
+        {
+            char *pattern = patterns[i];
+            
+            int pointer_count = 0;
+            for(; pattern[pointer_count] == '*'; ++pointer_count);
+            
+            char *name = pattern + pointer_count;
+            int name_length = 0;
+            for(; name[name_length] && name[name_length] != '['; ++name_length);
+            int array_only = name[name_length] == '[';
+            
+            // If the base type name doesn't appear anywhere in the
+            // graph, it has no atom, and the pattern can never match.
+            int atom = DataDeskGetAtomN(graph, name, name_length);
+            if(atom)
+            {
+                _DataDeskTypeMatcherInsert(matcher, atom, pointer_count, 1, i);
+                if(!array_only)
+                {
+                    _DataDeskTypeMatcherInsert(matcher, atom, pointer_count, 0, i);
+                }
+            }
+        }
+    }
+    
+    return success;
+}
+
+DATA_DESK_HEADER_PROC int
+DataDeskMatchType(DataDeskTypeMatcher *matcher, DataDeskNode *root)
+{
+    int pattern_index = -1;
+    
+    DataDeskNode *type = root;
+    if(type && type->type == DATA_DESK_NODE_TYPE_declaration)
+    {
+        type = type->declaration.type;
+    }
+    
+    if(type && type->type == DATA_DESK_NODE_TYPE_type_usage && type->atom)
+    {
+        int pointer_count = type->type_usage.pointer_count;
+        int array = type->type_usage.first_array_size_expression != 0;
+        unsigned int slot = _DataDeskTypeMatcherSlot(type->atom, pointer_count, array);
+        for(;;)
+        {
+            DataDeskTypeMatcherSlot *s = matcher->slots + slot;
+            if(s->atom == 0)
+            {
+                break;
+            }
+            if(s->atom == type->atom && s->pointer_count == pointer_count && s->array == array)
+            {
+                pattern_index = s->pattern_index;
+                break;
+            }
+            slot = (slot + 1) & (DATA_DESK_TYPE_MATCHER_SLOT_MAX - 1);
+        }
+    }
+    
+    return pattern_index;
+}
+
+DATA_DESK_HEADER_PROC int
+_DataDeskQueryCharIsName(int c)
+{
+    return DataDeskCharIsAlpha(c) || DataDeskCharIsDigit(c) || c == '_';
+}
+
+DATA_DESK_HEADER_PROC char *
+_DataDeskQuerySkipSpaces(char *at)
+{
+    while(*at == ' ' || *at == '\t' || *at == '\n' || *at == '\r')
+    {
+        ++at;
+    }
+    return at;
+}
+
+DATA_DESK_HEADER_PROC int
+_DataDeskQueryNameMatch(char *name, int name_length, char *string)
+{
+    int i = 0;
+    for(; i < name_length && string[i] == name[i]; ++i);
+    return i == name_length && string[i] == 0;
+}
+
+DATA_DESK_HEADER_PROC int
+DataDeskCompileQuery(DataDeskGraph *graph, DataDeskQuery *query, char *query_string)
+{
+    int success = 1;
+    query->step_count = 0;
+    query->empty = 0;
+    
+    char *at = query_string;
+    for(;;)
+    {
+        at = _DataDeskQuerySkipSpaces(at);
+        if(query->step_count >= DATA_DESK_QUERY_STEP_MAX)
+        {
+            success = 0;
+            break;
+        }
+        
+        DataDeskQueryStep *step = query->steps + query->step_count++;
+        step->node_type = DATA_DESK_NODE_TYPE_invalid;
+        step->predicate_count = 0;
+        
+        // Node kind.
+        {
+            char *kind = at;
+            int kind_length = 0;
+            if(*at == '*')
+            {
+                ++at;
+            }
+            else
+            {
+                for(; _DataDeskQueryCharIsName(kind[kind_length]); ++kind_length);
+                at += kind_length;
+                
+                static struct
+                {
+                    char *name;
+                    DataDeskNodeType type;
+                }
+                kinds[] =
+                {
+                    { "struct", DATA_DESK_NODE_TYPE_struct_declaration },
+                    { "union",  DATA_DESK_NODE_TYPE_union_declaration },
+                    { "enum",   DATA_DESK_NODE_TYPE_enum_declaration },
+                    { "flags",  DATA_DESK_NODE_TYPE_flags_declaration },
+                    { "proc",   DATA_DESK_NODE_TYPE_procedure_header },
+                    { "namespace", DATA_DESK_NODE_TYPE_namespace_declaration },
+                    { "const",  DATA_DESK_NODE_TYPE_constant_definition },
+                    { "decl",   DATA_DESK_NODE_TYPE_declaration },
+                    { "member", DATA_DESK_NODE_TYPE_declaration },
+                    { "ident",  DATA_DESK_NODE_TYPE_identifier },
+                };
+                
+                for(int i = 0; i < (int)(sizeof(kinds) / sizeof(kinds[0])); ++i)
+                {
+                    if(kind_length && _DataDeskQueryNameMatch(kind, kind_length, kinds[i].name))
+                    {
+                        step->node_type = kinds[i].type;
+                        break;
+                    }
+                }
+                
+                if(step->node_type == DATA_DESK_NODE_TYPE_invalid)
+                {
+                    success = 0;
+                    break;
+                }
+            }
+        }
+        
+        // Predicates.
+        at = _DataDeskQuerySkipSpaces(at);
+        if(*at == '[')
+        {
+            ++at;
+            for(;;)
+            {
+                at = _DataDeskQuerySkipSpaces(at);
+                if(step->predicate_count >= DATA_DESK_QUERY_PREDICATE_MAX)
+                {
+                    success = 0;
+                    break;
+                }
+                
+                DataDeskQueryPredicate *predicate = step->predicates + step->predicate_count++;
+                predicate->type = DATA_DESK_QUERY_PREDICATE_TYPE_invalid;
+                predicate->negate = 0;
+                predicate->id = 0;
+                predicate->pointer_count = 0;
+                predicate->array_only = 0;
+                
+                if(*at == '!')
+                {
+                    predicate->negate = 1;
+                    at = _DataDeskQuerySkipSpaces(at + 1);
+                }
+                
+                if(*at == '@')
+                {
+                    char *name = ++at;
+                    int name_length = 0;
+                    for(; _DataDeskQueryCharIsName(name[name_length]); ++name_length);
+                    at += name_length;
+                    predicate->type = DATA_DESK_QUERY_PREDICATE_TYPE_tag;
+                    predicate->id = DataDeskGetTagIDN(graph, name, name_length);
+                    success = name_length > 0;
+                }
+                else
+                {
+                    char *key = at;
+                    int key_length = 0;
+                    for(; _DataDeskQueryCharIsName(key[key_length]); ++key_length);
+                    at = _DataDeskQuerySkipSpaces(at + key_length);
+                    
+                    if(*at == '=')
+                    {
+                        at = _DataDeskQuerySkipSpaces(at + 1);
+                        if(_DataDeskQueryNameMatch(key, key_length, "type"))
+                        {
+                            predicate->type = DATA_DESK_QUERY_PREDICATE_TYPE_type;
+                            for(; *at == '*'; ++at)
+                            {
+                                ++predicate->pointer_count;
+                            }
+                        }
+                        else if(_DataDeskQueryNameMatch(key, key_length, "name"))
+                        {
+                            predicate->type = DATA_DESK_QUERY_PREDICATE_TYPE_name;
+                        }
+                        
+                        char *name = at;
+                        int name_length = 0;
+                        for(; _DataDeskQueryCharIsName(name[name_length]); ++name_length);
+                        at += name_length;
+                        predicate->id = DataDeskGetAtomN(graph, name, name_length);
+                        
+                        if(predicate->type == DATA_DESK_QUERY_PREDICATE_TYPE_type &&
+                           at[0] == '[' && at[1] == ']')
+                        {
+                            predicate->array_only = 1;
+                            at += 2;
+                        }
+                        
+                        success = name_length > 0 && predicate->type != DATA_DESK_QUERY_PREDICATE_TYPE_invalid;
+                    }
+                    else
+                    {
+                        success = 0;
+                    }
+                }
+                
+                // A positive predicate on a tag or name that appears
+                // nowhere in the graph can never hold.
+                if(!predicate->negate && predicate->id == 0)
+                {
+                    query->empty = 1;
+                }
+                
+                at = _DataDeskQuerySkipSpaces(at);
+                if(!success)
+                {
+                    break;
+                }
+                else if(*at == ',')
+                {
+                    ++at;
+                }
+                else if(*at == ']')
+                {
+                    ++at;
+                    break;
+                }
+                else
+                {
+                    success = 0;
+                    break;
+                }
+            }
+        }
+        
+        if(!success)
+        {
+            break;
+        }
+        
+        at = _DataDeskQuerySkipSpaces(at);
+        if(*at == '>')
+        {
+            ++at;
+        }
+        else if(*at == 0)
+        {
+            break;
+        }
+        else
+        {
+            success = 0;
+            break;
+        }
+    }
+    
+    if(!success)
+    {
+        query->step_count = 0;
+        query->empty = 1;
+    }
+    
+    return success;
+}
+
+DATA_DESK_HEADER_PROC int
+_DataDeskQueryStepMatches(DataDeskQueryStep *step, DataDeskNode *node)
+{
+    int matches = (step->node_type == DATA_DESK_NODE_TYPE_invalid ||
+                   step->node_type == node->type);
+    
+    for(int i = 0; matches && i < step->predicate_count; ++i)
+    {
+        DataDeskQueryPredicate *predicate = step->predicates + i;
+        int holds = 0;
+        switch(predicate->type)
+        {
+            case DATA_DESK_QUERY_PREDICATE_TYPE_tag:
+            {
+                holds = DataDeskNodeHasTagID(node, predicate->id);
+                break;
+            }
+            case DATA_DESK_QUERY_PREDICATE_TYPE_type:
+            {
+                DataDeskNode *type = node->type == DATA_DESK_NODE_TYPE_declaration ? node->declaration.type : 0;
+                holds = (type && predicate->id && type->atom == predicate->id &&
+                         type->type_usage.pointer_count == predicate->pointer_count &&
+                         (!predicate->array_only || type->type_usage.first_array_size_expression));
+                break;
+            }
+            case DATA_DESK_QUERY_PREDICATE_TYPE_name:
+            {
+                holds = predicate->id && node->atom == predicate->id;
+                break;
+            }
+            default: break;
+        }
+        matches = predicate->negate ? !holds : holds;
+    }
+    
+    return matches;
+}
+
+DATA_DESK_HEADER_PROC DataDeskQueryIterator
+DataDeskQueryIterate(DataDeskGraph *graph, DataDeskQuery *query)
+{
+    DataDeskQueryIterator iterator;
+    iterator.graph = graph;
+    iterator.query = query;
+    iterator.step = 0;
+    iterator.source_type = DATA_DESK_NODE_TYPE_invalid + 1;
+    iterator.source_node_count = -1;
+    iterator.source_nodes = 0;
+    for(int i = 0; i < DATA_DESK_QUERY_STEP_MAX; ++i)
+    {
+        iterator.indices[i] = 0;
+        iterator.matches[i] = 0;
+    }
+    
+    // Pick the smallest index that the first step can be run over.
+    if(!query->empty && query->step_count > 0)
+    {
+        DataDeskQueryStep *step = query->steps;
+        for(int i = 0; i < step->predicate_count; ++i)
+        {
+            DataDeskQueryPredicate *predicate = step->predicates + i;
+            if(predicate->type == DATA_DESK_QUERY_PREDICATE_TYPE_tag && !predicate->negate)
+            {
+                DataDeskTagInfo *info = graph->tag_infos + predicate->id;
+                if(iterator.source_node_count < 0 || info->node_count < iterator.source_node_count)
+                {
+                    iterator.source_nodes = info->nodes;
+                    iterator.source_node_count = info->node_count;
+                }
+            }
+        }
+        
+        if(iterator.source_node_count < 0 && step->node_type != DATA_DESK_NODE_TYPE_invalid)
+        {
+            iterator.source_nodes = graph->type_nodes[step->node_type];
+            iterator.source_node_count = graph->type_node_counts[step->node_type];
+        }
+    }
+    
+    return iterator;
+}
+
+DATA_DESK_HEADER_PROC DataDeskNode *
+DataDeskQueryNext(DataDeskQueryIterator *iterator)
+{
+    DataDeskNode *result = 0;
+    DataDeskQuery *query = iterator->query;
+    
+    if(query->empty || query->step_count == 0)
+    {
+        return result;
+    }
+    
+    while(iterator->step >= 0)
+    {
+        int step_index = iterator->step;
+        DataDeskNode *candidate = 0;
+        
+        if(step_index == 0)
+        {
+            if(iterator->source_node_count >= 0)
+            {
+                if(iterator->indices[0] < iterator->source_node_count)
+                {
+                    candidate = iterator->source_nodes[iterator->indices[0]++];
+                }
+            }
+            else
+            {
+                // Full scan, one per-type index at a time.
+                while(iterator->source_type < DATA_DESK_NODE_TYPE_MAX &&
+                      iterator->indices[0] >= iterator->graph->type_node_counts[iterator->source_type])
+                {
+                    ++iterator->source_type;
+                    iterator->indices[0] = 0;
+                }
+                if(iterator->source_type < DATA_DESK_NODE_TYPE_MAX)
+                {
+                    candidate = iterator->graph->type_nodes[iterator->source_type][iterator->indices[0]++];
+                }
+            }
+        }
+        else
+        {
+            DataDeskNode *parent = iterator->matches[step_index - 1];
+            if(iterator->indices[step_index] < parent->child_count)
+            {
+                candidate = parent->children[iterator->indices[step_index]++];
+            }
+        }
+        
+        if(!candidate)
+        {
+            // This step is exhausted; go back to the previous one.
+            --iterator->step;
+        }
+        else if(_DataDeskQueryStepMatches(query->steps + step_index, candidate))
+        {
+            iterator->matches[step_index] = candidate;
+            if(step_index == query->step_count - 1)
+            {
+                result = candidate;
+                break;
+            }
+            else
+            {
+                ++iterator->step;
+                iterator->indices[iterator->step] = 0;
+            }
+        }
+    }
+    
+    return result;
+}
+
+DATA_DESK_HEADER_PROC char *
+DataDeskGetUnaryOperatorString(int type)
+{
+    char *strings[] =
+    {
+        "(invalid)",
+        "-",
+        "!",
+        "~",
+    };
+    return strings[type];
+}
+
+DATA_DESK_HEADER_PROC DataDeskAST
+DataDeskASTFromMemory(void *memory, unsigned int size)
+{
+    DataDeskAST ast = {0};
+    DataDeskASTHeader *header = (DataDeskASTHeader *)memory;
+    
+    int valid = (memory && size >= sizeof(DataDeskASTHeader) &&
+                 header->magic == DATA_DESK_AST_MAGIC &&
+                 header->version == DATA_DESK_AST_VERSION &&
+                 header->size <= size);
+    
+    // Make sure that every section is 8-byte aligned and fits in
+    // the file (counts are divided rather than multiplied, so that nothing
+    // can overflow), and that the string pool ends with a null terminator.
+    if(valid)
+    {
+        unsigned int sections[][3] =
+        {
+            { header->nodes,   header->node_count + 1, sizeof(DataDeskASTNode) },
+            { header->strings, header->string_pool_size, 1 },
+            { header->indices, header->index_count, sizeof(unsigned int) },
+            { header->files,   header->file_count + 1, sizeof(DataDeskASTFile) },
+            { header->atoms,   header->atom_count + 1, sizeof(unsigned int) },
+            { header->tags,    header->tag_count + 1, sizeof(DataDeskASTTag) },
+        };
+        for(unsigned int i = 0; valid && i < sizeof(sections) / sizeof(sections[0]); ++i)
+        {
+            valid = (sections[i][0] <= header->size &&
+                     sections[i][1] <= (header->size - sections[i][0]) / sections[i][2] &&
+                     sections[i][0] % 8 == 0);
+        }
+        valid = valid && header->node_count + 1 != 0 && header->string_pool_size > 0 &&
+            ((char *)memory)[header->strings + header->string_pool_size - 1] == 0;
+        for(int i = 0; valid && i < DATA_DESK_NODE_TYPE_MAX; ++i)
+        {
+            valid = (header->type_nodes[i] <= header->index_count &&
+                     header->type_node_counts[i] <= header->index_count - header->type_nodes[i]);
+        }
+    }
+    
+    if(valid)
+    {
+        char *base = (char *)memory;
+        ast.header = header;
+        ast.nodes = (DataDeskASTNode *)(base + header->nodes);
+        ast.strings = base + header->strings;
+        ast.indices = (unsigned int *)(base + header->indices);
+        ast.files = (DataDeskASTFile *)(base + header->files);
+        ast.atoms = (unsigned int *)(base + header->atoms);
+        ast.tags = (DataDeskASTTag *)(base + header->tags);
+    }
+    
+    return ast;
+}
+
+DATA_DESK_HEADER_PROC DataDeskASTNode *
+DataDeskASTGetNode(DataDeskAST *ast, unsigned int index)
+{
+    DataDeskASTNode *node = 0;
+    if(ast->header && index > 0 && index <= ast->header->node_count)
+    {
+        node = ast->nodes + index;
+    }
+    return node;
+}
+
+DATA_DESK_HEADER_PROC char *
+DataDeskASTGetString(DataDeskAST *ast, unsigned int offset)
+{
+    char *string = 0;
+    if(ast->header && offset < ast->header->string_pool_size)
+    {
+        string = ast->strings + offset;
+    }
+    return string;
+}
+
+DATA_DESK_HEADER_PROC DataDeskASTNode *
+DataDeskASTGetChild(DataDeskAST *ast, DataDeskASTNode *root, unsigned int index)
+{
+    DataDeskASTNode *child = 0;
+    if(root && index < root->child_count && root->children + index < ast->header->index_count)
+    {
+        child = DataDeskASTGetNode(ast, ast->indices[root->children + index]);
+    }
+    return child;
+}
+
+DATA_DESK_HEADER_PROC DataDeskASTNode *
+DataDeskASTGetFileRoot(DataDeskAST *ast, unsigned int file)
+{
+    DataDeskASTNode *root = 0;
+    if(ast->header && file > 0 && file <= ast->header->file_count)
+    {
+        root = DataDeskASTGetNode(ast, ast->files[file].first_root);
+    }
+    return root;
+}
+
+DATA_DESK_HEADER_PROC unsigned int *
+DataDeskASTGetAllNodesOfType(DataDeskAST *ast, DataDeskNodeType type, unsigned int *count)
+{
+    unsigned int *nodes = 0;
+    *count = 0;
+    if(ast->header && type >= 0 && type < DATA_DESK_NODE_TYPE_MAX)
+    {
+        *count = ast->header->type_node_counts[type];
+        nodes = ast->indices + ast->header->type_nodes[type];
+    }
+    return nodes;
+}
+
+DATA_DESK_HEADER_PROC unsigned int *
+DataDeskASTGetNodesWithTag(DataDeskAST *ast, char *tag, unsigned int *count)
+{
+    unsigned int *nodes = 0;
+    *count = 0;
+    if(ast->header && tag)
+    {
+        if(tag[0] == '@')
+        {
+            ++tag;
+        }
+        for(unsigned int i = 1; i <= ast->header->tag_count; ++i)
+        {
+            char *name = DataDeskASTGetString(ast, ast->tags[i].name);
+            int j = 0;
+            while(name && name[j] && name[j] == tag[j])
+            {
+                ++j;
+            }
+            if(name && name[j] == 0 && tag[j] == 0)
+            {
+                if(ast->tags[i].nodes <= ast->header->index_count &&
+                   ast->tags[i].node_count <= ast->header->index_count - ast->tags[i].nodes)
+                {
+                    *count = ast->tags[i].node_count;
+                    nodes = ast->indices + ast->tags[i].nodes;
+                }
+                break;
+            }
+        }
+    }
+    return nodes;
+}
+
+#ifndef DATA_DESK_NO_CRT
+// Declarations in namespaces are written with the names of the namespaces
+// around them as a prefix (Render.Vertex is written as Render_Vertex), since
+// C only has one scope for them. Finding the namespaces needs the graph.
+DATA_DESK_HEADER_PROC void
+_DataDeskFWriteCName(FILE *file, DataDeskGraph *graph, DataDeskNode *root)
+{
+    DataDeskNode *parent = DataDeskGetNodeParent(graph, root);
+    if(parent && parent->type == DATA_DESK_NODE_TYPE_namespace_declaration)
+    {
+        _DataDeskFWriteCName(file, graph, parent);
+        fprintf(file, "_");
+    }
+    fprintf(file, "%s", root->string);
+}
+
+// Names that couldn't be resolved are written as they were, other than
+// qualified ones, which are written the way they would be if they had been.
+DATA_DESK_HEADER_PROC void
+_DataDeskFWriteQualifiedNameAsC(FILE *file, char *string, int string_length)
+{
+    for(int i = 0; i < string_length; ++i)
+    {
+        fputc(string[i] == '.' ? '_' : string[i], file);
+    }
+}
+
+DATA_DESK_HEADER_PROC void
+_DataDeskFWriteGraphAsC(FILE *file, DataDeskGraph *graph, DataDeskNode *root, int follow_next, int nest)
+{
+    if(root)
+    {
+        if(root->first_tag)
+        {
+            fprintf(file, "// ");
+            for(DataDeskNode *tag = root->first_tag; tag; tag = tag->next)
+            {
+                fprintf(file, "%s", tag->string);
+                
+                if(tag->tag.first_tag_parameter)
+                {
+                    fprintf(file, "(");
+                    for(DataDeskNode *tag_arg = tag->tag.first_tag_parameter; tag_arg; tag_arg = tag_arg->next)
+                    {
+                        _DataDeskFWriteGraphAsC(file, graph, tag_arg, 0, nest+1);
+                        if(tag_arg->next)
+                        {
+                            fprintf(file, ", ");
+                        }
+                    }
+                    fprintf(file, ")");
+                }
+                fprintf(file, " ");
+            }
+            fprintf(file, "\n");
+        }
+        
+        switch(root->type)
+        {
+            case DATA_DESK_NODE_TYPE_identifier:
+            {
+                DataDeskNode *declaration = graph ? DataDeskGetIdentifierDeclaration(graph, root) : root->identifier.declaration;
+                if(declaration && declaration->string)
+                {
+                    _DataDeskFWriteCName(file, graph, declaration);
+                }
+                else
+                {
+                    _DataDeskFWriteQualifiedNameAsC(file, root->string, root->string_length);
+                }
+                break;
+            }
+            
+            case DATA_DESK_NODE_TYPE_numeric_constant:
+            case DATA_DESK_NODE_TYPE_string_constant:
+            case DATA_DESK_NODE_TYPE_char_constant:
+            {
+                fprintf(file, "%s", root->string);
+                break;
+            }
+            
+            case DATA_DESK_NODE_TYPE_unary_operator:
+            {
+                fprintf(file, "(");
+                char *unary_operator_string = DataDeskGetUnaryOperatorString(root->unary_operator.type);
+                fprintf(file, "%s", unary_operator_string);
+                fprintf(file, "(");
+                _DataDeskFWriteGraphAsC(file, graph, root->unary_operator.operand, 0, nest+1);
+                fprintf(file, ")");
+                fprintf(file, ")");
+                break;
+            }
+            
+            case DATA_DESK_NODE_TYPE_binary_operator:
+            {
+                fprintf(file, "(");
+                _DataDeskFWriteGraphAsC(file, graph, root->binary_operator.left, 0, nest);
+                char *binary_operator_string = DataDeskGetBinaryOperatorString(root->binary_operator.type);
+                fprintf(file, "%s", binary_operator_string);
+                _DataDeskFWriteGraphAsC(file, graph, root->binary_operator.right, 0, nest+1);
+                fprintf(file, ")");
+                
+                break;
+            }
+            
+            case DATA_DESK_NODE_TYPE_struct_declaration:
+            {
+                if(nest == 0)
+                {
+                    fprintf(file, "typedef struct ");
+                    _DataDeskFWriteCName(file, graph, root);
+                    fprintf(file, " ");
+                    _DataDeskFWriteCName(file, graph, root);
+                    fprintf(file, ";\n");
+                }
+                
+                if(root->string)
+                {
+                    fprintf(file, "struct ");
+                    _DataDeskFWriteCName(file, graph, root);
+                    fprintf(file, "\n{\n");
+                }
+                else
+                {
                     fprintf(file, "struct\n{\n");
                 }
                 
                 for(DataDeskNode *member = root->struct_declaration.first_member;
                     member; member = member->next)
                 {
-                    _DataDeskFWriteGraphAsC(file, member, 0, nest+1);
+                    _DataDeskFWriteGraphAsC(file, graph, member, 0, nest+1);
                     fprintf(file, ";\n");
                 }
                 fprintf(file, "}");
@@ -729,12 +2439,18 @@ _DataDeskFWriteGraphAsC(FILE *file, DataDeskNode *root, int follow_next, int nes
             {
                 if(nest == 0)
                 {
-                    fprintf(file, "typedef union %s %s;\n", root->string, root->string);
+                    fprintf(file, "typedef union ");
+                    _DataDeskFWriteCName(file, graph, root);
+                    fprintf(file, " ");
+                    _DataDeskFWriteCName(file, graph, root);
+                    fprintf(file, ";\n");
                 }
                 
                 if(root->string)
                 {
-                    fprintf(file, "union %s\n{\n", root->string);
+                    fprintf(file, "union ");
+                    _DataDeskFWriteCName(file, graph, root);
+                    fprintf(file, "\n{\n");
                 }
                 else
                 {
@@ -744,7 +2460,7 @@ _DataDeskFWriteGraphAsC(FILE *file, DataDeskNode *root, int follow_next, int nes
                 for(DataDeskNode *member = root->union_declaration.first_member;
                     member; member = member->next)
                 {
-                    _DataDeskFWriteGraphAsC(file, member, 0, nest+1);
+                    _DataDeskFWriteGraphAsC(file, graph, member, 0, nest+1);
                     fprintf(file, ";\n");
                 }
                 fprintf(file, "}");
@@ -761,12 +2477,18 @@ _DataDeskFWriteGraphAsC(FILE *file, DataDeskNode *root, int follow_next, int nes
             {
                 if(nest == 0)
                 {
-                    fprintf(file, "typedef %s %s %s;\n", "enum", root->string, root->string);
+                    fprintf(file, "typedef enum ");
+                    _DataDeskFWriteCName(file, graph, root);
+                    fprintf(file, " ");
+                    _DataDeskFWriteCName(file, graph, root);
+                    fprintf(file, ";\n");
                 }
                 
                 if(root->string)
                 {
-                    fprintf(file, "enum %s\n{\n", root->string);
+                    fprintf(file, "enum ");
+                    _DataDeskFWriteCName(file, graph, root);
+                    fprintf(file, "\n{\n");
                 }
                 else
                 {
@@ -808,11 +2530,15 @@ _DataDeskFWriteGraphAsC(FILE *file, DataDeskNode *root, int follow_next, int nes
                 {
                     if(needed_bits_for_flag_type == 32)
                     {
-                        fprintf(file, "typedef unsigned int %s;\n\n", root->string);
+                        fprintf(file, "typedef unsigned int ");
+                        _DataDeskFWriteCName(file, graph, root);
+                        fprintf(file, ";\n\n");
                     }
                     else if(needed_bits_for_flag_type > 32)
                     {
-                        fprintf(file, "typedef unsigned long int %s;\n\n", root->string);
+                        fprintf(file, "typedef unsigned long int ");
+                        _DataDeskFWriteCName(file, graph, root);
+                        fprintf(file, ";\n\n");
                     }
                 }
                 
@@ -821,15 +2547,15 @@ _DataDeskFWriteGraphAsC(FILE *file, DataDeskNode *root, int follow_next, int nes
             
             case DATA_DESK_NODE_TYPE_declaration:
             {
-                _DataDeskFWriteGraphAsC(file, root->declaration.type, 0, nest+1);
-                fprintf(file, "%s", root->string);
+                _DataDeskFWriteGraphAsC(file, graph, root->declaration.type, 0, nest+1);
+                _DataDeskFWriteCName(file, graph, root);
                 
                 for(DataDeskNode *array = root->declaration.type->type_usage.first_array_size_expression;
                     array;
                     array = array->next)
                 {
                     fprintf(file, "[");
-                    _DataDeskFWriteGraphAsC(file, array, 0, nest);
+                    _DataDeskFWriteGraphAsC(file, graph, array, 0, nest);
                     fprintf(file, "]");
                 }
                 
@@ -840,12 +2566,21 @@ _DataDeskFWriteGraphAsC(FILE *file, DataDeskNode *root, int follow_next, int nes
             {
                 if(root->type_usage.struct_declaration)
                 {
-                    _DataDeskFWriteGraphAsC(file, root->type_usage.struct_declaration, 0, nest+1);
+                    _DataDeskFWriteGraphAsC(file, graph, root->type_usage.struct_declaration, 0, nest+1);
                     fprintf(file, "\n");
                 }
                 else
                 {
-                    fprintf(file, "%s ", root->string);
+                    DataDeskNode *definition = graph ? DataDeskGetTypeDefinition(graph, root) : root->type_usage.type_definition;
+                    if(definition && definition->string)
+                    {
+                        _DataDeskFWriteCName(file, graph, definition);
+                    }
+                    else
+                    {
+                        _DataDeskFWriteQualifiedNameAsC(file, root->string, root->string_length);
+                    }
+                    fprintf(file, " ");
                 }
                 
                 for(int i = 0; i < root->type_usage.pointer_count; ++i)
@@ -858,8 +2593,10 @@ _DataDeskFWriteGraphAsC(FILE *file, DataDeskNode *root, int follow_next, int nes
             
             case DATA_DESK_NODE_TYPE_constant_definition:
             {
-                fprintf(file, "#define %s (", root->string);
-                DataDeskFWriteGraphAsC(file, root->constant_definition.expression, 0);
+                fprintf(file, "#define ");
+                _DataDeskFWriteCName(file, graph, root);
+                fprintf(file, " (");
+                _DataDeskFWriteGraphAsC(file, graph, root->constant_definition.expression, 0, nest);
                 fprintf(file, ")\n");
                 break;
             }
@@ -868,19 +2605,21 @@ _DataDeskFWriteGraphAsC(FILE *file, DataDeskNode *root, int follow_next, int nes
             {
                 if(root->procedure_header.return_type)
                 {
-                    _DataDeskFWriteGraphAsC(file, root->procedure_header.return_type, 0, nest);
+                    _DataDeskFWriteGraphAsC(file, graph, root->procedure_header.return_type, 0, nest);
                 }
                 else
                 {
                     fprintf(file, "void");
                 }
-                fprintf(file, " %s(", root->string);
+                fprintf(file, " ");
+                _DataDeskFWriteCName(file, graph, root);
+                fprintf(file, "(");
                 if(root->procedure_header.first_parameter)
                 {
                     for(DataDeskNode *parameter = root->procedure_header.first_parameter;
                         parameter; parameter = parameter->next)
                     {
-                        _DataDeskFWriteGraphAsC(file, parameter, 0, nest);
+                        _DataDeskFWriteGraphAsC(file, graph, parameter, 0, nest);
                         if(parameter->next)
                         {
                             fprintf(file, ", ");
@@ -895,12 +2634,21 @@ _DataDeskFWriteGraphAsC(FILE *file, DataDeskNode *root, int follow_next, int nes
                 break;
             }
             
+            case DATA_DESK_NODE_TYPE_namespace_declaration:
+            {
+                // C has no namespaces, so members are written out at the top
+                // level (see _DataDeskFWriteCName).
+                fprintf(file, "// %s\n", root->string);
+                _DataDeskFWriteGraphAsC(file, graph, root->namespace_declaration.first_member, 1, nest);
+                break;
+            }
+            
             default: break;
         }
         
         if(root->next && follow_next)
         {
-            _DataDeskFWriteGraphAsC(file, root->next, follow_next, nest);
+            _DataDeskFWriteGraphAsC(file, graph, root->next, follow_next, nest);
         }
     }
 }
@@ -908,7 +2656,17 @@ _DataDeskFWriteGraphAsC(FILE *file, DataDeskNode *root, int follow_next, int nes
 DATA_DESK_HEADER_PROC void
 DataDeskFWriteGraphAsC(FILE *file, DataDeskNode *root, int follow_next)
 {
-    _DataDeskFWriteGraphAsC(file, root, follow_next, 0);
+    _DataDeskFWriteGraphAsC(file, 0, root, follow_next, 0);
+}
+
+// Like DataDeskFWriteGraphAsC, but symbols are looked up in the graph (so
+// that --lazy-symbols doesn't change anything), and declarations in
+// namespaces are prefixed with the names of the namespaces (see
+// _DataDeskFWriteCName).
+DATA_DESK_HEADER_PROC void
+DataDeskFWriteGraphAsCWithGraph(FILE *file, DataDeskGraph *graph, DataDeskNode *root, int follow_next)
+{
+    _DataDeskFWriteGraphAsC(file, graph, root, follow_next, 0);
 }
 
 DATA_DESK_HEADER_PROC void
@@ -1059,8 +2817,113 @@ DataDeskFWriteStringAsLowerCamelCaseN(FILE *file, char *string, int string_lengt
     }
 }
 
+// Opens a file that the custom layer generates, and tells Data
+// Desk about it (services may be 0, in which case this is just fopen).
+DATA_DESK_HEADER_PROC FILE *
+DataDeskFOpenOutputFile(DataDeskServices *services, char *path, char *mode)
+{
+    if(services && services->AddOutputFile)
+    {
+        services->AddOutputFile(services, path);
+    }
+    return fopen(path, mode);
+}
+
 #endif // DATA_DESK_NO_CRT
 
+#if defined(DATA_DESK_AST_LOADER)
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+DATA_DESK_HEADER_PROC DataDeskAST DataDeskLoadAST(char *path);
+DATA_DESK_HEADER_PROC void DataDeskUnloadAST(DataDeskAST *ast);
+
+// Maps a file written with --emit-ast read-only. Returns a
+// DataDeskAST with header set to 0 if the file can't be mapped or isn't a
+// binary AST file of this version.
+DATA_DESK_HEADER_PROC DataDeskAST
+DataDeskLoadAST(char *path)
+{
+    DataDeskAST ast = {0};
+    void *mapping = 0;
+    unsigned int mapping_size = 0;
+    
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if(file != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER file_size;
+        if(GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0 && file_size.QuadPart <= 0xffffffff)
+        {
+            HANDLE file_mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+            if(file_mapping)
+            {
+                mapping = MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+                mapping_size = (unsigned int)file_size.QuadPart;
+                CloseHandle(file_mapping);
+            }
+        }
+        CloseHandle(file);
+    }
+#else
+    int file = open(path, O_RDONLY);
+    if(file >= 0)
+    {
+        struct stat file_info;
+        if(fstat(file, &file_info) == 0 && file_info.st_size > 0 && file_info.st_size <= 0xffffffff)
+        {
+            mapping = mmap(0, file_info.st_size, PROT_READ, MAP_SHARED, file, 0);
+            if(mapping == MAP_FAILED)
+            {
+                mapping = 0;
+            }
+            mapping_size = (unsigned int)file_info.st_size;
+        }
+        close(file);
+    }
+#endif
+    
+    if(mapping)
+    {
+        ast = DataDeskASTFromMemory(mapping, mapping_size);
+        ast.mapping = mapping;
+        ast.mapping_size = mapping_size;
+        if(!ast.header)
+        {
+            DataDeskUnloadAST(&ast);
+        }
+    }
+    
+    return ast;
+}
+
+DATA_DESK_HEADER_PROC void
+DataDeskUnloadAST(DataDeskAST *ast)
+{
+    if(ast->mapping)
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(ast->mapping);
+#else
+        munmap(ast->mapping, ast->mapping_size);
+#endif
+    }
+    DataDeskAST empty = {0};
+    *ast = empty;
+}
+
+#endif // DATA_DESK_AST_LOADER
+
 #endif // DATA_DESK_H_INCLUDED_
 
 /*
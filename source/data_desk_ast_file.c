@@ -0,0 +1,426 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Data Desk
+
+Author  : Ryan Fleury
+Updated : 5 December 2019
+License : MIT, at end of file.
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// Writes binary AST files for --emit-ast. The format is described
+// in data_desk.h, under "Binary AST Files".
+
+// Offsets in the file are 32-bit, so files are kept under 2 GB (which also
+// keeps the doubling of the writer's buffers from overflowing).
+#define AST_FILE_SIZE_MAX 0x7fffffffu
+
+typedef struct ASTFileWriter ASTFileWriter;
+struct ASTFileWriter
+{
+    // Strings are deduplicated with an open-addressed table of
+    // string pool offsets plus one (so that 0 marks an empty slot).
+    unsigned int string_pool_size;
+    unsigned int string_pool_max;
+    char *string_pool;
+    unsigned int string_count;
+    unsigned int string_slot_max;
+    unsigned int *string_slots;
+
+    unsigned int index_count;
+    unsigned int index_max;
+    unsigned int *indices;
+
+    int too_large;
+};
+
+static unsigned int
+ASTFileWriterFindStringSlot(ASTFileWriter *writer, char *string, int string_length)
+{
+    unsigned int slot = DataDeskHashStringN(string, string_length) & (writer->string_slot_max - 1);
+    while(writer->string_slots[slot])
+    {
+        char *candidate = writer->string_pool + writer->string_slots[slot] - 1;
+        if(StringMatchCaseSensitiveN(candidate, string, string_length) && candidate[string_length] == 0)
+        {
+            break;
+        }
+        slot = (slot + 1) & (writer->string_slot_max - 1);
+    }
+    return slot;
+}
+
+static unsigned int
+ASTFileWriterPushString(ASTFileWriter *writer, char *string, int string_length)
+{
+    unsigned int offset = 0;
+    if(string && string_length > 0 &&
+       (unsigned long long)writer->string_pool_size + string_length + 1 > AST_FILE_SIZE_MAX)
+    {
+        writer->too_large = 1;
+    }
+    else if(string && string_length > 0)
+    {
+        if((writer->string_count + 1) * 2 > writer->string_slot_max)
+        {
+            unsigned int old_slot_max = writer->string_slot_max;
+            unsigned int *old_slots = writer->string_slots;
+            writer->string_slot_max = old_slot_max ? old_slot_max * 2 : 1024;
+            writer->string_slots = calloc(writer->string_slot_max, sizeof(unsigned int));
+            Assert(writer->string_slots != 0);
+            for(unsigned int i = 0; i < old_slot_max; ++i)
+            {
+                if(old_slots[i])
+                {
+                    char *old_string = writer->string_pool + old_slots[i] - 1;
+                    unsigned int slot = ASTFileWriterFindStringSlot(writer, old_string, CalculateCStringLength(old_string));
+                    writer->string_slots[slot] = old_slots[i];
+                }
+            }
+            free(old_slots);
+        }
+
+        unsigned int slot = ASTFileWriterFindStringSlot(writer, string, string_length);
+        if(writer->string_slots[slot])
+        {
+            offset = writer->string_slots[slot] - 1;
+        }
+        else
+        {
+            while(writer->string_pool_size + string_length + 1 > writer->string_pool_max)
+            {
+                writer->string_pool_max = writer->string_pool_max ? writer->string_pool_max * 2 : 4096;
+                writer->string_pool = realloc(writer->string_pool, writer->string_pool_max);
+                Assert(writer->string_pool != 0);
+            }
+            offset = writer->string_pool_size;
+            MemoryCopy(writer->string_pool + offset, string, string_length);
+            writer->string_pool[offset + string_length] = 0;
+            writer->string_pool_size += string_length + 1;
+            writer->string_slots[slot] = offset + 1;
+            ++writer->string_count;
+        }
+    }
+    return offset;
+}
+
+static unsigned int
+ASTFileWriterPushCString(ASTFileWriter *writer, char *string)
+{
+    return ASTFileWriterPushString(writer, string, string ? CalculateCStringLength(string) : 0);
+}
+
+// Appends a list of node indices to the index pool, and returns
+// its position there.
+static unsigned int
+ASTFileWriterPushNodes(ASTFileWriter *writer, DataDeskNode **nodes, int node_count)
+{
+    unsigned int position = writer->index_count;
+    if((unsigned long long)writer->index_count + node_count > AST_FILE_SIZE_MAX / sizeof(unsigned int))
+    {
+        writer->too_large = 1;
+        return 0;
+    }
+    if(writer->index_count + node_count > writer->index_max)
+    {
+        while(writer->index_count + node_count > writer->index_max)
+        {
+            writer->index_max = writer->index_max ? writer->index_max * 2 : 4096;
+        }
+        writer->indices = realloc(writer->indices, sizeof(unsigned int) * writer->index_max);
+        Assert(writer->indices != 0);
+    }
+    for(int i = 0; i < node_count; ++i)
+    {
+        writer->indices[writer->index_count++] = nodes[i] ? nodes[i]->id : 0;
+    }
+    return position;
+}
+
+static unsigned int
+ASTFileNodeIndex(DataDeskNode *node)
+{
+    return node ? node->id : 0;
+}
+
+static void
+ASTFileWriteNode(ParseContext *context, ASTFileWriter *writer, DataDeskNode *node, DataDeskASTNode *record)
+{
+    DataDeskGraph *graph = &context->graph;
+    DataDeskNodeLocation *location = graph->node_locations + node->id;
+
+    record->type = node->type;
+    record->flags = node->flags;
+    record->next = ASTFileNodeIndex(node->next);
+    record->parent = ASTFileNodeIndex(location->parent);
+
+    record->string_length = node->string_length;
+    record->string = ASTFileWriterPushString(writer, node->string, node->string_length);
+    record->name_lowercase_with_underscores = ASTFileWriterPushCString(writer, node->name_lowercase_with_underscores);
+    record->name_uppercase_with_underscores = ASTFileWriterPushCString(writer, node->name_uppercase_with_underscores);
+    record->name_upper_camel_case = ASTFileWriterPushCString(writer, node->name_upper_camel_case);
+    record->name_lower_camel_case = ASTFileWriterPushCString(writer, node->name_lower_camel_case);
+    record->atom = node->atom;
+
+    record->first_tag = ASTFileNodeIndex(node->first_tag);
+    record->child_count = node->child_count;
+    record->children = ASTFileWriterPushNodes(writer, node->children, node->child_count);
+
+    record->file = location->file;
+    record->start_offset = location->start_offset;
+    record->end_offset = location->end_offset;
+
+    record->hash = DataDeskGetNodeHash(graph, node);
+    record->tag_mask = node->tag_mask;
+
+    switch(node->type)
+    {
+        case DATA_DESK_NODE_TYPE_identifier:
+        {
+            record->identifier.declaration = ASTFileNodeIndex(DataDeskGetIdentifierDeclaration(graph, node));
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_unary_operator:
+        {
+            record->unary_operator.type = node->unary_operator.type;
+            record->unary_operator.operand = ASTFileNodeIndex(node->unary_operator.operand);
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_binary_operator:
+        {
+            record->binary_operator.type = node->binary_operator.type;
+            record->binary_operator.left = ASTFileNodeIndex(node->binary_operator.left);
+            record->binary_operator.right = ASTFileNodeIndex(node->binary_operator.right);
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_struct_declaration:
+        {
+            record->struct_declaration.first_member = ASTFileNodeIndex(node->struct_declaration.first_member);
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_union_declaration:
+        {
+            record->union_declaration.first_member = ASTFileNodeIndex(node->union_declaration.first_member);
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_enum_declaration:
+        {
+            record->enum_declaration.first_constant = ASTFileNodeIndex(node->enum_declaration.first_constant);
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_flags_declaration:
+        {
+            record->flags_declaration.first_flag = ASTFileNodeIndex(node->flags_declaration.first_flag);
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_declaration:
+        {
+            record->declaration.type = ASTFileNodeIndex(node->declaration.type);
+            record->declaration.initialization = ASTFileNodeIndex(node->declaration.initialization);
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_type_usage:
+        {
+            record->type_usage.pointer_count = node->type_usage.pointer_count;
+            record->type_usage.first_array_size_expression = ASTFileNodeIndex(node->type_usage.first_array_size_expression);
+            record->type_usage.struct_declaration = ASTFileNodeIndex(node->type_usage.struct_declaration);
+            record->type_usage.union_declaration = ASTFileNodeIndex(node->type_usage.union_declaration);
+            record->type_usage.type_definition = ASTFileNodeIndex(DataDeskGetTypeDefinition(graph, node));
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_tag:
+        {
+            record->tag.first_tag_parameter = ASTFileNodeIndex(node->tag.first_tag_parameter);
+            record->tag.id = node->tag.id;
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_constant_definition:
+        {
+            record->constant_definition.expression = ASTFileNodeIndex(node->constant_definition.expression);
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_procedure_header:
+        {
+            record->procedure_header.return_type = ASTFileNodeIndex(node->procedure_header.return_type);
+            record->procedure_header.first_parameter = ASTFileNodeIndex(node->procedure_header.first_parameter);
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_namespace_declaration:
+        {
+            record->namespace_declaration.first_member = ASTFileNodeIndex(node->namespace_declaration.first_member);
+            record->namespace_declaration.scope = node->namespace_declaration.scope;
+            break;
+        }
+        default: break;
+    }
+}
+
+static unsigned long long
+ASTFileAlign(unsigned long long offset)
+{
+    return (offset + 7) & ~7ull;
+}
+
+static void
+ASTFileWriteSection(FILE *file, unsigned int *written, unsigned int offset, void *data, unsigned int size)
+{
+    static char padding[8] = {0};
+    Assert(offset >= *written && offset - *written < sizeof(padding));
+    fwrite(padding, 1, offset - *written, file);
+    fwrite(data, 1, size, file);
+    *written = offset + size;
+}
+
+// Writes every node in the graph (which has to have been patched
+// already) to a binary AST file. Node indices in the file are node IDs.
+// Returns 0 if the file couldn't be written, or would be too large.
+static int
+WriteASTFile(ParseContext *context, char *path)
+{
+    DataDeskGraph *graph = &context->graph;
+    ASTFileWriter writer = {0};
+    DataDeskASTHeader header = {0};
+    int success = 0;
+
+    // Offset 0 in the string pool is the empty string.
+    writer.string_pool_max = 4096;
+    writer.string_pool = malloc(writer.string_pool_max);
+    Assert(writer.string_pool != 0);
+    writer.string_pool[0] = 0;
+    writer.string_pool_size = 1;
+
+    DataDeskASTNode *nodes = calloc(graph->node_count + 1, sizeof(DataDeskASTNode));
+    DataDeskASTFile *files = calloc(graph->file_count + 1, sizeof(DataDeskASTFile));
+    unsigned int *atoms = calloc(graph->atoms.count + 1, sizeof(unsigned int));
+    DataDeskASTTag *tags = calloc(graph->tags.count + 1, sizeof(DataDeskASTTag));
+    Assert(nodes != 0 && files != 0 && atoms != 0 && tags != 0);
+
+    // Every node is in exactly one of the per-type indices.
+    for(int type = 0; type < DATA_DESK_NODE_TYPE_MAX; ++type)
+    {
+        for(int i = 0; i < graph->type_node_counts[type]; ++i)
+        {
+            DataDeskNode *node = graph->type_nodes[type][i];
+            ASTFileWriteNode(context, &writer, node, nodes + node->id);
+        }
+        header.type_node_counts[type] = graph->type_node_counts[type];
+        header.type_nodes[type] = ASTFileWriterPushNodes(&writer, graph->type_nodes[type], graph->type_node_counts[type]);
+    }
+
+    for(int i = 1; i <= graph->file_count; ++i)
+    {
+        files[i].filename = ASTFileWriterPushCString(&writer, graph->files[i].filename);
+        files[i].first_root = ASTFileNodeIndex(graph->files[i].root);
+    }
+
+    for(int i = 1; i <= graph->atoms.count; ++i)
+    {
+        atoms[i] = ASTFileWriterPushString(&writer, graph->atoms.strings[i], graph->atoms.string_lengths[i]);
+    }
+
+    for(int i = 1; i <= graph->tags.count; ++i)
+    {
+        tags[i].name = ASTFileWriterPushString(&writer, graph->tags.strings[i], graph->tags.string_lengths[i]);
+        tags[i].node_count = graph->tag_infos[i].node_count;
+        tags[i].nodes = ASTFileWriterPushNodes(&writer, graph->tag_infos[i].nodes, graph->tag_infos[i].node_count);
+    }
+
+    header.magic = DATA_DESK_AST_MAGIC;
+    header.version = DATA_DESK_AST_VERSION;
+    header.node_count = graph->node_count;
+    header.file_count = graph->file_count;
+    header.atom_count = graph->atoms.count;
+    header.tag_count = graph->tags.count;
+    header.index_count = writer.index_count;
+    header.string_pool_size = writer.string_pool_size;
+
+    unsigned long long node_bytes = sizeof(DataDeskASTNode) * (unsigned long long)(graph->node_count + 1);
+    unsigned long long file_bytes = sizeof(DataDeskASTFile) * (unsigned long long)(graph->file_count + 1);
+    unsigned long long atom_bytes = sizeof(unsigned int) * (unsigned long long)(graph->atoms.count + 1);
+    unsigned long long tag_bytes = sizeof(DataDeskASTTag) * (unsigned long long)(graph->tags.count + 1);
+    unsigned long long index_bytes = sizeof(unsigned int) * (unsigned long long)writer.index_count;
+
+    // The layout is worked out in 64 bits, and only stored in the header once
+    // it's known to fit.
+    unsigned long long nodes_offset = ASTFileAlign(sizeof(header));
+    unsigned long long files_offset = ASTFileAlign(nodes_offset + node_bytes);
+    unsigned long long atoms_offset = ASTFileAlign(files_offset + file_bytes);
+    unsigned long long tags_offset = ASTFileAlign(atoms_offset + atom_bytes);
+    unsigned long long indices_offset = ASTFileAlign(tags_offset + tag_bytes);
+    unsigned long long strings_offset = ASTFileAlign(indices_offset + index_bytes);
+    unsigned long long size = strings_offset + writer.string_pool_size;
+
+    if(writer.too_large || size > AST_FILE_SIZE_MAX)
+    {
+        LogError("ERROR: The graph is too large for a binary AST file (the limit is 2 GB).");
+    }
+    else
+    {
+        header.nodes = (unsigned int)nodes_offset;
+        header.files = (unsigned int)files_offset;
+        header.atoms = (unsigned int)atoms_offset;
+        header.tags = (unsigned int)tags_offset;
+        header.indices = (unsigned int)indices_offset;
+        header.strings = (unsigned int)strings_offset;
+        header.size = (unsigned int)size;
+
+        // Written next to the old file and moved over it, so that readers
+        // never map a partly written one.
+        int temporary_path_size = CalculateCStringLength(path) + 32;
+        char *temporary_path = malloc(temporary_path_size);
+        Assert(temporary_path != 0);
+        snprintf(temporary_path, temporary_path_size, "%s.%u.tmp", path, GetProcessID());
+
+        FILE *file = fopen(temporary_path, "wb");
+        if(file)
+        {
+            unsigned int written = 0;
+            ASTFileWriteSection(file, &written, 0, &header, sizeof(header));
+            ASTFileWriteSection(file, &written, header.nodes, nodes, (unsigned int)node_bytes);
+            ASTFileWriteSection(file, &written, header.files, files, (unsigned int)file_bytes);
+            ASTFileWriteSection(file, &written, header.atoms, atoms, (unsigned int)atom_bytes);
+            ASTFileWriteSection(file, &written, header.tags, tags, (unsigned int)tag_bytes);
+            ASTFileWriteSection(file, &written, header.indices, writer.indices, (unsigned int)index_bytes);
+            ASTFileWriteSection(file, &written, header.strings, writer.string_pool, writer.string_pool_size);
+            success = !ferror(file);
+            success = !fclose(file) && success;
+            success = success && ReplaceFileWith(path, temporary_path);
+            if(!success)
+            {
+                remove(temporary_path);
+            }
+        }
+
+        free(temporary_path);
+    }
+
+    free(nodes);
+    free(files);
+    free(atoms);
+    free(tags);
+    free(writer.string_pool);
+    free(writer.string_slots);
+    free(writer.indices);
+
+    return success;
+}
+
+/*
+Copyright 2019 Ryan Fleury
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -9,9 +9,12 @@ License : MIT, at end of file.
 typedef struct DataDeskCustom DataDeskCustom;
 struct DataDeskCustom
 {
-    DataDeskInitCallback    *InitCallback;
-    DataDeskParseCallback   *ParseCallback;
-    DataDeskCleanUpCallback *CleanUpCallback;
+    DataDeskInitCallback     *InitCallback;
+    DataDeskParseCallback    *ParseCallback;
+    DataDeskCleanUpCallback  *CleanUpCallback;
+    DataDeskGraphCallback    *GraphCallback;
+    DataDeskFileCallback     *FileCallback;
+    DataDeskServicesCallback *ServicesCallback;
     
 #if BUILD_WIN32
     HANDLE custom_dll;
@@ -19,34 +22,81 @@ struct DataDeskCustom
     void *custom_dll;
 #endif
     
+    char *shadow_path;
+    
+    // The contents that were loaded, for noticing a rebuild.
+    int file_exists;
+    unsigned long long file_hash;
 };
 
+// With shadow_copy, the custom layer is copied, and the copy is
+// loaded instead, so that the custom layer can be rebuilt while it's loaded
+// (which Windows doesn't allow), and so that loading it again after a rebuild
+// can't give back the old one. Every copy gets a new name, because the loader
+// can keep a library around after it's closed. On Linux, the copy is deleted
+// as soon as it's loaded; elsewhere, it's deleted when it's unloaded.
 static DataDeskCustom
-DataDeskCustomLoad(char *custom_dll_path)
+DataDeskCustomLoad(char *custom_dll_path, int shadow_copy)
 {
     DataDeskCustom custom = {0};
+    char *load_path = custom_dll_path;
+    
+    if(shadow_copy)
+    {
+        static int shadow_copy_count = 0;
+        int shadow_path_size = CalculateCStringLength(custom_dll_path) + 48;
+        custom.shadow_path = malloc(shadow_path_size);
+        Assert(custom.shadow_path != 0);
+        snprintf(custom.shadow_path, shadow_path_size, "%s.%u.%i.live",
+                 custom_dll_path, GetProcessID(), shadow_copy_count++);
+        if(CopyFileTo(custom_dll_path, custom.shadow_path))
+        {
+            load_path = custom.shadow_path;
+        }
+        else
+        {
+            LogError("WARNING: Could not copy the custom layer to \"%s\"; loading it in place.", custom.shadow_path);
+            free(custom.shadow_path);
+            custom.shadow_path = 0;
+        }
+    }
+    
+    custom.file_exists = HashFileContents(load_path, &custom.file_hash);
     
 #if BUILD_WIN32
-    custom.custom_dll = LoadLibraryA(custom_dll_path);
+    custom.custom_dll = LoadLibraryA(load_path);
     if(custom.custom_dll)
     {
         Log("Custom layer successfully loaded from \"%s\".", custom_dll_path);
         custom.InitCallback      = (void *)GetProcAddress(custom.custom_dll, "DataDeskCustomInitCallback"   );
         custom.ParseCallback     = (void *)GetProcAddress(custom.custom_dll, "DataDeskCustomParseCallback"  );
         custom.CleanUpCallback   = (void *)GetProcAddress(custom.custom_dll, "DataDeskCustomCleanUpCallback");
+        custom.GraphCallback     = (void *)GetProcAddress(custom.custom_dll, "DataDeskCustomGraphCallback"  );
+        custom.FileCallback      = (void *)GetProcAddress(custom.custom_dll, "DataDeskCustomFileCallback"   );
+        custom.ServicesCallback  = (void *)GetProcAddress(custom.custom_dll, "DataDeskCustomServicesCallback");
     }
 #elif BUILD_LINUX
-    custom.custom_dll = dlopen(custom_dll_path, RTLD_NOW);
+    custom.custom_dll = dlopen(load_path, RTLD_NOW);
+    if(custom.shadow_path)
+    {
+        remove(custom.shadow_path);
+        free(custom.shadow_path);
+        custom.shadow_path = 0;
+    }
     if(custom.custom_dll)
     {
         Log("Custom layer successfully loaded from \"%s\".", custom_dll_path);
         custom.InitCallback      = dlsym(custom.custom_dll, "DataDeskCustomInitCallback"   );
         custom.ParseCallback     = dlsym(custom.custom_dll, "DataDeskCustomParseCallback"  );
         custom.CleanUpCallback   = dlsym(custom.custom_dll, "DataDeskCustomCleanUpCallback");
+        custom.GraphCallback     = dlsym(custom.custom_dll, "DataDeskCustomGraphCallback"  );
+        custom.FileCallback      = dlsym(custom.custom_dll, "DataDeskCustomFileCallback"   );
+        custom.ServicesCallback  = dlsym(custom.custom_dll, "DataDeskCustomServicesCallback");
     }
 #endif
     
-    if(!custom.InitCallback && !custom.ParseCallback && !custom.CleanUpCallback)
+    if(!custom.InitCallback && !custom.ParseCallback && !custom.CleanUpCallback &&
+       !custom.GraphCallback && !custom.FileCallback && !custom.ServicesCallback)
     {
         LogError("WARNING: No callbacks successfully loaded in custom layer.");
     }
@@ -59,7 +109,10 @@ DataDeskCustomUnload(DataDeskCustom *custom)
 {
     
 #if BUILD_WIN32
-    FreeLibrary(custom->custom_dll);
+    if(custom->custom_dll)
+    {
+        FreeLibrary(custom->custom_dll);
+    }
 #elif BUILD_LINUX
     if(custom->custom_dll)
     {
@@ -70,7 +123,17 @@ DataDeskCustomUnload(DataDeskCustom *custom)
     custom->InitCallback = 0;
     custom->ParseCallback = 0;
     custom->CleanUpCallback = 0;
+    custom->GraphCallback = 0;
+    custom->FileCallback = 0;
+    custom->ServicesCallback = 0;
     custom->custom_dll = 0;
+    
+    if(custom->shadow_path)
+    {
+        remove(custom->shadow_path);
+        free(custom->shadow_path);
+        custom->shadow_path = 0;
+    }
 }
 
 /*
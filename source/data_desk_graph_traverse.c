@@ -9,6 +9,13 @@ License : MIT, at end of file.
 static void
 GenerateGraphNullTerminatedStrings(ParseContext *context, DataDeskNode *root)
 {
+    // Shared nodes (see --share-nodes) can be reached more than once,
+    // but only need their strings generated the first time.
+    if(root && (root->flags & DATA_DESK_NODE_FLAG_shared) && root->name_lowercase_with_underscores)
+    {
+        root = root->next;
+    }
+    
     if(root)
     {
         if(root->string)
@@ -78,6 +85,11 @@ GenerateGraphNullTerminatedStrings(ParseContext *context, DataDeskNode *root)
                 GenerateGraphNullTerminatedStrings(context, root->procedure_header.return_type);
                 break;
             }
+            case DATA_DESK_NODE_TYPE_namespace_declaration:
+            {
+                GenerateGraphNullTerminatedStrings(context, root->namespace_declaration.first_member);
+                break;
+            }
             case DATA_DESK_NODE_TYPE_tag:
             {
                 GenerateGraphNullTerminatedStrings(context, root->tag.first_tag_parameter);
@@ -98,11 +110,651 @@ GenerateGraphNullTerminatedStrings(ParseContext *context, DataDeskNode *root)
     }
 }
 
+static void
+BuildNodeChildArray(ParseContext *context, DataDeskNode *node, DataDeskNode *first_child)
+{
+    int child_count = 0;
+    for(DataDeskNode *child = first_child; child; child = child->next)
+    {
+        ++child_count;
+    }
+    
+    if(child_count)
+    {
+        node->child_count = child_count;
+        node->children = ParseContextAllocateMemory(context, sizeof(DataDeskNode *) * child_count);
+        int i = 0;
+        for(DataDeskNode *child = first_child; child; child = child->next)
+        {
+            node->children[i++] = child;
+        }
+        
+        if(child_count > DATA_DESK_CHILD_TABLE_THRESHOLD)
+        {
+            unsigned int child_table_max = 1;
+            while(child_table_max < (unsigned int)child_count * 2)
+            {
+                child_table_max *= 2;
+            }
+            node->child_table_max = child_table_max;
+            node->child_table = ParseContextAllocateMemory(context, sizeof(DataDeskNode *) * child_table_max);
+            MemorySet(node->child_table, 0, sizeof(DataDeskNode *) * child_table_max);
+            
+            for(i = 0; i < child_count; ++i)
+            {
+                DataDeskNode *child = node->children[i];
+                if(child->atom)
+                {
+                    unsigned int slot = ((unsigned int)child->atom * 2654435761u) & (child_table_max - 1);
+                    while(node->child_table[slot] && node->child_table[slot]->atom != child->atom)
+                    {
+                        slot = (slot + 1) & (child_table_max - 1);
+                    }
+                    
+                    // If two children share a name, the first one wins,
+                    // which matches what a linear search would find.
+                    if(!node->child_table[slot])
+                    {
+                        node->child_table[slot] = child;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// A node's source range covers its own token, anything set
+// explicitly while parsing (see ParseContextSetNodeStart/End), and the ranges
+// of its children (which must be computed first). Shared nodes are skipped,
+// because they can be somewhere else entirely (their parents record their
+// own range explicitly while parsing instead).
+static void
+MergeNodeSourceRange(ParseContext *context, DataDeskNodeLocation *location, int start_offset, int end_offset)
+{
+    if(!location->file)
+    {
+        location->file = context->current_file;
+        location->start_offset = start_offset;
+    }
+    else if(start_offset < location->start_offset)
+    {
+        location->start_offset = start_offset;
+    }
+    
+    if(end_offset > location->end_offset)
+    {
+        location->end_offset = end_offset;
+    }
+}
+
+static void
+ComputeNodeSourceRange(ParseContext *context, DataDeskNode *node, DataDeskNode *first_extra_child)
+{
+    if(context->current_file)
+    {
+        DataDeskSourceFile *file = context->graph.files + context->current_file;
+        DataDeskNodeLocation *location = context->graph.node_locations + node->id;
+        
+        if(node->string && node->string >= file->contents && node->string < file->contents + file->contents_length)
+        {
+            int start_offset = (int)(node->string - file->contents);
+            MergeNodeSourceRange(context, location, start_offset, start_offset + node->string_length);
+        }
+        
+        DataDeskNode *children[4] = {0};
+        DataDeskNode *first_child = first_extra_child;
+        switch(node->type)
+        {
+            case DATA_DESK_NODE_TYPE_unary_operator:   { children[0] = node->unary_operator.operand; break; }
+            case DATA_DESK_NODE_TYPE_binary_operator:
+            {
+                children[0] = node->binary_operator.left;
+                children[1] = node->binary_operator.right;
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_struct_declaration:  { first_child = node->struct_declaration.first_member; break; }
+            case DATA_DESK_NODE_TYPE_union_declaration:   { first_child = node->union_declaration.first_member; break; }
+            case DATA_DESK_NODE_TYPE_enum_declaration:    { first_child = node->enum_declaration.first_constant; break; }
+            case DATA_DESK_NODE_TYPE_flags_declaration:   { first_child = node->flags_declaration.first_flag; break; }
+            case DATA_DESK_NODE_TYPE_declaration:
+            {
+                children[0] = node->declaration.type;
+                children[1] = node->declaration.initialization;
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_type_usage:
+            {
+                children[0] = node->type_usage.struct_declaration;
+                children[1] = node->type_usage.union_declaration;
+                first_child = node->type_usage.first_array_size_expression;
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_constant_definition: { children[0] = node->constant_definition.expression; break; }
+            case DATA_DESK_NODE_TYPE_procedure_header:
+            {
+                children[0] = node->procedure_header.return_type;
+                first_child = node->procedure_header.first_parameter;
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_namespace_declaration: { first_child = node->namespace_declaration.first_member; break; }
+            default: break;
+        }
+        
+        for(int i = 0; i < ArrayCount(children); ++i)
+        {
+            DataDeskNodeLocation *child = context->graph.node_locations + (children[i] ? children[i]->id : 0);
+            if(children[i] && !(children[i]->flags & DATA_DESK_NODE_FLAG_shared) &&
+               child->file == context->current_file)
+            {
+                MergeNodeSourceRange(context, location, child->start_offset, child->end_offset);
+            }
+        }
+        for(DataDeskNode *child_node = first_child; child_node; child_node = child_node->next)
+        {
+            DataDeskNodeLocation *child = context->graph.node_locations + child_node->id;
+            if(!(child_node->flags & DATA_DESK_NODE_FLAG_shared) && child->file == context->current_file)
+            {
+                MergeNodeSourceRange(context, location, child->start_offset, child->end_offset);
+            }
+        }
+    }
+}
+
+static void
+IndexGraphNodes(ParseContext *context, DataDeskNode *root, DataDeskNode *parent)
+{
+    for(DataDeskNode *node = root; node; node = node->next)
+    {
+        // Shared nodes (see --share-nodes) can be reached more than once.
+        if(node->flags & DATA_DESK_NODE_FLAG_indexed)
+        {
+            continue;
+        }
+        node->flags |= DATA_DESK_NODE_FLAG_indexed;
+        
+        ParseContextAddTypedNode(context, node);
+        context->graph.node_locations[node->id].parent = parent;
+        
+        switch(node->type)
+        {
+            case DATA_DESK_NODE_TYPE_numeric_constant:
+            case DATA_DESK_NODE_TYPE_string_constant:
+            case DATA_DESK_NODE_TYPE_char_constant:
+            case DATA_DESK_NODE_TYPE_tag:
+            {
+                break;
+            }
+            default:
+            {
+                if(node->string)
+                {
+                    node->atom = ParseContextInternAtom(context, node->string, node->string_length);
+                }
+                break;
+            }
+        }
+        
+        for(DataDeskNode *tag = node->first_tag; tag; tag = tag->next)
+        {
+            ParseContextAddTypedNode(context, tag);
+            context->graph.node_locations[tag->id].parent = node;
+            tag->tag.id = ParseContextInternTag(context, tag->string, tag->string_length);
+            if(tag->tag.id < 64)
+            {
+                node->tag_mask |= (1ull << tag->tag.id);
+            }
+            ParseContextAddTaggedNode(context, tag->tag.id, node);
+            IndexGraphNodes(context, tag->tag.first_tag_parameter, tag);
+            ComputeNodeSourceRange(context, tag, tag->tag.first_tag_parameter);
+            BuildNodeChildArray(context, tag, tag->tag.first_tag_parameter);
+        }
+        
+        switch(node->type)
+        {
+            case DATA_DESK_NODE_TYPE_unary_operator:
+            {
+                IndexGraphNodes(context, node->unary_operator.operand, node);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_binary_operator:
+            {
+                IndexGraphNodes(context, node->binary_operator.left, node);
+                IndexGraphNodes(context, node->binary_operator.right, node);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_struct_declaration:
+            {
+                IndexGraphNodes(context, node->struct_declaration.first_member, node);
+                BuildNodeChildArray(context, node, node->struct_declaration.first_member);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_union_declaration:
+            {
+                IndexGraphNodes(context, node->union_declaration.first_member, node);
+                BuildNodeChildArray(context, node, node->union_declaration.first_member);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_enum_declaration:
+            {
+                IndexGraphNodes(context, node->enum_declaration.first_constant, node);
+                BuildNodeChildArray(context, node, node->enum_declaration.first_constant);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_flags_declaration:
+            {
+                IndexGraphNodes(context, node->flags_declaration.first_flag, node);
+                BuildNodeChildArray(context, node, node->flags_declaration.first_flag);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_declaration:
+            {
+                IndexGraphNodes(context, node->declaration.type, node);
+                IndexGraphNodes(context, node->declaration.initialization, node);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_type_usage:
+            {
+                IndexGraphNodes(context, node->type_usage.first_array_size_expression, node);
+                IndexGraphNodes(context, node->type_usage.struct_declaration, node);
+                IndexGraphNodes(context, node->type_usage.union_declaration, node);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_constant_definition:
+            {
+                IndexGraphNodes(context, node->constant_definition.expression, node);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_procedure_header:
+            {
+                IndexGraphNodes(context, node->procedure_header.first_parameter, node);
+                BuildNodeChildArray(context, node, node->procedure_header.first_parameter);
+                IndexGraphNodes(context, node->procedure_header.return_type, node);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_namespace_declaration:
+            {
+                IndexGraphNodes(context, node->namespace_declaration.first_member, node);
+                BuildNodeChildArray(context, node, node->namespace_declaration.first_member);
+                break;
+            }
+            default: break;
+        }
+        
+        ComputeNodeSourceRange(context, node, 0);
+    }
+}
+
+// Parses and indexes the body of a node skimmed with --skim (see
+// SkimBody), if it hasn't been already.
+static void
+ExpandSkimmedNode(ParseContext *context, DataDeskNode *node)
+{
+    if(node && (node->flags & DATA_DESK_NODE_FLAG_skimmed))
+    {
+        node->flags &= ~DATA_DESK_NODE_FLAG_skimmed;
+        
+        int parent_file = context->current_file;
+        context->current_file = context->skimmed_bodies[node->id].file;
+        
+        DataDeskNode *first = ParseSkimmedBody(context, node);
+        switch(node->type)
+        {
+            case DATA_DESK_NODE_TYPE_struct_declaration: { node->struct_declaration.first_member = first; break; }
+            case DATA_DESK_NODE_TYPE_union_declaration:  { node->union_declaration.first_member = first;  break; }
+            case DATA_DESK_NODE_TYPE_enum_declaration:   { node->enum_declaration.first_constant = first; break; }
+            case DATA_DESK_NODE_TYPE_flags_declaration:  { node->flags_declaration.first_flag = first;    break; }
+            default: break;
+        }
+        IndexGraphNodes(context, first, node);
+        BuildNodeChildArray(context, node, first);
+        GenerateGraphNullTerminatedStrings(context, first);
+        
+        context->current_file = parent_file;
+        
+        // The node's hash (and the hashes of the namespaces around
+        // it) were computed without the body.
+        for(DataDeskNode *parent = node; parent; parent = DataDeskGetNodeParent(&context->graph, parent))
+        {
+            parent->flags &= ~DATA_DESK_NODE_FLAG_hash_computed;
+        }
+    }
+}
+
+static int
+GraphExpandNode(DataDeskGraph *graph, DataDeskNode *node)
+{
+    ExpandSkimmedNode(graph->parse_context, node);
+    return 1;
+}
+
+// Expands every skimmed node that will be sent to the custom
+// layer's parse callback, and everything in the namespaces that will be.
+static void
+ExpandSkimmedNodes(ParseContext *context, DataDeskNode *root, int top_level)
+{
+    for(DataDeskNode *node = root; node; node = node->next)
+    {
+        if(top_level && context->reachable_nodes && !context->reachable_nodes[node->id])
+        {
+            continue;
+        }
+        
+        ExpandSkimmedNode(context, node);
+        if(node->type == DATA_DESK_NODE_TYPE_namespace_declaration)
+        {
+            ExpandSkimmedNodes(context, node->namespace_declaration.first_member, 0);
+        }
+    }
+}
+
+static void
+HashGraphNodes(ParseContext *context, DataDeskNode *root)
+{
+    // DataDeskGetNodeHash computes (and stores) the hash of every
+    // node below the one it's given, bottom-up.
+    for(DataDeskNode *node = root; node; node = node->next)
+    {
+        DataDeskGetNodeHash(&context->graph, node);
+    }
+}
+
+static void
+FreezeGraph(ParseContext *context)
+{
+    DataDeskGraph *graph = &context->graph;
+    
+    // Fill out everything that would otherwise be computed (and
+    // written to nodes) the first time it's read, so that reading the graph
+    // never writes to it again.
+    for(int type = 0; type < DATA_DESK_NODE_TYPE_MAX; ++type)
+    {
+        for(int i = 0; i < graph->type_node_counts[type]; ++i)
+        {
+            DataDeskNode *node = graph->type_nodes[type][i];
+            DataDeskGetIdentifierDeclaration(graph, node);
+            DataDeskGetTypeDefinition(graph, node);
+            DataDeskGetNodeHash(graph, node);
+        }
+    }
+    
+    for(ParseContextMemoryBlock *block = context->first_block; block; block = block->next)
+    {
+        block->frozen = 1;
+        if(block->page_allocated)
+        {
+            MakePagesReadOnly(block->memory, block->memory_size);
+        }
+    }
+    
+    graph->frozen = 1;
+}
+
+typedef struct ReachabilityWorklist ReachabilityWorklist;
+struct ReachabilityWorklist
+{
+    int node_count;
+    int node_max;
+    DataDeskNode **nodes;
+};
+
+static void
+MarkNodeReachable(ParseContext *context, ReachabilityWorklist *worklist, DataDeskNode *node)
+{
+    // Reachability is tracked for top-level nodes only, so a
+    // reference to anything nested (like an enum constant) keeps the whole
+    // top-level declaration that contains it.
+    for(DataDeskNode *parent = DataDeskGetNodeParent(&context->graph, node); parent;
+        parent = DataDeskGetNodeParent(&context->graph, node))
+    {
+        node = parent;
+    }
+    
+    if(!context->reachable_nodes[node->id])
+    {
+        context->reachable_nodes[node->id] = 1;
+        PushNodeToArray(&worklist->nodes, &worklist->node_count, &worklist->node_max, node);
+    }
+}
+
+static void
+MarkReferencedNodesReachable(ParseContext *context, ReachabilityWorklist *worklist, DataDeskNode *first, int follow_next)
+{
+    for(DataDeskNode *node = first; node; node = follow_next ? node->next : 0)
+    {
+        ExpandSkimmedNode(context, node);
+        
+        for(DataDeskNode *tag = node->first_tag; tag; tag = tag->next)
+        {
+            MarkReferencedNodesReachable(context, worklist, tag->tag.first_tag_parameter, 1);
+        }
+        
+        switch(node->type)
+        {
+            case DATA_DESK_NODE_TYPE_identifier:
+            {
+                DataDeskNode *declaration = DataDeskGetIdentifierDeclaration(&context->graph, node);
+                if(declaration)
+                {
+                    MarkNodeReachable(context, worklist, declaration);
+                }
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_unary_operator:
+            {
+                MarkReferencedNodesReachable(context, worklist, node->unary_operator.operand, 0);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_binary_operator:
+            {
+                MarkReferencedNodesReachable(context, worklist, node->binary_operator.left, 0);
+                MarkReferencedNodesReachable(context, worklist, node->binary_operator.right, 0);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_struct_declaration:
+            {
+                MarkReferencedNodesReachable(context, worklist, node->struct_declaration.first_member, 1);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_union_declaration:
+            {
+                MarkReferencedNodesReachable(context, worklist, node->union_declaration.first_member, 1);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_enum_declaration:
+            {
+                MarkReferencedNodesReachable(context, worklist, node->enum_declaration.first_constant, 1);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_flags_declaration:
+            {
+                MarkReferencedNodesReachable(context, worklist, node->flags_declaration.first_flag, 1);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_declaration:
+            {
+                MarkReferencedNodesReachable(context, worklist, node->declaration.type, 0);
+                MarkReferencedNodesReachable(context, worklist, node->declaration.initialization, 0);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_type_usage:
+            {
+                DataDeskNode *definition = DataDeskGetTypeDefinition(&context->graph, node);
+                if(definition)
+                {
+                    MarkNodeReachable(context, worklist, definition);
+                }
+                MarkReferencedNodesReachable(context, worklist, node->type_usage.first_array_size_expression, 1);
+                MarkReferencedNodesReachable(context, worklist, node->type_usage.struct_declaration, 0);
+                MarkReferencedNodesReachable(context, worklist, node->type_usage.union_declaration, 0);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_constant_definition:
+            {
+                MarkReferencedNodesReachable(context, worklist, node->constant_definition.expression, 0);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_procedure_header:
+            {
+                MarkReferencedNodesReachable(context, worklist, node->procedure_header.first_parameter, 1);
+                MarkReferencedNodesReachable(context, worklist, node->procedure_header.return_type, 0);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_namespace_declaration:
+            {
+                MarkReferencedNodesReachable(context, worklist, node->namespace_declaration.first_member, 1);
+                break;
+            }
+            default: break;
+        }
+    }
+}
+
+// Whether the node is a declaration at the top level, or in
+// namespaces that are.
+static int
+NodeIsTopLevelDeclaration(ParseContext *context, DataDeskNode *node)
+{
+    DataDeskNode *parent = DataDeskGetNodeParent(&context->graph, node);
+    while(parent && parent->type == DATA_DESK_NODE_TYPE_namespace_declaration)
+    {
+        parent = DataDeskGetNodeParent(&context->graph, parent);
+    }
+    return !parent;
+}
+
+// Returns whether the root matched anything. Tags are found with
+// the tag index, and names (which can be qualified, like "Render.Vertex")
+// are looked up from the top level.
+static int
+MarkRootReachable(ParseContext *context, ReachabilityWorklist *worklist, char *root, int root_length)
+{
+    DataDeskGraph *graph = &context->graph;
+    int matched = 0;
+    if(root_length > 0 && root[0] == '@')
+    {
+        int tag_id = DataDeskGetTagIDN(graph, root, root_length);
+        if(tag_id)
+        {
+            for(int i = 0; i < graph->tag_infos[tag_id].node_count; ++i)
+            {
+                DataDeskNode *node = graph->tag_infos[tag_id].nodes[i];
+                if(NodeIsTopLevelDeclaration(context, node))
+                {
+                    MarkNodeReachable(context, worklist, node);
+                    matched = 1;
+                }
+            }
+        }
+    }
+    else if(root_length > 0)
+    {
+        DataDeskNode *node = ParseContextLookUpSymbolFromScope(context, 0, root, root_length);
+        if(node)
+        {
+            // With --streaming, a summary is a declaration from a
+            // file that has already been sent.
+            if(!(node->flags & DATA_DESK_NODE_FLAG_summary))
+            {
+                MarkNodeReachable(context, worklist, node);
+            }
+            matched = 1;
+        }
+    }
+    return matched;
+}
+
+// roots is a comma-separated list of tags (like "@Export") and
+// names. Declarations at the top level (or in namespaces) that match one of
+// them, and every top-level node that they refer to (through types,
+// identifiers, and tag parameters, directly or not), are marked as
+// reachable; the rest are not sent to the custom layer's parse callback.
+static void
+ComputeReachableNodes(ParseContext *context, char *roots)
+{
+    DataDeskGraph *graph = &context->graph;
+    ReachabilityWorklist worklist = {0};
+    
+    free(context->reachable_nodes);
+    context->reachable_nodes = calloc(1, graph->node_count + 1);
+    Assert(context->reachable_nodes != 0);
+    
+    if(!context->matched_roots)
+    {
+        context->root_count = 1;
+        for(char *at = roots; *at; ++at)
+        {
+            context->root_count += *at == ',';
+        }
+        context->matched_roots = calloc(1, context->root_count);
+        Assert(context->matched_roots != 0);
+    }
+    
+    int root_index = 0;
+    for(char *root = roots; *root; ++root_index)
+    {
+        int root_length = 0;
+        while(root[root_length] && root[root_length] != ',')
+        {
+            ++root_length;
+        }
+        
+        if(MarkRootReachable(context, &worklist, root, root_length))
+        {
+            context->matched_roots[root_index] = 1;
+        }
+        
+        root += root_length;
+        if(*root == ',')
+        {
+            ++root;
+        }
+    }
+    
+    while(worklist.node_count > 0)
+    {
+        DataDeskNode *node = worklist.nodes[--worklist.node_count];
+        MarkReferencedNodesReachable(context, &worklist, node, 0);
+    }
+    
+    free(worklist.nodes);
+}
+
+// Called once every file has been sent.
+static void
+WarnAboutUnmatchedRoots(ParseContext *context)
+{
+    int root_index = 0;
+    for(char *root = context->roots; root && *root; ++root_index)
+    {
+        int root_length = 0;
+        while(root[root_length] && root[root_length] != ',')
+        {
+            ++root_length;
+        }
+        
+        if(root_length && (root_index >= context->root_count || !context->matched_roots[root_index]))
+        {
+            LogError("WARNING: \"%.*s\" (from --roots) didn't match anything.", root_length, root);
+        }
+        
+        root += root_length;
+        if(*root == ',')
+        {
+            ++root;
+        }
+    }
+}
+
 static void
 CallCustomParseCallbacks(ParseContext *context, DataDeskNode *root, DataDeskCustom custom, char *filename)
 {
     for(DataDeskNode *node = root; node; node = node->next)
     {
+        if(context->reachable_nodes && !context->reachable_nodes[node->id])
+        {
+            continue;
+        }
+        
         if(custom.ParseCallback)
         {
             custom.ParseCallback(node, filename);
@@ -111,7 +763,7 @@ CallCustomParseCallbacks(ParseContext *context, DataDeskNode *root, DataDeskCust
 }
 
 static void
-PatchGraphSymbols(ParseContext *context, DataDeskNode *root)
+PatchGraphSymbols(ParseContext *context, DataDeskNode *root, int scope)
 {
     for(DataDeskNode *node = root; node; node = node->next)
     {
@@ -119,53 +771,60 @@ PatchGraphSymbols(ParseContext *context, DataDeskNode *root)
         {
             case DATA_DESK_NODE_TYPE_identifier:
             {
-                node->identifier.declaration = ParseContextLookUpSymbol(context, node->string, node->string_length);
+                node->identifier.declaration = ParseContextResolveSymbol(context, scope, node->string, node->string_length);
+                node->flags |= DATA_DESK_NODE_FLAG_symbol_resolved;
                 break;
             }
             case DATA_DESK_NODE_TYPE_unary_operator:
             {
-                PatchGraphSymbols(context, node->unary_operator.operand);
+                PatchGraphSymbols(context, node->unary_operator.operand, scope);
                 break;
             }
             case DATA_DESK_NODE_TYPE_binary_operator:
             {
-                PatchGraphSymbols(context, node->binary_operator.left);
-                PatchGraphSymbols(context, node->binary_operator.right);
+                PatchGraphSymbols(context, node->binary_operator.left, scope);
+                PatchGraphSymbols(context, node->binary_operator.right, scope);
                 break;
             }
             case DATA_DESK_NODE_TYPE_struct_declaration:
             {
-                PatchGraphSymbols(context, node->struct_declaration.first_member);
+                PatchGraphSymbols(context, node->struct_declaration.first_member, scope);
                 break;
             }
             case DATA_DESK_NODE_TYPE_union_declaration:
             {
-                PatchGraphSymbols(context, node->union_declaration.first_member);
+                PatchGraphSymbols(context, node->union_declaration.first_member, scope);
                 break;
             }
             case DATA_DESK_NODE_TYPE_declaration:
             {
-                PatchGraphSymbols(context, node->declaration.type);
-                PatchGraphSymbols(context, node->declaration.initialization);
+                PatchGraphSymbols(context, node->declaration.type, scope);
+                PatchGraphSymbols(context, node->declaration.initialization, scope);
                 break;
             }
             case DATA_DESK_NODE_TYPE_type_usage:
             {
                 if(!node->type_usage.struct_declaration && !node->type_usage.union_declaration)
                 {
-                    node->type_usage.type_definition = ParseContextLookUpSymbol(context, node->string, node->string_length);
+                    node->type_usage.type_definition = ParseContextResolveSymbol(context, scope, node->string, node->string_length);
                 }
+                node->flags |= DATA_DESK_NODE_FLAG_symbol_resolved;
                 break;
             }
             case DATA_DESK_NODE_TYPE_tag:
             {
-                PatchGraphSymbols(context, node->tag.first_tag_parameter);
+                PatchGraphSymbols(context, node->tag.first_tag_parameter, scope);
                 break;
             }
             case DATA_DESK_NODE_TYPE_procedure_header:
             {
-                PatchGraphSymbols(context, node->procedure_header.return_type);
-                PatchGraphSymbols(context, node->procedure_header.first_parameter);
+                PatchGraphSymbols(context, node->procedure_header.return_type, scope);
+                PatchGraphSymbols(context, node->procedure_header.first_parameter, scope);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_namespace_declaration:
+            {
+                PatchGraphSymbols(context, node->namespace_declaration.first_member, node->namespace_declaration.scope);
                 break;
             }
             default: break;
@@ -173,9 +832,300 @@ PatchGraphSymbols(ParseContext *context, DataDeskNode *root)
         
         if(node->first_tag)
         {
-            PatchGraphSymbols(context, node->first_tag);
+            PatchGraphSymbols(context, node->first_tag, scope);
+        }
+    }
+}
+
+// With --streaming, a file's nodes are released once the file has
+// been sent to the custom layer. Before that happens, every declaration that
+// is in a symbol table is replaced there by a summary, allocated in the
+// persistent arena, which keeps what later files need to know about it.
+typedef struct FileSummarizer FileSummarizer;
+struct FileSummarizer
+{
+    // The file's nodes have IDs from first_node_id + 1 up to
+    // first_node_id + node_count; summaries is indexed by ID minus
+    // first_node_id + 1.
+    int first_node_id;
+    int node_count;
+    DataDeskNode **summaries;
+};
+
+static DataDeskNode *SummarizeNodeList(ParseContext *context, FileSummarizer *summarizer, DataDeskNode *first);
+
+static DataDeskNode *
+SummarizeNode(ParseContext *context, FileSummarizer *summarizer, DataDeskNode *node)
+{
+    DataDeskNode *summary = 0;
+    if(node)
+    {
+        summary = ParseContextAllocateMemory(context, sizeof(DataDeskNode));
+        MemorySet(summary, 0, sizeof(DataDeskNode));
+        summary->type = node->type;
+        summary->flags = DATA_DESK_NODE_FLAG_summary | DATA_DESK_NODE_FLAG_hash_computed;
+        summary->hash = DataDeskGetNodeHash(&context->graph, node);
+        summary->atom = node->atom;
+        summary->tag_mask = node->tag_mask;
+        
+        // Names are already interned (in the persistent arena), so
+        // only literals need their strings copied.
+        summary->string_length = node->string_length;
+        if(node->atom)
+        {
+            summary->string = context->graph.atoms.strings[node->atom];
+        }
+        else if(node->string)
+        {
+            summary->string = ParseContextAllocateMemory(context, node->string_length + 1);
+            MemoryCopy(summary->string, node->string, node->string_length);
+            summary->string[node->string_length] = 0;
+        }
+        
+        if(node->id > summarizer->first_node_id && node->id <= summarizer->first_node_id + summarizer->node_count)
+        {
+            summarizer->summaries[node->id - summarizer->first_node_id - 1] = summary;
+        }
+        
+        switch(node->type)
+        {
+            case DATA_DESK_NODE_TYPE_unary_operator:
+            {
+                summary->unary_operator.type = node->unary_operator.type;
+                summary->unary_operator.operand = SummarizeNode(context, summarizer, node->unary_operator.operand);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_binary_operator:
+            {
+                summary->binary_operator.type = node->binary_operator.type;
+                summary->binary_operator.left = SummarizeNode(context, summarizer, node->binary_operator.left);
+                summary->binary_operator.right = SummarizeNode(context, summarizer, node->binary_operator.right);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_struct_declaration:
+            {
+                summary->struct_declaration.first_member = SummarizeNodeList(context, summarizer, node->struct_declaration.first_member);
+                BuildNodeChildArray(context, summary, summary->struct_declaration.first_member);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_union_declaration:
+            {
+                summary->union_declaration.first_member = SummarizeNodeList(context, summarizer, node->union_declaration.first_member);
+                BuildNodeChildArray(context, summary, summary->union_declaration.first_member);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_enum_declaration:
+            {
+                summary->enum_declaration.first_constant = SummarizeNodeList(context, summarizer, node->enum_declaration.first_constant);
+                BuildNodeChildArray(context, summary, summary->enum_declaration.first_constant);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_flags_declaration:
+            {
+                summary->flags_declaration.first_flag = SummarizeNodeList(context, summarizer, node->flags_declaration.first_flag);
+                BuildNodeChildArray(context, summary, summary->flags_declaration.first_flag);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_declaration:
+            {
+                summary->declaration.type = SummarizeNode(context, summarizer, node->declaration.type);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_type_usage:
+            {
+                summary->type_usage.pointer_count = node->type_usage.pointer_count;
+                summary->type_usage.first_array_size_expression = SummarizeNodeList(context, summarizer, node->type_usage.first_array_size_expression);
+                summary->type_usage.struct_declaration = SummarizeNode(context, summarizer, node->type_usage.struct_declaration);
+                summary->type_usage.union_declaration = SummarizeNode(context, summarizer, node->type_usage.union_declaration);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_constant_definition:
+            {
+                summary->constant_definition.expression = SummarizeNode(context, summarizer, node->constant_definition.expression);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_namespace_declaration:
+            {
+                summary->namespace_declaration.scope = node->namespace_declaration.scope;
+                break;
+            }
+            default: break;
+        }
+    }
+    return summary;
+}
+
+static DataDeskNode *
+SummarizeNodeList(ParseContext *context, FileSummarizer *summarizer, DataDeskNode *first)
+{
+    DataDeskNode *first_summary = 0;
+    DataDeskNode **summary_store_target = &first_summary;
+    for(DataDeskNode *node = first; node; node = node->next)
+    {
+        *summary_store_target = SummarizeNode(context, summarizer, node);
+        summary_store_target = &(*summary_store_target)->next;
+    }
+    return first_summary;
+}
+
+// Summarizes the declarations in a list that are in the given
+// scope's symbol table, replaces them there, and returns the summaries as a
+// list. Namespace members are summarized in their own scope.
+static DataDeskNode *
+SummarizeScope(ParseContext *context, FileSummarizer *summarizer, DataDeskNode *first, int scope)
+{
+    DataDeskNode *first_summary = 0;
+    DataDeskNode **summary_store_target = &first_summary;
+    ParseContextSymbolTable *table = &context->scopes[scope].symbols;
+    
+    for(DataDeskNode *node = first; node; node = node->next)
+    {
+        unsigned int slot = 0;
+        int in_table = 0;
+        if(node->string && table->max)
+        {
+            slot = ParseContextSymbolTableFindSlot(table, node->string, node->string_length);
+            in_table = table->keys[slot].key && table->values[slot].root == node;
+        }
+        
+        if(in_table)
+        {
+            DataDeskNode *summary = SummarizeNode(context, summarizer, node);
+            summary->name_lowercase_with_underscores = ParseContextAllocateStringCopyLowercaseWithUnderscores(context, summary->name);
+            summary->name_uppercase_with_underscores = ParseContextAllocateStringCopyUppercaseWithUnderscores(context, summary->name);
+            summary->name_lower_camel_case = ParseContextAllocateStringCopyLowerCamelCase(context, summary->name);
+            summary->name_upper_camel_case = ParseContextAllocateStringCopyUpperCamelCase(context, summary->name);
+            if(node->type == DATA_DESK_NODE_TYPE_namespace_declaration)
+            {
+                int namespace_scope = node->namespace_declaration.scope;
+                summary->namespace_declaration.first_member =
+                    SummarizeScope(context, summarizer, node->namespace_declaration.first_member, namespace_scope);
+                if(context->scopes[namespace_scope].node == node)
+                {
+                    context->scopes[namespace_scope].node = summary;
+                }
+            }
+            table->keys[slot].key = summary->string;
+            table->values[slot].root = summary;
+            *summary_store_target = summary;
+            summary_store_target = &summary->next;
+        }
+        else if(node->type == DATA_DESK_NODE_TYPE_namespace_declaration)
+        {
+            // A reopened namespace; its members go into the scope
+            // of the block that opened it first.
+            SummarizeScope(context, summarizer, node->namespace_declaration.first_member, node->namespace_declaration.scope);
+        }
+    }
+    
+    return first_summary;
+}
+
+// Definitions in the file being released are swapped for their
+// summaries. Anything else that isn't a summary (which can only be in a file
+// that is still being parsed, and will be released first) is left out.
+static DataDeskNode *
+GetSummaryOfNode(FileSummarizer *summarizer, DataDeskNode *node)
+{
+    DataDeskNode *summary = 0;
+    if(node)
+    {
+        if(node->flags & DATA_DESK_NODE_FLAG_summary)
+        {
+            summary = node;
+        }
+        else if(node->id > summarizer->first_node_id && node->id <= summarizer->first_node_id + summarizer->node_count)
+        {
+            summary = summarizer->summaries[node->id - summarizer->first_node_id - 1];
+        }
+    }
+    return summary;
+}
+
+static void
+ResolveSummarySymbols(ParseContext *context, FileSummarizer *summarizer)
+{
+    DataDeskGraph *graph = &context->graph;
+    
+    for(int i = 0; i < graph->type_node_counts[DATA_DESK_NODE_TYPE_identifier]; ++i)
+    {
+        DataDeskNode *node = graph->type_nodes[DATA_DESK_NODE_TYPE_identifier][i];
+        DataDeskNode *summary = GetSummaryOfNode(summarizer, node);
+        if(summary && summary != node)
+        {
+            summary->identifier.declaration = GetSummaryOfNode(summarizer, DataDeskGetIdentifierDeclaration(graph, node));
+            summary->flags |= DATA_DESK_NODE_FLAG_symbol_resolved;
+        }
+    }
+    
+    for(int i = 0; i < graph->type_node_counts[DATA_DESK_NODE_TYPE_type_usage]; ++i)
+    {
+        DataDeskNode *node = graph->type_nodes[DATA_DESK_NODE_TYPE_type_usage][i];
+        DataDeskNode *summary = GetSummaryOfNode(summarizer, node);
+        if(summary && summary != node)
+        {
+            summary->type_usage.type_definition = GetSummaryOfNode(summarizer, DataDeskGetTypeDefinition(graph, node));
+            summary->flags |= DATA_DESK_NODE_FLAG_symbol_resolved;
+        }
+    }
+}
+
+// Releases a file that has been sent to the custom layer (with
+// --streaming), and resets everything that refers to its nodes. The file's
+// arena itself is released by ParseContextEndFileArena.
+static void
+ReleaseParsedFile(ParseContext *context, int file_id, int first_node_id)
+{
+    DataDeskGraph *graph = &context->graph;
+    DataDeskSourceFile *file = graph->files + file_id;
+    
+    FileSummarizer summarizer = {0};
+    summarizer.first_node_id = first_node_id;
+    summarizer.node_count = graph->node_count - first_node_id;
+    summarizer.summaries = calloc(summarizer.node_count + 1, sizeof(DataDeskNode *));
+    Assert(summarizer.summaries != 0);
+    
+    ParseContextSwapPersistentArena(context);
+    SummarizeScope(context, &summarizer, file->root, 0);
+    ParseContextSwapPersistentArena(context);
+    ResolveSummarySymbols(context, &summarizer);
+    free(summarizer.summaries);
+    
+    for(int type = 0; type < DATA_DESK_NODE_TYPE_MAX; ++type)
+    {
+        graph->type_node_counts[type] = 0;
+    }
+    for(int i = 1; i <= graph->tags.count; ++i)
+    {
+        graph->tag_infos[i].node_count = 0;
+    }
+    
+    for(int i = 0; i < context->scope_count; ++i)
+    {
+        ParseContextSymbolTable *cache = &context->scopes[i].lookup_cache;
+        if(cache->max)
+        {
+            MemorySet(cache->keys, 0, sizeof(ParseContextSymbolTableKey) * cache->max);
+            cache->count = 0;
         }
     }
+    ParseContextResetHashCons(context);
+    
+    free(context->reachable_nodes);
+    context->reachable_nodes = 0;
+    
+    // Files that are still being parsed (ones that import this one)
+    // hold the IDs before first_node_id, so IDs are only reused from there.
+    graph->node_count = first_node_id;
+    graph->frozen = 0;
+    
+    free(file->contents);
+    free(file->line_offsets);
+    file->contents = 0;
+    file->contents_length = 0;
+    file->line_offsets = 0;
+    file->line_count = 0;
+    file->root = 0;
 }
 
 /*
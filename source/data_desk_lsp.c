@@ -0,0 +1,1770 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Data Desk
+
+Author  : Ryan Fleury
+Updated : 5 December 2019
+License : MIT, at end of file.
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// With --lsp, Data Desk runs as a language server, speaking
+// JSON-RPC over standard input and output, so that editors can show errors,
+// go to definitions, and find references while files are being edited.
+//
+// Parsing a large file again after every key press would be far too slow, so
+// every open document is kept as a list of chunks, each holding one top-level
+// declaration (or whatever tokens are between two of them), along with what
+// parsing the chunk found: its errors, the symbols it declares, and the
+// identifiers in it. Everything in a chunk is stored relative to the start of
+// the chunk, so an edit only re-lexes and re-parses the chunks that it
+// touches, and the chunks after them are just moved along. Chunks are parsed
+// on their own, so symbols are looked up here, in a table of every chunk's
+// symbols, rather than by the parser.
+
+#define LSP_MESSAGE_MAX_SIZE (1 << 28)
+#define LSP_JSON_MAX_DEPTH 64
+
+enum
+{
+    LSP_JSON_null,
+    LSP_JSON_boolean,
+    LSP_JSON_number,
+    LSP_JSON_string,
+    LSP_JSON_array,
+    LSP_JSON_object,
+};
+
+typedef struct LspJsonValue LspJsonValue;
+struct LspJsonValue
+{
+    int type;
+    char *key;
+    char *string;
+    int string_length;
+    double number;
+    LspJsonValue *first_child;
+    LspJsonValue *next;
+};
+
+typedef struct LspJsonParser LspJsonParser;
+struct LspJsonParser
+{
+    char *at;
+    char *end;
+    int depth;
+};
+
+typedef struct LspBuffer LspBuffer;
+struct LspBuffer
+{
+    char *data;
+    int length;
+    int max;
+};
+
+// Offsets in a chunk's results are from the start of the chunk.
+typedef struct LspSymbol LspSymbol;
+struct LspSymbol
+{
+    int offset;
+    int length;
+
+    // The end of a namespace's body, or the end of the name.
+    int end;
+
+    int type;
+
+    // The index of the namespace that the symbol is in (in the
+    // same chunk), or -1.
+    int parent;
+
+    unsigned long long path_hash;
+};
+
+typedef struct LspIdentifier LspIdentifier;
+struct LspIdentifier
+{
+    int offset;
+    int length;
+
+    // Non-zero if the identifier is followed by ':' or '::'.
+    int declaration;
+};
+
+typedef struct LspError LspError;
+struct LspError
+{
+    // Counted from the line that the chunk starts on, from 0.
+    int line;
+    char *message;
+};
+
+typedef struct LspChunk LspChunk;
+struct LspChunk
+{
+    int start;
+    int length;
+
+    int symbol_count;
+    int symbol_max;
+    LspSymbol *symbols;
+
+    int identifier_count;
+    int identifier_max;
+    LspIdentifier *identifiers;
+
+    int error_count;
+    int error_max;
+    LspError *errors;
+};
+
+typedef struct LspSymbolSlot LspSymbolSlot;
+struct LspSymbolSlot
+{
+    unsigned long long path_hash;
+    int occupied;
+    int chunk;
+    int symbol;
+};
+
+typedef struct LspDocument LspDocument;
+struct LspDocument
+{
+    char *uri;
+    char *path;
+
+    char *text;
+    int text_length;
+    int text_max;
+
+    int line_count;
+    int line_max;
+    int *line_offsets;
+
+    int chunk_count;
+    int chunk_max;
+    LspChunk *chunks;
+
+    // Keyed by path hash; the first declaration of each symbol.
+    unsigned int symbol_slot_max;
+    LspSymbolSlot *symbol_slots;
+
+    // Symbols that were declared again in another chunk.
+    int duplicate_count;
+    int duplicate_max;
+    LspSymbolSlot *duplicates;
+};
+
+typedef struct LspTarget LspTarget;
+struct LspTarget
+{
+    LspDocument *document;
+    int chunk;
+    int symbol;
+};
+
+typedef struct Lsp Lsp;
+struct Lsp
+{
+    FILE *input;
+    FILE *output;
+    int define_count;
+    char **defines;
+    int document_count;
+    int document_max;
+    LspDocument **documents;
+    int shut_down;
+};
+
+static void
+LspJsonFree(LspJsonValue *value)
+{
+    while(value)
+    {
+        LspJsonValue *next = value->next;
+        LspJsonFree(value->first_child);
+        free(value);
+        value = next;
+    }
+}
+
+static void
+LspJsonSkipWhitespace(LspJsonParser *parser)
+{
+    while(parser->at < parser->end &&
+          (*parser->at == ' ' || *parser->at == '\t' || *parser->at == '\n' || *parser->at == '\r'))
+    {
+        ++parser->at;
+    }
+}
+
+static int
+LspHexDigitValue(int c)
+{
+    int value = -1;
+    if(c >= '0' && c <= '9')      value = c - '0';
+    else if(c >= 'a' && c <= 'f') value = c - 'a' + 10;
+    else if(c >= 'A' && c <= 'F') value = c - 'A' + 10;
+    return value;
+}
+
+static int
+LspJsonParseHex4(LspJsonParser *parser, unsigned int *value)
+{
+    int success = 0;
+    if(parser->end - parser->at >= 4)
+    {
+        success = 1;
+        *value = 0;
+        for(int i = 0; i < 4; ++i)
+        {
+            int digit = LspHexDigitValue(parser->at[i]);
+            if(digit < 0)
+            {
+                success = 0;
+                break;
+            }
+            *value = (*value << 4) | digit;
+        }
+        if(success)
+        {
+            parser->at += 4;
+        }
+    }
+    return success;
+}
+
+// Strings are unescaped in place (which never makes them longer),
+// and null-terminated.
+static char *
+LspJsonParseString(LspJsonParser *parser, int *length)
+{
+    char *result = 0;
+    if(parser->at < parser->end && *parser->at == '"')
+    {
+        char *start = ++parser->at;
+        char *write = start;
+        int success = 1;
+        while(success && parser->at < parser->end && *parser->at != '"')
+        {
+            char c = *parser->at++;
+            if(c == '\\')
+            {
+                c = parser->at < parser->end ? *parser->at++ : 0;
+                switch(c)
+                {
+                    case '"': case '\\': case '/': break;
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case 'n': c = '\n'; break;
+                    case 'r': c = '\r'; break;
+                    case 't': c = '\t'; break;
+                    case 'u':
+                    {
+                        unsigned int codepoint = 0;
+                        success = LspJsonParseHex4(parser, &codepoint);
+                        if(success && codepoint >= 0xd800 && codepoint < 0xdc00 &&
+                           parser->end - parser->at >= 2 && parser->at[0] == '\\' && parser->at[1] == 'u')
+                        {
+                            unsigned int low_surrogate = 0;
+                            parser->at += 2;
+                            success = LspJsonParseHex4(parser, &low_surrogate);
+                            codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low_surrogate - 0xdc00);
+                        }
+
+                        if(codepoint < 0x80)
+                        {
+                            *write++ = (char)codepoint;
+                        }
+                        else if(codepoint < 0x800)
+                        {
+                            *write++ = (char)(0xc0 | (codepoint >> 6));
+                            *write++ = (char)(0x80 | (codepoint & 0x3f));
+                        }
+                        else if(codepoint < 0x10000)
+                        {
+                            *write++ = (char)(0xe0 | (codepoint >> 12));
+                            *write++ = (char)(0x80 | ((codepoint >> 6) & 0x3f));
+                            *write++ = (char)(0x80 | (codepoint & 0x3f));
+                        }
+                        else
+                        {
+                            *write++ = (char)(0xf0 | (codepoint >> 18));
+                            *write++ = (char)(0x80 | ((codepoint >> 12) & 0x3f));
+                            *write++ = (char)(0x80 | ((codepoint >> 6) & 0x3f));
+                            *write++ = (char)(0x80 | (codepoint & 0x3f));
+                        }
+                        continue;
+                    }
+                    default: success = 0; break;
+                }
+            }
+            *write++ = c;
+        }
+
+        if(success && parser->at < parser->end)
+        {
+            ++parser->at;
+            *write = 0;
+            *length = (int)(write - start);
+            result = start;
+        }
+    }
+    return result;
+}
+
+static int
+LspJsonParseLiteral(LspJsonParser *parser, char *literal)
+{
+    int length = CalculateCStringLength(literal);
+    int success = (parser->end - parser->at >= length &&
+                   StringMatchCaseSensitiveN(parser->at, literal, length));
+    if(success)
+    {
+        parser->at += length;
+    }
+    return success;
+}
+
+static LspJsonValue *
+LspJsonParseValue(LspJsonParser *parser)
+{
+    LspJsonValue *value = 0;
+    LspJsonSkipWhitespace(parser);
+    if(parser->at < parser->end && parser->depth < LSP_JSON_MAX_DEPTH)
+    {
+        value = calloc(1, sizeof(*value));
+        Assert(value != 0);
+        int success = 0;
+        char c = *parser->at;
+
+        if(c == '{' || c == '[')
+        {
+            char close = c == '{' ? '}' : ']';
+            value->type = c == '{' ? LSP_JSON_object : LSP_JSON_array;
+            ++parser->at;
+            ++parser->depth;
+            LspJsonSkipWhitespace(parser);
+            if(parser->at < parser->end && *parser->at == close)
+            {
+                ++parser->at;
+                success = 1;
+            }
+            else
+            {
+                LspJsonValue **child_store_target = &value->first_child;
+                for(;;)
+                {
+                    char *key = 0;
+                    if(value->type == LSP_JSON_object)
+                    {
+                        int key_length = 0;
+                        LspJsonSkipWhitespace(parser);
+                        key = LspJsonParseString(parser, &key_length);
+                        LspJsonSkipWhitespace(parser);
+                        if(!key || parser->at >= parser->end || *parser->at != ':')
+                        {
+                            break;
+                        }
+                        ++parser->at;
+                    }
+
+                    LspJsonValue *child = LspJsonParseValue(parser);
+                    if(!child)
+                    {
+                        break;
+                    }
+                    child->key = key;
+                    *child_store_target = child;
+                    child_store_target = &child->next;
+
+                    LspJsonSkipWhitespace(parser);
+                    if(parser->at < parser->end && *parser->at == ',')
+                    {
+                        ++parser->at;
+                    }
+                    else
+                    {
+                        if(parser->at < parser->end && *parser->at == close)
+                        {
+                            ++parser->at;
+                            success = 1;
+                        }
+                        break;
+                    }
+                }
+            }
+            --parser->depth;
+        }
+        else if(c == '"')
+        {
+            value->type = LSP_JSON_string;
+            value->string = LspJsonParseString(parser, &value->string_length);
+            success = value->string != 0;
+        }
+        else if(LspJsonParseLiteral(parser, "true"))
+        {
+            value->type = LSP_JSON_boolean;
+            value->number = 1;
+            success = 1;
+        }
+        else if(LspJsonParseLiteral(parser, "false"))
+        {
+            value->type = LSP_JSON_boolean;
+            success = 1;
+        }
+        else if(LspJsonParseLiteral(parser, "null"))
+        {
+            value->type = LSP_JSON_null;
+            success = 1;
+        }
+        else
+        {
+            // Messages are null-terminated, so strtod stops in time.
+            char *number_end = parser->at;
+            value->type = LSP_JSON_number;
+            value->number = strtod(parser->at, &number_end);
+            success = number_end != parser->at && number_end <= parser->end;
+            parser->at = number_end;
+        }
+
+        if(!success)
+        {
+            LspJsonFree(value);
+            value = 0;
+        }
+    }
+    return value;
+}
+
+static LspJsonValue *
+LspJsonParse(char *message, int message_length)
+{
+    LspJsonParser parser = {0};
+    parser.at = message;
+    parser.end = message + message_length;
+    return LspJsonParseValue(&parser);
+}
+
+static LspJsonValue *
+LspJsonGet(LspJsonValue *object, char *key)
+{
+    LspJsonValue *result = 0;
+    if(object && object->type == LSP_JSON_object)
+    {
+        for(LspJsonValue *child = object->first_child; child; child = child->next)
+        {
+            if(StringMatchCaseSensitive(child->key, key))
+            {
+                result = child;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+static char *
+LspJsonGetString(LspJsonValue *object, char *key)
+{
+    LspJsonValue *value = LspJsonGet(object, key);
+    return value && value->type == LSP_JSON_string ? value->string : 0;
+}
+
+static int
+LspJsonGetInt(LspJsonValue *object, char *key, int default_value)
+{
+    LspJsonValue *value = LspJsonGet(object, key);
+    return value && value->type == LSP_JSON_number ? (int)value->number : default_value;
+}
+
+static void
+LspBufferReserve(LspBuffer *buffer, int size)
+{
+    if(buffer->length + size > buffer->max)
+    {
+        while(buffer->length + size > buffer->max)
+        {
+            buffer->max = buffer->max ? buffer->max * 2 : 4096;
+        }
+        buffer->data = realloc(buffer->data, buffer->max);
+        Assert(buffer->data != 0);
+    }
+}
+
+static void
+LspBufferPrintf(LspBuffer *buffer, char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int needed_bytes = vsnprintf(0, 0, format, args);
+    va_end(args);
+    LspBufferReserve(buffer, needed_bytes + 1);
+    va_start(args, format);
+    vsnprintf(buffer->data + buffer->length, needed_bytes + 1, format, args);
+    va_end(args);
+    buffer->length += needed_bytes;
+}
+
+// Pushes the string as a quoted, escaped JSON string.
+static void
+LspBufferPushString(LspBuffer *buffer, char *string, int length)
+{
+    LspBufferReserve(buffer, length * 6 + 2);
+    char *write = buffer->data + buffer->length;
+    *write++ = '"';
+    for(int i = 0; i < length; ++i)
+    {
+        unsigned char c = (unsigned char)string[i];
+        if(c == '"' || c == '\\')
+        {
+            *write++ = '\\';
+            *write++ = c;
+        }
+        else if(c == '\n')
+        {
+            *write++ = '\\';
+            *write++ = 'n';
+        }
+        else if(c < 0x20)
+        {
+            write += sprintf(write, "\\u%04x", c);
+        }
+        else
+        {
+            *write++ = c;
+        }
+    }
+    *write++ = '"';
+    buffer->length = (int)(write - buffer->data);
+}
+
+// Request IDs are numbers or strings, and are sent back as they
+// were.
+static void
+LspBufferPushID(LspBuffer *buffer, LspJsonValue *id)
+{
+    if(id && id->type == LSP_JSON_number)
+    {
+        LspBufferPrintf(buffer, "%lld", (long long)id->number);
+    }
+    else if(id && id->type == LSP_JSON_string)
+    {
+        LspBufferPushString(buffer, id->string, id->string_length);
+    }
+    else
+    {
+        LspBufferPrintf(buffer, "null");
+    }
+}
+
+// Returns a heap-allocated, null-terminated message, or 0 once the
+// input has ended.
+static char *
+LspReadMessage(FILE *input, int *length)
+{
+    char *message = 0;
+    int content_length = -1;
+    char header[1024];
+    for(;;)
+    {
+        if(!fgets(header, sizeof(header), input))
+        {
+            content_length = -1;
+            break;
+        }
+        if(header[0] == '\r' || header[0] == '\n')
+        {
+            if(content_length >= 0)
+            {
+                break;
+            }
+        }
+        else if(StringMatchCaseSensitiveN(header, "Content-Length:", 15))
+        {
+            content_length = atoi(header + 15);
+        }
+    }
+
+    if(content_length >= 0 && content_length < LSP_MESSAGE_MAX_SIZE)
+    {
+        message = malloc(content_length + 1);
+        Assert(message != 0);
+        if(fread(message, 1, content_length, input) == (size_t)content_length)
+        {
+            message[content_length] = 0;
+            *length = content_length;
+        }
+        else
+        {
+            free(message);
+            message = 0;
+        }
+    }
+    return message;
+}
+
+static void
+LspSendMessage(Lsp *lsp, LspBuffer *message)
+{
+    fprintf(lsp->output, "Content-Length: %i\r\n\r\n", message->length);
+    fwrite(message->data, 1, message->length, lsp->output);
+    fflush(lsp->output);
+    message->length = 0;
+}
+
+static void
+LspSendResult(Lsp *lsp, LspBuffer *message, LspJsonValue *id, char *result)
+{
+    LspBufferPrintf(message, "{\"jsonrpc\":\"2.0\",\"id\":");
+    LspBufferPushID(message, id);
+    LspBufferPrintf(message, ",\"result\":%s}", result);
+    LspSendMessage(lsp, message);
+}
+
+static void
+LspSendError(Lsp *lsp, LspBuffer *message, LspJsonValue *id, int code, char *error)
+{
+    LspBufferPrintf(message, "{\"jsonrpc\":\"2.0\",\"id\":");
+    LspBufferPushID(message, id);
+    LspBufferPrintf(message, ",\"error\":{\"code\":%i,\"message\":", code);
+    LspBufferPushString(message, error, CalculateCStringLength(error));
+    LspBufferPrintf(message, "}}");
+    LspSendMessage(lsp, message);
+}
+
+// Returns a heap-allocated path for a "file://" URI (or a copy of
+// anything else), with percent-escapes decoded.
+static char *
+LspPathFromURI(char *uri)
+{
+    char *read = uri;
+    if(StringMatchCaseSensitiveN(uri, "file://", 7))
+    {
+        read += 7;
+    }
+
+    int length = CalculateCStringLength(read);
+    char *path = malloc(length + 1);
+    Assert(path != 0);
+    int path_length = 0;
+    for(int i = 0; i < length; ++i)
+    {
+        int high = 0;
+        int low = 0;
+        if(read[i] == '%' && i + 2 < length &&
+           (high = LspHexDigitValue(read[i+1])) >= 0 &&
+           (low = LspHexDigitValue(read[i+2])) >= 0)
+        {
+            path[path_length++] = (char)((high << 4) | low);
+            i += 2;
+        }
+        else
+        {
+            path[path_length++] = read[i];
+        }
+    }
+    path[path_length] = 0;
+
+#if BUILD_WIN32
+    // "file:///C:/..." has a slash before the drive.
+    if(path[0] == '/' && path_length > 2 && path[2] == ':')
+    {
+        MemoryCopy(path, path + 1, path_length);
+    }
+#endif
+
+    return path;
+}
+
+static unsigned long long
+LspSymbolPathHash(unsigned long long parent_path_hash, char *name, int name_length)
+{
+    return _DataDeskHashBytes(_DataDeskHashMix(parent_path_hash, '.'), name, name_length);
+}
+
+static void
+LspChunkFreeResults(LspChunk *chunk)
+{
+    for(int i = 0; i < chunk->error_count; ++i)
+    {
+        free(chunk->errors[i].message);
+    }
+    free(chunk->symbols);
+    free(chunk->identifiers);
+    free(chunk->errors);
+    int start = chunk->start;
+    int length = chunk->length;
+    MemorySet(chunk, 0, sizeof(*chunk));
+    chunk->start = start;
+    chunk->length = length;
+}
+
+static int
+LspChunkPushSymbol(LspChunk *chunk)
+{
+    if(chunk->symbol_count >= chunk->symbol_max)
+    {
+        chunk->symbol_max = chunk->symbol_max ? chunk->symbol_max * 2 : 8;
+        chunk->symbols = realloc(chunk->symbols, sizeof(LspSymbol) * chunk->symbol_max);
+        Assert(chunk->symbols != 0);
+    }
+    return chunk->symbol_count++;
+}
+
+static int
+LspChunkPushIdentifier(LspChunk *chunk)
+{
+    if(chunk->identifier_count >= chunk->identifier_max)
+    {
+        chunk->identifier_max = chunk->identifier_max ? chunk->identifier_max * 2 : 16;
+        chunk->identifiers = realloc(chunk->identifiers, sizeof(LspIdentifier) * chunk->identifier_max);
+        Assert(chunk->identifiers != 0);
+    }
+    return chunk->identifier_count++;
+}
+
+static int
+LspChunkPushError(LspChunk *chunk)
+{
+    if(chunk->error_count >= chunk->error_max)
+    {
+        chunk->error_max = chunk->error_max ? chunk->error_max * 2 : 4;
+        chunk->errors = realloc(chunk->errors, sizeof(LspError) * chunk->error_max);
+        Assert(chunk->errors != 0);
+    }
+    return chunk->error_count++;
+}
+
+static void
+LspAddChunkSymbols(LspChunk *chunk, ParseContext *context, char *contents,
+                   DataDeskNode *first_node, int parent, unsigned long long parent_path_hash)
+{
+    for(DataDeskNode *node = first_node; node; node = node->next)
+    {
+        int declares_symbol = 0;
+        switch(node->type)
+        {
+            case DATA_DESK_NODE_TYPE_struct_declaration:
+            case DATA_DESK_NODE_TYPE_union_declaration:
+            case DATA_DESK_NODE_TYPE_enum_declaration:
+            case DATA_DESK_NODE_TYPE_flags_declaration:
+            case DATA_DESK_NODE_TYPE_declaration:
+            case DATA_DESK_NODE_TYPE_constant_definition:
+            case DATA_DESK_NODE_TYPE_procedure_header:
+            case DATA_DESK_NODE_TYPE_namespace_declaration:
+            {
+                declares_symbol = 1;
+                break;
+            }
+            default: break;
+        }
+
+        if(declares_symbol && node->string >= contents && node->string + node->string_length <= contents + chunk->length)
+        {
+            int index = LspChunkPushSymbol(chunk);
+            LspSymbol *symbol = chunk->symbols + index;
+            symbol->offset = (int)(node->string - contents);
+            symbol->length = node->string_length;
+            symbol->end = symbol->offset + symbol->length;
+            symbol->type = node->type;
+            symbol->parent = parent;
+            symbol->path_hash = LspSymbolPathHash(parent_path_hash, node->string, node->string_length);
+
+            if(node->type == DATA_DESK_NODE_TYPE_namespace_declaration)
+            {
+                int end = context->graph.node_locations[node->id].end_offset;
+                symbol->end = end > symbol->end ? end : chunk->length;
+                LspAddChunkSymbols(chunk, context, contents, node->namespace_declaration.first_member,
+                                   index, symbol->path_hash);
+            }
+        }
+    }
+}
+
+static void
+LspParseChunk(Lsp *lsp, LspDocument *document, LspChunk *chunk)
+{
+    LspChunkFreeResults(chunk);
+
+    char *contents = malloc(chunk->length + 1);
+    Assert(contents != 0);
+    MemoryCopy(contents, document->text + chunk->start, chunk->length);
+    contents[chunk->length] = 0;
+
+    Tokenizer tokenizer = {0};
+    tokenizer.at = contents;
+    int last_identifier = -1;
+    for(;;)
+    {
+        Token token = NextToken(&tokenizer);
+        if(token.type == TOKEN_invalid)
+        {
+            break;
+        }
+        else if(token.type == TOKEN_alphanumeric_block)
+        {
+            last_identifier = LspChunkPushIdentifier(chunk);
+            LspIdentifier *identifier = chunk->identifiers + last_identifier;
+            identifier->offset = (int)(token.string - contents);
+            identifier->length = token.string_length;
+            identifier->declaration = 0;
+        }
+        else
+        {
+            if(last_identifier >= 0 && (TokenMatch(token, ":") || TokenMatch(token, "::")))
+            {
+                chunk->identifiers[last_identifier].declaration = 1;
+            }
+            last_identifier = -1;
+        }
+    }
+
+    ParseContext context = {0};
+    ParseContextInit(&context);
+    for(int i = 0; i < lsp->define_count; ++i)
+    {
+        ParseContextAddDefine(&context, lsp->defines[i]);
+    }
+    context.current_file = ParseContextAddSourceFile(&context, document->path, contents, chunk->length);
+    tokenizer.at = contents;
+    tokenizer.filename = document->path;
+    tokenizer.line = 1;
+    DataDeskNode *root = ParseCode(&context, &tokenizer);
+    LspAddChunkSymbols(chunk, &context, contents, root, -1, 0);
+
+    // Errors in imported files have already been logged by
+    // ParseFile; only this document's are kept.
+    for(int i = 0; i < context.error_stack_size; ++i)
+    {
+        ParseError *parse_error = context.error_stack + i;
+        if(parse_error->file == document->path)
+        {
+            int message_length = CalculateCStringLength(parse_error->string);
+            int index = LspChunkPushError(chunk);
+            LspError *error = chunk->errors + index;
+            error->line = parse_error->line - 1;
+            error->message = malloc(message_length + 1);
+            Assert(error->message != 0);
+            MemoryCopy(error->message, parse_error->string, message_length + 1);
+        }
+    }
+
+    ParseContextCleanUp(&context);
+}
+
+// Returns where the chunk that starts at the offset ends: after a
+// ';' or a closing brace that isn't inside brackets (and a ';' right after
+// that brace), after a closer with no opener, or at the end of the text.
+static int
+LspFindChunkEnd(LspDocument *document, int start)
+{
+    int end = document->text_length;
+    int depth = 0;
+    Tokenizer tokenizer = {0};
+    tokenizer.at = document->text + start;
+    for(;;)
+    {
+        Token token = NextToken(&tokenizer);
+        if(token.type == TOKEN_invalid)
+        {
+            break;
+        }
+
+        if(token.type == TOKEN_symbolic_block && token.string_length == 1)
+        {
+            char c = token.string[0];
+            int chunk_ended = 0;
+            if(c == '(' || c == '[' || c == '{')
+            {
+                ++depth;
+            }
+            else if(c == ')' || c == ']' || c == '}')
+            {
+                --depth;
+                chunk_ended = depth < 0 || (depth == 0 && c == '}');
+            }
+            else if(c == ';')
+            {
+                chunk_ended = depth == 0;
+            }
+
+            if(chunk_ended)
+            {
+                if(c == '}' && depth == 0)
+                {
+                    Tokenizer peek = tokenizer;
+                    RequireToken(&peek, ";", 0);
+                    tokenizer = peek;
+                }
+                end = (int)(tokenizer.at - document->text);
+                break;
+            }
+        }
+    }
+    return end;
+}
+
+static void
+LspComputeLineOffsets(LspDocument *document)
+{
+    document->line_count = 0;
+    for(int offset = 0;;)
+    {
+        if(document->line_count >= document->line_max)
+        {
+            document->line_max = document->line_max ? document->line_max * 2 : 1024;
+            document->line_offsets = realloc(document->line_offsets, sizeof(int) * document->line_max);
+            Assert(document->line_offsets != 0);
+        }
+        document->line_offsets[document->line_count++] = offset;
+
+        char *newline = memchr(document->text + offset, '\n', document->text_length - offset);
+        if(!newline)
+        {
+            break;
+        }
+        offset = (int)(newline - document->text) + 1;
+    }
+}
+
+static int
+LspLineFromOffset(LspDocument *document, int offset)
+{
+    int low = 0;
+    int high = document->line_count - 1;
+    while(low < high)
+    {
+        int middle = (low + high + 1) / 2;
+        if(document->line_offsets[middle] <= offset)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+static int
+LspUTF8SequenceLength(unsigned char c)
+{
+    int length = 1;
+    if(c >= 0xf0)      length = 4;
+    else if(c >= 0xe0) length = 3;
+    else if(c >= 0xc0) length = 2;
+    return length;
+}
+
+// Positions count UTF-16 code units, as the protocol asks.
+static void
+LspPositionFromOffset(LspDocument *document, int offset, int *line, int *character)
+{
+    *line = LspLineFromOffset(document, offset);
+    *character = 0;
+    for(int i = document->line_offsets[*line]; i < offset;)
+    {
+        int length = LspUTF8SequenceLength((unsigned char)document->text[i]);
+        *character += length == 4 ? 2 : 1;
+        i += length;
+    }
+}
+
+static int
+LspOffsetFromPosition(LspDocument *document, int line, int character)
+{
+    int offset = document->text_length;
+    if(line >= 0 && line < document->line_count)
+    {
+        offset = document->line_offsets[line];
+        for(int units = 0; units < character && offset < document->text_length && document->text[offset] != '\n';)
+        {
+            int length = LspUTF8SequenceLength((unsigned char)document->text[offset]);
+            units += length == 4 ? 2 : 1;
+            offset += length;
+        }
+        if(offset > document->text_length)
+        {
+            offset = document->text_length;
+        }
+    }
+    return offset;
+}
+
+static LspSymbolSlot *
+LspDocumentSymbolSlot(LspDocument *document, unsigned long long path_hash)
+{
+    LspSymbolSlot *slot = 0;
+    if(document->symbol_slot_max)
+    {
+        unsigned int index = (unsigned int)path_hash & (document->symbol_slot_max - 1);
+        while(document->symbol_slots[index].occupied && document->symbol_slots[index].path_hash != path_hash)
+        {
+            index = (index + 1) & (document->symbol_slot_max - 1);
+        }
+        slot = document->symbol_slots + index;
+    }
+    return slot;
+}
+
+// Redeclarations in the same chunk are reported by the parser;
+// ones in different chunks are found here. Namespaces can be opened again.
+static void
+LspBuildSymbolTable(LspDocument *document)
+{
+    int symbol_count = 0;
+    for(int i = 0; i < document->chunk_count; ++i)
+    {
+        symbol_count += document->chunks[i].symbol_count;
+    }
+
+    unsigned int symbol_slot_max = 64;
+    while(symbol_slot_max < (unsigned int)symbol_count * 2)
+    {
+        symbol_slot_max *= 2;
+    }
+    if(symbol_slot_max != document->symbol_slot_max)
+    {
+        free(document->symbol_slots);
+        document->symbol_slots = malloc(sizeof(LspSymbolSlot) * symbol_slot_max);
+        Assert(document->symbol_slots != 0);
+        document->symbol_slot_max = symbol_slot_max;
+    }
+    MemorySet(document->symbol_slots, 0, sizeof(LspSymbolSlot) * symbol_slot_max);
+    document->duplicate_count = 0;
+
+    for(int i = 0; i < document->chunk_count; ++i)
+    {
+        LspChunk *chunk = document->chunks + i;
+        for(int j = 0; j < chunk->symbol_count; ++j)
+        {
+            LspSymbol *symbol = chunk->symbols + j;
+            LspSymbolSlot *slot = LspDocumentSymbolSlot(document, symbol->path_hash);
+            if(!slot->occupied)
+            {
+                slot->path_hash = symbol->path_hash;
+                slot->occupied = 1;
+                slot->chunk = i;
+                slot->symbol = j;
+            }
+            else if(slot->chunk != i &&
+                    !(symbol->type == DATA_DESK_NODE_TYPE_namespace_declaration &&
+                      document->chunks[slot->chunk].symbols[slot->symbol].type == DATA_DESK_NODE_TYPE_namespace_declaration))
+            {
+                if(document->duplicate_count >= document->duplicate_max)
+                {
+                    document->duplicate_max = document->duplicate_max ? document->duplicate_max * 2 : 16;
+                    document->duplicates = realloc(document->duplicates, sizeof(LspSymbolSlot) * document->duplicate_max);
+                    Assert(document->duplicates != 0);
+                }
+                LspSymbolSlot *duplicate = document->duplicates + document->duplicate_count++;
+                MemorySet(duplicate, 0, sizeof(*duplicate));
+                duplicate->chunk = i;
+                duplicate->symbol = j;
+            }
+        }
+    }
+}
+
+static void
+LspPushChunk(LspChunk **chunks, int *chunk_count, int *chunk_max, int start, int length)
+{
+    if(*chunk_count >= *chunk_max)
+    {
+        *chunk_max = *chunk_max ? *chunk_max * 2 : 64;
+        *chunks = realloc(*chunks, sizeof(LspChunk) * *chunk_max);
+        Assert(*chunks != 0);
+    }
+    LspChunk *chunk = *chunks + (*chunk_count)++;
+    MemorySet(chunk, 0, sizeof(*chunk));
+    chunk->start = start;
+    chunk->length = length;
+}
+
+static void
+LspDocumentFreeChunks(LspDocument *document)
+{
+    for(int i = 0; i < document->chunk_count; ++i)
+    {
+        LspChunkFreeResults(document->chunks + i);
+    }
+    document->chunk_count = 0;
+}
+
+static void
+LspParseDocument(Lsp *lsp, LspDocument *document)
+{
+    LspDocumentFreeChunks(document);
+    for(int start = 0; start < document->text_length;)
+    {
+        int end = LspFindChunkEnd(document, start);
+        LspPushChunk(&document->chunks, &document->chunk_count, &document->chunk_max, start, end - start);
+        start = end;
+    }
+    for(int i = 0; i < document->chunk_count; ++i)
+    {
+        LspParseChunk(lsp, document, document->chunks + i);
+    }
+    LspComputeLineOffsets(document);
+    LspBuildSymbolTable(document);
+}
+
+static void
+LspDocumentSetText(LspDocument *document, char *text, int text_length)
+{
+    if(text_length + 1 > document->text_max)
+    {
+        document->text_max = text_length + 1 + text_length / 4;
+        document->text = realloc(document->text, document->text_max);
+        Assert(document->text != 0);
+    }
+    MemoryCopy(document->text, text, text_length);
+    document->text[text_length] = 0;
+    document->text_length = text_length;
+}
+
+// Finds the last chunk that starts at or before the offset.
+static int
+LspFindChunk(LspDocument *document, int offset)
+{
+    int low = 0;
+    int high = document->chunk_count - 1;
+    while(low < high)
+    {
+        int middle = (low + high + 1) / 2;
+        if(document->chunks[middle].start <= offset)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+// Replaces [start, end) with the new text. The text is split into
+// chunks again from the start of the first chunk that the edit touches, until
+// a new chunk ends where an old one did (past the edit); everything after
+// that is unchanged, so only the chunks in between are parsed again.
+static void
+LspDocumentEdit(Lsp *lsp, LspDocument *document, int start, int end, char *new_text, int new_text_length)
+{
+    if(document->chunk_count == 0)
+    {
+        LspDocumentSetText(document, new_text, new_text_length);
+        LspParseDocument(lsp, document);
+        return;
+    }
+
+    int first_chunk = LspFindChunk(document, start);
+    if(first_chunk > 0 && document->chunks[first_chunk].start == start)
+    {
+        // Text typed right after a chunk can continue it.
+        --first_chunk;
+    }
+    int last_chunk = LspFindChunk(document, end);
+
+    int delta = new_text_length - (end - start);
+    int new_length = document->text_length + delta;
+    if(new_length + 1 > document->text_max)
+    {
+        document->text_max = new_length + 1 + new_length / 4;
+        document->text = realloc(document->text, document->text_max);
+        Assert(document->text != 0);
+    }
+    memmove(document->text + start + new_text_length, document->text + end, document->text_length - end);
+    MemoryCopy(document->text + start, new_text, new_text_length);
+    document->text_length = new_length;
+    document->text[new_length] = 0;
+
+    for(int i = last_chunk + 1; i < document->chunk_count; ++i)
+    {
+        document->chunks[i].start += delta;
+    }
+
+    int new_chunk_count = 0;
+    int new_chunk_max = 0;
+    LspChunk *new_chunks = 0;
+    int replaced_chunk = last_chunk;
+    int replaced_chunk_end = document->chunks[last_chunk].start + document->chunks[last_chunk].length + delta;
+    int edit_end = start + new_text_length;
+    for(int chunk_start = document->chunks[first_chunk].start; chunk_start < document->text_length;)
+    {
+        int chunk_end = LspFindChunkEnd(document, chunk_start);
+        LspPushChunk(&new_chunks, &new_chunk_count, &new_chunk_max, chunk_start, chunk_end - chunk_start);
+        chunk_start = chunk_end;
+
+        while(replaced_chunk + 1 < document->chunk_count && replaced_chunk_end < chunk_end)
+        {
+            ++replaced_chunk;
+            replaced_chunk_end = document->chunks[replaced_chunk].start + document->chunks[replaced_chunk].length;
+        }
+        if(chunk_end >= edit_end && replaced_chunk_end == chunk_end)
+        {
+            break;
+        }
+    }
+    if(replaced_chunk_end != (new_chunk_count ? new_chunks[new_chunk_count-1].start + new_chunks[new_chunk_count-1].length : document->text_length))
+    {
+        replaced_chunk = document->chunk_count - 1;
+    }
+
+    for(int i = first_chunk; i <= replaced_chunk; ++i)
+    {
+        LspChunkFreeResults(document->chunks + i);
+    }
+    int kept_after = document->chunk_count - (replaced_chunk + 1);
+    int chunk_count = first_chunk + new_chunk_count + kept_after;
+    if(chunk_count > document->chunk_max)
+    {
+        document->chunk_max = chunk_count * 2;
+        document->chunks = realloc(document->chunks, sizeof(LspChunk) * document->chunk_max);
+        Assert(document->chunks != 0);
+    }
+    memmove(document->chunks + first_chunk + new_chunk_count, document->chunks + replaced_chunk + 1,
+            sizeof(LspChunk) * kept_after);
+    MemoryCopy(document->chunks + first_chunk, new_chunks, sizeof(LspChunk) * new_chunk_count);
+    document->chunk_count = chunk_count;
+    free(new_chunks);
+
+    for(int i = first_chunk; i < first_chunk + new_chunk_count; ++i)
+    {
+        LspParseChunk(lsp, document, document->chunks + i);
+    }
+    LspComputeLineOffsets(document);
+    LspBuildSymbolTable(document);
+}
+
+static LspDocument *
+LspFindDocument(Lsp *lsp, char *uri)
+{
+    LspDocument *document = 0;
+    for(int i = 0; uri && i < lsp->document_count; ++i)
+    {
+        if(StringMatchCaseSensitive(lsp->documents[i]->uri, uri))
+        {
+            document = lsp->documents[i];
+            break;
+        }
+    }
+    return document;
+}
+
+static void
+LspFreeDocument(LspDocument *document)
+{
+    LspDocumentFreeChunks(document);
+    free(document->chunks);
+    free(document->symbol_slots);
+    free(document->duplicates);
+    free(document->line_offsets);
+    free(document->text);
+    free(document->path);
+    free(document->uri);
+    free(document);
+}
+
+static void
+LspPushRange(LspBuffer *buffer, LspDocument *document, int start, int end)
+{
+    int start_line = 0;
+    int start_character = 0;
+    int end_line = 0;
+    int end_character = 0;
+    LspPositionFromOffset(document, start, &start_line, &start_character);
+    LspPositionFromOffset(document, end, &end_line, &end_character);
+    LspBufferPrintf(buffer, "{\"start\":{\"line\":%i,\"character\":%i},\"end\":{\"line\":%i,\"character\":%i}}",
+                    start_line, start_character, end_line, end_character);
+}
+
+static void
+LspPushLocation(LspBuffer *buffer, LspDocument *document, int start, int end)
+{
+    LspBufferPrintf(buffer, "{\"uri\":");
+    LspBufferPushString(buffer, document->uri, CalculateCStringLength(document->uri));
+    LspBufferPrintf(buffer, ",\"range\":");
+    LspPushRange(buffer, document, start, end);
+    LspBufferPrintf(buffer, "}");
+}
+
+static void
+LspPushDiagnostic(LspBuffer *buffer, LspDocument *document, int start, int end, char *message, int *diagnostic_count)
+{
+    LspBufferPrintf(buffer, "%s{\"range\":", (*diagnostic_count)++ ? "," : "");
+    LspPushRange(buffer, document, start, end);
+    LspBufferPrintf(buffer, ",\"severity\":1,\"source\":\"data_desk\",\"message\":");
+    LspBufferPushString(buffer, message, CalculateCStringLength(message));
+    LspBufferPrintf(buffer, "}");
+}
+
+static void
+LspPublishDiagnostics(Lsp *lsp, LspBuffer *message, LspDocument *document, char *uri)
+{
+    LspBufferPrintf(message, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+    LspBufferPushString(message, uri, CalculateCStringLength(uri));
+    LspBufferPrintf(message, ",\"diagnostics\":[");
+    int diagnostic_count = 0;
+    for(int i = 0; document && i < document->chunk_count; ++i)
+    {
+        LspChunk *chunk = document->chunks + i;
+        for(int j = 0; j < chunk->error_count; ++j)
+        {
+            // Errors only know their line, so the whole line is marked.
+            int line = LspLineFromOffset(document, chunk->start) + chunk->errors[j].line;
+            if(line >= document->line_count)
+            {
+                line = document->line_count - 1;
+            }
+            int line_start = document->line_offsets[line];
+            int line_end = line + 1 < document->line_count ? document->line_offsets[line + 1] - 1 : document->text_length;
+            LspPushDiagnostic(message, document, line_start, line_end, chunk->errors[j].message, &diagnostic_count);
+        }
+    }
+    for(int i = 0; document && i < document->duplicate_count; ++i)
+    {
+        LspChunk *chunk = document->chunks + document->duplicates[i].chunk;
+        LspSymbol *symbol = chunk->symbols + document->duplicates[i].symbol;
+        char error[256];
+        snprintf(error, sizeof(error), "\"%.*s\" has already been defined.",
+                 symbol->length, document->text + chunk->start + symbol->offset);
+        LspPushDiagnostic(message, document, chunk->start + symbol->offset, chunk->start + symbol->offset + symbol->length,
+                          error, &diagnostic_count);
+    }
+    LspBufferPrintf(message, "]}}");
+    LspSendMessage(lsp, message);
+}
+
+// Finds the identifier that the offset is in (or just after).
+static int
+LspFindIdentifier(LspChunk *chunk, int offset)
+{
+    int result = -1;
+    for(int i = 0; i < chunk->identifier_count; ++i)
+    {
+        LspIdentifier *identifier = chunk->identifiers + i;
+        if(identifier->offset > offset)
+        {
+            break;
+        }
+        if(offset <= identifier->offset + identifier->length)
+        {
+            result = i;
+        }
+    }
+    return result;
+}
+
+static int
+LspLookUpSymbol(LspDocument *document, unsigned long long path_hash, char *name, int name_length, LspTarget *target)
+{
+    int found = 0;
+    LspSymbolSlot *slot = LspDocumentSymbolSlot(document, path_hash);
+    if(slot && slot->occupied)
+    {
+        LspChunk *chunk = document->chunks + slot->chunk;
+        LspSymbol *symbol = chunk->symbols + slot->symbol;
+        if(symbol->length == name_length &&
+           StringMatchCaseSensitiveN(document->text + chunk->start + symbol->offset, name, name_length))
+        {
+            target->document = document;
+            target->chunk = slot->chunk;
+            target->symbol = slot->symbol;
+            found = 1;
+        }
+    }
+    return found;
+}
+
+// Works out which symbol an identifier names. Qualified names
+// (like A.B) are read back from the identifier; like the parser's scopes,
+// names are looked for in the namespaces around the identifier first, from
+// the inside out. This document is searched before the other open ones.
+static int
+LspResolveIdentifier(Lsp *lsp, LspDocument *document, int chunk_index, int identifier_index, LspTarget *target)
+{
+    LspChunk *chunk = document->chunks + chunk_index;
+    char *chunk_text = document->text + chunk->start;
+
+    int first_component = identifier_index;
+    while(first_component > 0)
+    {
+        LspIdentifier *previous = chunk->identifiers + first_component - 1;
+        LspIdentifier *next = chunk->identifiers + first_component;
+        int dot_count = 0;
+        int only_dot = 1;
+        for(int i = previous->offset + previous->length; i < next->offset; ++i)
+        {
+            char c = chunk_text[i];
+            if(c == '.')
+            {
+                ++dot_count;
+            }
+            else if(c != ' ' && c != '\t' && c != '\r' && c != '\n')
+            {
+                only_dot = 0;
+                break;
+            }
+        }
+        if(!only_dot || dot_count != 1)
+        {
+            break;
+        }
+        --first_component;
+    }
+
+    int namespace_index = -1;
+    int offset = chunk->identifiers[identifier_index].offset;
+    for(int i = 0; i < chunk->symbol_count; ++i)
+    {
+        LspSymbol *symbol = chunk->symbols + i;
+        if(symbol->type == DATA_DESK_NODE_TYPE_namespace_declaration &&
+           symbol->offset < offset && offset < symbol->end)
+        {
+            namespace_index = i;
+        }
+    }
+
+    LspIdentifier *identifier = chunk->identifiers + identifier_index;
+    int found = 0;
+    for(int scope = namespace_index;; scope = chunk->symbols[scope].parent)
+    {
+        unsigned long long path_hash = scope >= 0 ? chunk->symbols[scope].path_hash : 0;
+        for(int i = first_component; i <= identifier_index; ++i)
+        {
+            path_hash = LspSymbolPathHash(path_hash, chunk_text + chunk->identifiers[i].offset, chunk->identifiers[i].length);
+        }
+
+        found = LspLookUpSymbol(document, path_hash, chunk_text + identifier->offset, identifier->length, target);
+        for(int i = 0; !found && i < lsp->document_count; ++i)
+        {
+            if(lsp->documents[i] != document)
+            {
+                found = LspLookUpSymbol(lsp->documents[i], path_hash, chunk_text + identifier->offset, identifier->length, target);
+            }
+        }
+
+        if(found || scope < 0)
+        {
+            break;
+        }
+    }
+    return found;
+}
+
+static int
+LspTargetFromPosition(Lsp *lsp, LspJsonValue *params, LspTarget *target)
+{
+    int found = 0;
+    LspDocument *document = LspFindDocument(lsp, LspJsonGetString(LspJsonGet(params, "textDocument"), "uri"));
+    LspJsonValue *position = LspJsonGet(params, "position");
+    if(document && document->chunk_count && position)
+    {
+        int offset = LspOffsetFromPosition(document, LspJsonGetInt(position, "line", 0), LspJsonGetInt(position, "character", 0));
+        int chunk_index = LspFindChunk(document, offset);
+        LspChunk *chunk = document->chunks + chunk_index;
+        int identifier_index = LspFindIdentifier(chunk, offset - chunk->start);
+        if(identifier_index < 0 && chunk_index > 0 && offset == chunk->start)
+        {
+            chunk = document->chunks + --chunk_index;
+            identifier_index = LspFindIdentifier(chunk, offset - chunk->start);
+        }
+        if(identifier_index >= 0)
+        {
+            found = LspResolveIdentifier(lsp, document, chunk_index, identifier_index, target);
+        }
+    }
+    return found;
+}
+
+static void
+LspHandleDefinition(Lsp *lsp, LspBuffer *message, LspBuffer *result, LspJsonValue *id, LspJsonValue *params)
+{
+    LspTarget target = {0};
+    if(LspTargetFromPosition(lsp, params, &target))
+    {
+        LspChunk *chunk = target.document->chunks + target.chunk;
+        LspSymbol *symbol = chunk->symbols + target.symbol;
+        LspPushLocation(result, target.document, chunk->start + symbol->offset, chunk->start + symbol->offset + symbol->length);
+    }
+    else
+    {
+        LspBufferPrintf(result, "null");
+    }
+    LspSendResult(lsp, message, id, result->data);
+}
+
+// References are found by name, and then checked by resolving
+// them. Declarations of other things (like struct members) that share the
+// name are left out.
+static void
+LspHandleReferences(Lsp *lsp, LspBuffer *message, LspBuffer *result, LspJsonValue *id, LspJsonValue *params)
+{
+    LspBufferPrintf(result, "[");
+    LspTarget target = {0};
+    if(LspTargetFromPosition(lsp, params, &target))
+    {
+        int include_declaration = 0;
+        LspJsonValue *reference_context = LspJsonGet(params, "context");
+        LspJsonValue *include = LspJsonGet(reference_context, "includeDeclaration");
+        include_declaration = include && include->type == LSP_JSON_boolean && include->number;
+
+        LspChunk *target_chunk = target.document->chunks + target.chunk;
+        LspSymbol *target_symbol = target_chunk->symbols + target.symbol;
+        int target_offset = target_chunk->start + target_symbol->offset;
+        char *name = target.document->text + target_offset;
+        int name_length = target_symbol->length;
+
+        int reference_count = 0;
+        for(int i = 0; i < lsp->document_count; ++i)
+        {
+            LspDocument *document = lsp->documents[i];
+            for(int j = 0; j < document->chunk_count; ++j)
+            {
+                LspChunk *chunk = document->chunks + j;
+                for(int k = 0; k < chunk->identifier_count; ++k)
+                {
+                    LspIdentifier *identifier = chunk->identifiers + k;
+                    int offset = chunk->start + identifier->offset;
+                    if(identifier->length == name_length &&
+                       StringMatchCaseSensitiveN(document->text + offset, name, name_length))
+                    {
+                        int is_definition = document == target.document && offset == target_offset;
+                        LspTarget reference = {0};
+                        if(is_definition ? include_declaration :
+                           (!identifier->declaration &&
+                            LspResolveIdentifier(lsp, document, j, k, &reference) &&
+                            reference.document == target.document &&
+                            reference.chunk == target.chunk && reference.symbol == target.symbol))
+                        {
+                            LspBufferPrintf(result, "%s", reference_count++ ? "," : "");
+                            LspPushLocation(result, document, offset, offset + name_length);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    LspBufferPrintf(result, "]");
+    LspSendResult(lsp, message, id, result->data);
+}
+
+static void
+LspHandleDidOpen(Lsp *lsp, LspBuffer *message, LspJsonValue *params)
+{
+    LspJsonValue *text_document = LspJsonGet(params, "textDocument");
+    char *uri = LspJsonGetString(text_document, "uri");
+    LspJsonValue *text = LspJsonGet(text_document, "text");
+    if(uri && text && text->type == LSP_JSON_string)
+    {
+        LspDocument *document = LspFindDocument(lsp, uri);
+        if(!document)
+        {
+            if(lsp->document_count >= lsp->document_max)
+            {
+                lsp->document_max = lsp->document_max ? lsp->document_max * 2 : 16;
+                lsp->documents = realloc(lsp->documents, sizeof(LspDocument *) * lsp->document_max);
+                Assert(lsp->documents != 0);
+            }
+            document = calloc(1, sizeof(*document));
+            Assert(document != 0);
+            int uri_length = CalculateCStringLength(uri);
+            document->uri = malloc(uri_length + 1);
+            Assert(document->uri != 0);
+            MemoryCopy(document->uri, uri, uri_length + 1);
+            document->path = LspPathFromURI(uri);
+            lsp->documents[lsp->document_count++] = document;
+        }
+
+        LspDocumentSetText(document, text->string, text->string_length);
+        LspParseDocument(lsp, document);
+        LspPublishDiagnostics(lsp, message, document, document->uri);
+    }
+}
+
+static void
+LspHandleDidChange(Lsp *lsp, LspBuffer *message, LspJsonValue *params)
+{
+    LspDocument *document = LspFindDocument(lsp, LspJsonGetString(LspJsonGet(params, "textDocument"), "uri"));
+    LspJsonValue *changes = LspJsonGet(params, "contentChanges");
+    if(document && changes && changes->type == LSP_JSON_array)
+    {
+        for(LspJsonValue *change = changes->first_child; change; change = change->next)
+        {
+            LspJsonValue *text = LspJsonGet(change, "text");
+            LspJsonValue *range = LspJsonGet(change, "range");
+            if(!text || text->type != LSP_JSON_string)
+            {
+                continue;
+            }
+
+            if(range)
+            {
+                LspJsonValue *start = LspJsonGet(range, "start");
+                LspJsonValue *end = LspJsonGet(range, "end");
+                int start_offset = LspOffsetFromPosition(document, LspJsonGetInt(start, "line", 0), LspJsonGetInt(start, "character", 0));
+                int end_offset = LspOffsetFromPosition(document, LspJsonGetInt(end, "line", 0), LspJsonGetInt(end, "character", 0));
+                if(end_offset < start_offset)
+                {
+                    end_offset = start_offset;
+                }
+                LspDocumentEdit(lsp, document, start_offset, end_offset, text->string, text->string_length);
+            }
+            else
+            {
+                LspDocumentSetText(document, text->string, text->string_length);
+                LspParseDocument(lsp, document);
+            }
+        }
+        LspPublishDiagnostics(lsp, message, document, document->uri);
+    }
+}
+
+static void
+LspHandleDidClose(Lsp *lsp, LspBuffer *message, LspJsonValue *params)
+{
+    char *uri = LspJsonGetString(LspJsonGet(params, "textDocument"), "uri");
+    for(int i = 0; uri && i < lsp->document_count; ++i)
+    {
+        if(StringMatchCaseSensitive(lsp->documents[i]->uri, uri))
+        {
+            LspFreeDocument(lsp->documents[i]);
+            lsp->documents[i] = lsp->documents[--lsp->document_count];
+            LspPublishDiagnostics(lsp, message, 0, uri);
+            break;
+        }
+    }
+}
+
+// Runs until the client sends "exit" (or closes the input).
+// Anything else printed (like logging) goes to stderr, since stdout carries
+// the protocol.
+static int
+RunLanguageServer(int define_count, char **defines)
+{
+    Lsp lsp = {0};
+    lsp.define_count = define_count;
+    lsp.defines = defines;
+    lsp.input = stdin;
+#if BUILD_WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    lsp.output = _fdopen(_dup(_fileno(stdout)), "wb");
+    _dup2(_fileno(stderr), _fileno(stdout));
+#elif BUILD_LINUX
+    lsp.output = fdopen(dup(1), "wb");
+    dup2(2, 1);
+#endif
+    if(!lsp.output)
+    {
+        LogError("ERROR: Could not open the output for the language server.");
+        return 1;
+    }
+
+    Log("Running as a language server.");
+
+    int exit_code = 1;
+    LspBuffer message = {0};
+    LspBuffer result = {0};
+    char *input = 0;
+    int input_length = 0;
+    while((input = LspReadMessage(lsp.input, &input_length)))
+    {
+        LspJsonValue *request = LspJsonParse(input, input_length);
+        LspJsonValue *id = LspJsonGet(request, "id");
+        LspJsonValue *params = LspJsonGet(request, "params");
+        char *method = LspJsonGetString(request, "method");
+        result.length = 0;
+        int exit_requested = 0;
+
+        if(!request || request->type != LSP_JSON_object)
+        {
+            LspSendError(&lsp, &message, 0, -32700, "Could not parse the message.");
+        }
+        else if(!method)
+        {
+            // Responses to requests that were never sent.
+        }
+        else if(StringMatchCaseSensitive(method, "initialize"))
+        {
+            LspSendResult(&lsp, &message, id,
+                          "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+                          "\"definitionProvider\":true,\"referencesProvider\":true},"
+                          "\"serverInfo\":{\"name\":\"Data Desk\",\"version\":\"" DATA_DESK_VERSION_STRING "\"}}");
+        }
+        else if(StringMatchCaseSensitive(method, "shutdown"))
+        {
+            lsp.shut_down = 1;
+            LspSendResult(&lsp, &message, id, "null");
+        }
+        else if(StringMatchCaseSensitive(method, "exit"))
+        {
+            exit_code = lsp.shut_down ? 0 : 1;
+            exit_requested = 1;
+        }
+        else if(StringMatchCaseSensitive(method, "textDocument/didOpen"))
+        {
+            LspHandleDidOpen(&lsp, &message, params);
+        }
+        else if(StringMatchCaseSensitive(method, "textDocument/didChange"))
+        {
+            LspHandleDidChange(&lsp, &message, params);
+        }
+        else if(StringMatchCaseSensitive(method, "textDocument/didClose"))
+        {
+            LspHandleDidClose(&lsp, &message, params);
+        }
+        else if(StringMatchCaseSensitive(method, "textDocument/definition"))
+        {
+            LspHandleDefinition(&lsp, &message, &result, id, params);
+        }
+        else if(StringMatchCaseSensitive(method, "textDocument/references"))
+        {
+            LspHandleReferences(&lsp, &message, &result, id, params);
+        }
+        else if(id)
+        {
+            LspSendError(&lsp, &message, id, -32601, "Unsupported method.");
+        }
+
+        LspJsonFree(request);
+        free(input);
+        if(exit_requested)
+        {
+            break;
+        }
+    }
+
+    for(int i = 0; i < lsp.document_count; ++i)
+    {
+        LspFreeDocument(lsp.documents[i]);
+    }
+    free(lsp.documents);
+    free(message.data);
+    free(result.data);
+    fclose(lsp.output);
+    return exit_code;
+}
+
+/*
+Copyright 2019 Ryan Fleury
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
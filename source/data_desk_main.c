@@ -10,8 +10,21 @@ License : MIT, at end of file.
 #if BUILD_WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <fcntl.h>
+#include <io.h>
 #elif BUILD_LINUX
 #include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 #endif
 
 // NOTE(rjf): C Runtime Library
@@ -27,7 +40,13 @@ License : MIT, at end of file.
 #include "data_desk_tokenizer.c"
 #include "data_desk_custom.c"
 #include "data_desk_parse.c"
+#include "data_desk_parse_cache.c"
 #include "data_desk_graph_traverse.c"
+#include "data_desk_ast_file.c"
+#include "data_desk_stamp.c"
+#include "data_desk_watch.c"
+#include "data_desk_server.c"
+#include "data_desk_lsp.c"
 
 static void
 PrintAndResetParseContextErrors(ParseContext *context)
@@ -39,21 +58,99 @@ PrintAndResetParseContextErrors(ParseContext *context)
                 context->error_stack[i].line,
                 context->error_stack[i].string);
     }
+    context->error_count += context->error_stack_size;
     context->error_stack_size = 0;
 }
 
-static DataDeskNode *
-ParseFile(ParseContext *context, char *file, char *filename)
+static void ProcessAndSendParsedFiles(ParseContext *context, int first_parsed_file);
+
+// Returns the ID of the file at the path, parsing it if it hasn't
+// been parsed yet, or 0 if it couldn't be loaded. With --streaming, the file
+// is also sent to the custom layer and released before this returns.
+static int
+ParseFile(ParseContext *context, char *filename)
 {
-    Tokenizer tokenizer = {0};
+    int file_id = 0;
+    
+    char *canonical_path = CanonicalizePath(filename);
+    if(canonical_path)
     {
-        tokenizer.at = file;
-        tokenizer.filename = filename;
-        tokenizer.line = 1;
+        for(int i = 1; i <= context->graph.file_count; ++i)
+        {
+            if(StringMatchCaseSensitive(context->graph.files[i].canonical_path, canonical_path))
+            {
+                file_id = i;
+                break;
+            }
+        }
     }
     
-    DataDeskNode *root = ParseCode(context, &tokenizer);
-    PrintAndResetParseContextErrors(context);
+    if(file_id)
+    {
+        free(canonical_path);
+    }
+    else
+    {
+        Log("Processing file at \"%s\".", filename);
+        char *file = LoadEntireFileAndNullTerminate(filename);
+        if(file)
+        {
+            // The file is registered before it's parsed, so that
+            // import cycles stop here, rather than recursing forever.
+            file_id = ParseContextAddSourceFile(context, filename, file, CalculateCStringLength(file));
+            context->graph.files[file_id].canonical_path = canonical_path;
+            RecordFileHash(context, file_id, file, context->graph.files[file_id].contents_length);
+            
+            Tokenizer tokenizer = {0};
+            {
+                tokenizer.at = file;
+                tokenizer.filename = filename;
+                tokenizer.line = 1;
+            }
+            
+            ParseContextArena importing_arena = {0};
+            int first_node_id = context->graph.node_count;
+            if(context->streaming)
+            {
+                importing_arena = ParseContextBeginFileArena(context);
+                ParseContextResetHashCons(context);
+            }
+            
+            // Files are always parsed at the top level, even when
+            // they're imported from inside a namespace.
+            int importing_file = context->current_file;
+            int importing_scope = context->current_scope;
+            context->current_file = file_id;
+            context->current_scope = 0;
+            DataDeskNode *root = ParseFileCode(context, &tokenizer);
+            IndexGraphNodes(context, root, 0);
+            context->current_file = importing_file;
+            context->current_scope = importing_scope;
+            context->graph.files[file_id].root = root;
+            
+            if(context->parsed_file_count >= context->parsed_file_max)
+            {
+                context->parsed_file_max = context->parsed_file_max ? context->parsed_file_max * 2 : 16;
+                context->parsed_files = realloc(context->parsed_files, sizeof(int) * context->parsed_file_max);
+                Assert(context->parsed_files != 0);
+            }
+            context->parsed_files[context->parsed_file_count++] = file_id;
+            
+            PrintAndResetParseContextErrors(context);
+            
+            if(context->streaming)
+            {
+                context->error_count += ParseContextReportLateDefinitions(context, file_id);
+                ProcessAndSendParsedFiles(context, context->parsed_file_count - 1);
+                ReleaseParsedFile(context, file_id, first_node_id);
+                ParseContextEndFileArena(context, importing_arena);
+            }
+        }
+        else
+        {
+            free(canonical_path);
+        }
+    }
     
     // NOTE(rjf): ParseContextCleanUp shouldn't be called, because often time, code
     // will depend on ASTs persisting between files (which should totally work).
@@ -70,21 +167,251 @@ ParseFile(ParseContext *context, char *file, char *filename)
     // NOTE(rjf): This is a reason why non-nuanced and non-context-specific programming
     // rules suck.
     
-    return root;
+    return file_id;
+}
+
+static int
+ImportFile(ParseContext *context, Tokenizer *tokenizer, char *path, int path_length)
+{
+    DataDeskSourceFile *importing_file = context->graph.files + context->current_file;
+    
+    // Relative paths are relative to the directory of the
+    // importing file.
+    int directory_length = 0;
+    int path_is_absolute = (path_length > 0 && (path[0] == '/' || path[0] == '\\')) || (path_length > 1 && path[1] == ':');
+    if(!path_is_absolute)
+    {
+        for(int i = 0; importing_file->filename[i]; ++i)
+        {
+            if(importing_file->filename[i] == '/' || importing_file->filename[i] == '\\')
+            {
+                directory_length = i + 1;
+            }
+        }
+    }
+    
+    char *filename = ParseContextAllocatePersistentMemory(context, directory_length + path_length + 1);
+    MemoryCopy(filename, importing_file->filename, directory_length);
+    MemoryCopy(filename + directory_length, path, path_length);
+    filename[directory_length + path_length] = 0;
+    
+    ParseCacheRecordImport(context, tokenizer, path, path_length);
+    
+    int importing_file_id = context->current_file;
+    int file_id = ParseFile(context, filename);
+    if(file_id)
+    {
+        DataDeskSourceFile *file = context->graph.files + importing_file_id;
+        if(file->import_count >= file->import_max)
+        {
+            file->import_max = file->import_max ? file->import_max * 2 : 8;
+            file->imports = realloc(file->imports, sizeof(int) * file->import_max);
+            Assert(file->imports != 0);
+        }
+        file->imports[file->import_count++] = file_id;
+    }
+    else
+    {
+        ParseContextPushError(context, tokenizer, "Could not import \"%s\".", filename);
+    }
+    
+    return file_id;
 }
 
 static void
-ProcessParsedGraph(char *filename, DataDeskNode *root, ParseContext *context, DataDeskCustom custom)
+ProcessParsedGraph(char *filename, DataDeskNode *root, ParseContext *context, int lazy_symbols)
 {
-    PatchGraphSymbols(context, root);
+    if(!lazy_symbols)
+    {
+        PatchGraphSymbols(context, root, 0);
+        HashGraphNodes(context, root);
+    }
     GenerateGraphNullTerminatedStrings(context, root);
+    PrintAndResetParseContextErrors(context);
+}
+
+static void
+SendParsedGraphToCustomLayer(char *filename, DataDeskNode *root, ParseContext *context, DataDeskCustom custom)
+{
+    if(custom.FileCallback)
+    {
+        custom.FileCallback(&context->graph, filename);
+    }
     CallCustomParseCallbacks(context, root, custom, filename);
     PrintAndResetParseContextErrors(context);
 }
 
-int
-main(int argument_count, char **arguments)
+// Everything that one custom layer is given in a run, from its
+// init callback to its clean up callback, on whichever thread runs this.
+typedef struct CustomLayerRun CustomLayerRun;
+struct CustomLayerRun
+{
+    ParseContext *context;
+    DataDeskCustom custom;
+    int first_parsed_file;
+    int started;
+    Thread thread;
+};
+
+static THREAD_PROCEDURE(RunCustomLayer)
+{
+    CustomLayerRun *run = data;
+    ParseContext *context = run->context;
+    
+    if(run->custom.InitCallback)
+    {
+        run->custom.InitCallback();
+    }
+    
+    if(run->custom.GraphCallback)
+    {
+        run->custom.GraphCallback(&context->graph);
+    }
+    
+    for(int i = run->first_parsed_file; i < context->parsed_file_count; ++i)
+    {
+        DataDeskSourceFile *file = context->graph.files + context->parsed_files[i];
+        if(run->custom.FileCallback)
+        {
+            run->custom.FileCallback(&context->graph, file->filename);
+        }
+        CallCustomParseCallbacks(context, file->root, run->custom, file->filename);
+    }
+    
+    if(run->custom.CleanUpCallback)
+    {
+        run->custom.CleanUpCallback();
+    }
+    
+    return 0;
+}
+
+// This is also used to send a graph that has already been sent
+// once to the custom layers again, after one was reloaded. Parallel custom
+// layers are each run from init to clean up here, on their own threads, and
+// only read the (frozen) graph; otherwise, the init and clean up callbacks
+// are called around parsing, since --streaming sends files as they're parsed.
+static void
+SendParsedFilesToCustomLayers(ParseContext *context, int first_parsed_file)
+{
+    if(context->parallel_custom_layers)
+    {
+        CustomLayerRun *runs = calloc(context->custom_layer_count, sizeof(CustomLayerRun));
+        Assert(runs != 0);
+        for(int i = 0; i < context->custom_layer_count; ++i)
+        {
+            runs[i].context = context;
+            runs[i].custom = context->custom_layers[i];
+            runs[i].first_parsed_file = first_parsed_file;
+            runs[i].started = ThreadStart(&runs[i].thread, RunCustomLayer, runs + i);
+            if(!runs[i].started)
+            {
+                LogError("WARNING: Could not start a thread for a custom layer; running it on this one.");
+                RunCustomLayer(runs + i);
+            }
+        }
+        for(int i = 0; i < context->custom_layer_count; ++i)
+        {
+            if(runs[i].started)
+            {
+                ThreadJoin(&runs[i].thread);
+            }
+        }
+        free(runs);
+        PrintAndResetParseContextErrors(context);
+    }
+    else
+    {
+        for(int i = 0; i < context->custom_layer_count; ++i)
+        {
+            DataDeskCustom custom = context->custom_layers[i];
+            
+            // With --streaming, this is called once per file, but the graph
+            // callback is still only called once, before the first file.
+            if(custom.GraphCallback && first_parsed_file == 0)
+            {
+                custom.GraphCallback(&context->graph);
+            }
+            
+            for(int j = first_parsed_file; j < context->parsed_file_count; ++j)
+            {
+                DataDeskSourceFile *file = context->graph.files + context->parsed_files[j];
+                SendParsedGraphToCustomLayer(file->filename, file->root, context, custom);
+            }
+        }
+    }
+}
+
+// Resolves, freezes, and sends every parsed file from
+// first_parsed_file on to the custom layers. This is called once, after all
+// files are parsed, or once per file with --streaming.
+static void
+ProcessAndSendParsedFiles(ParseContext *context, int first_parsed_file)
+{
+    for(int i = first_parsed_file; i < context->parsed_file_count; ++i)
+    {
+        DataDeskSourceFile *file = context->graph.files + context->parsed_files[i];
+        ProcessParsedGraph(file->filename, file->root, context, context->lazy_symbols);
+    }
+    
+    // This has to happen before freezing, because it can
+    // resolve symbols (with --lazy-symbols).
+    if(context->roots)
+    {
+        ComputeReachableNodes(context, context->roots);
+    }
+    
+    // Everything that the custom layer is given has to be
+    // parsed in full before the graph is frozen.
+    if(context->skim)
+    {
+        for(int i = first_parsed_file; i < context->parsed_file_count; ++i)
+        {
+            DataDeskSourceFile *file = context->graph.files + context->parsed_files[i];
+            ExpandSkimmedNodes(context, file->root, 1);
+        }
+        PrintAndResetParseContextErrors(context);
+    }
+    
+    // The binary AST file gets the whole graph, not just what the
+    // custom layer is sent.
+    if(context->emit_ast_path)
+    {
+        if(context->skim)
+        {
+            for(int i = first_parsed_file; i < context->parsed_file_count; ++i)
+            {
+                DataDeskSourceFile *file = context->graph.files + context->parsed_files[i];
+                ExpandSkimmedNodes(context, file->root, 0);
+            }
+            PrintAndResetParseContextErrors(context);
+        }
+        
+        Log("Writing binary AST to \"%s\".", context->emit_ast_path);
+        if(!WriteASTFile(context, context->emit_ast_path))
+        {
+            LogError("ERROR: Could not write \"%s\".", context->emit_ast_path);
+            ++context->error_count;
+        }
+    }
+    
+    // Parallel custom layers can't be allowed to resolve symbols
+    // (or write anything else) as they go, so everything is resolved here.
+    if(!context->lazy_symbols || context->protect_frozen_memory || context->parallel_custom_layers)
+    {
+        FreezeGraph(context);
+    }
+    
+    SendParsedFilesToCustomLayers(context, first_parsed_file);
+}
+
+// Does everything for one command line. With --serve, this is
+// called for every request, and server holds what is kept between them.
+static int
+RunDataDesk(int argument_count, char **arguments, Server *server)
 {
+    int result = 0;
+    
     if(argument_count > 1)
     {
         if(StringMatchCaseInsensitive(arguments[1], "help"  ) ||
@@ -97,14 +424,63 @@ main(int argument_count, char **arguments)
            StringMatchCaseInsensitive(arguments[1], "-?"    ))
         {
             printf("Data Desk Flags\n");
-            printf("--custom    (-c)        Specify the path to a custom layer to which parsed information is to be sent.\n");
+            printf("--custom    (-c)        Specify the path to a custom layer to which parsed information is to be sent.\n"
+                   "                        Given more than once, each custom layer runs on its own thread.\n");
             printf("--log       (-l)        Enable logging.\n");
+            printf("--lazy-symbols          Only resolve symbols when the custom layer asks for them. With one custom layer,\n"
+                   "                        the graph is then written to as it is read, so it must only be read from one thread.\n");
+            printf("--share-nodes           Share structurally identical type usages and constant subexpressions. Shared\n"
+                   "                        nodes can have more than one parent, and have DATA_DESK_NODE_FLAG_shared set.\n");
+            printf("--protect-graph         Write-protect the parsed graph before it is sent to the custom layer (even with\n"
+                   "                        --lazy-symbols), so that stray writes crash where they happen.\n");
+            printf("-DNAME[=value]          Define NAME (as value, or 1) for @If(...) and @Unless(...) tags.\n");
+            printf("--roots <roots>         Only send declarations reachable from the given comma-separated tags\n"
+                   "                        (like @Export) and names (like Render.Vertex) to the custom layer's parse callback.\n");
+            printf("--skim                  Only parse the bodies of structs, unions, enums, and flags when they're needed.\n"
+                   "                        Skimmed nodes have DATA_DESK_NODE_FLAG_skimmed set, and no children until expanded.\n");
+            printf("--cache-dir <path>      Keep parsed files in the directory, and load unchanged files from there.\n");
+            printf("--watch                 Keep running, and run again whenever a file that was read changes. When only\n"
+                   "                        the custom layer changes, it's reloaded and sent the graph that was parsed.\n");
+            printf("--serve <socket path>   Stay resident, and run requests from --connect clients, keeping parsed files\n"
+                   "                        and custom layers in memory between them.\n");
+            printf("--connect <socket path> Send the rest of the command line to a --serve server, and run it there\n"
+                   "                        (or here, if there is no server).\n");
+            printf("--lsp                   Run as a language server over standard input and output, reporting errors\n"
+                   "                        and finding definitions and references in the files that an editor has open.\n");
+            printf("--stamp <path>          Write a stamp file after a successful run, and do nothing if its inputs,\n"
+                   "                        outputs, flags, and custom layers haven't changed since then.\n");
+            printf("-MD                     Write a Make-style dependency file, listing the files that were read\n"
+                   "                        and the custom layers as dependencies of the generated files.\n");
+            printf("-MF <path>              Like -MD, but write it to the given path, rather than next to the\n"
+                   "                        first generated file.\n");
+            printf("--emit-ast <path>       Write the parsed graph to a binary AST file (see \"Binary AST Files\" in data_desk.h).\n");
+            printf("--streaming             Send each file to the custom layer as soon as it's parsed, and release it\n"
+                   "                        afterwards, keeping only summaries of its declarations. A file can only\n"
+                   "                        use names from itself and the files before it (or that it imports); using\n"
+                   "                        a name that a later file defines is an error. The graph callback is only\n"
+                   "                        called for the first file; DataDeskCustomFileCallback is called for each.\n");
         }
         else
         {
-            DataDeskCustom custom = {0};
-            char *custom_layer_dll_path = 0;
-            int expected_number_of_files = 0;
+            int custom_layer_count = 0;
+            char **custom_layer_paths = malloc(sizeof(char *) * argument_count);
+            Assert(custom_layer_paths != 0);
+            int lazy_symbols = 0;
+            int hash_cons = 0;
+            int protect_graph = 0;
+            int skim = 0;
+            int streaming = 0;
+            int watch = 0;
+            char *roots = 0;
+            char *emit_ast_path = 0;
+            char *cache_dir = 0;
+            char *stamp_path = 0;
+            int write_dependency_file = 0;
+            char *dependency_file_path = 0;
+            unsigned long long arguments_hash = HashArguments(argument_count, arguments);
+            int define_count = 0;
+            char **defines = malloc(sizeof(char *) * argument_count);
+            Assert(defines != 0);
             
             // NOTE(rjf): Load command line arguments and set all non-file arguments
             // to zero, so that we know the arguments to process in the file-processing
@@ -115,6 +491,11 @@ main(int argument_count, char **arguments)
                 {
                     ARGUMENT_READ_MODE_files,
                     ARGUMENT_READ_MODE_custom_layer_dll,
+                    ARGUMENT_READ_MODE_roots,
+                    ARGUMENT_READ_MODE_emit_ast_path,
+                    ARGUMENT_READ_MODE_cache_dir,
+                    ARGUMENT_READ_MODE_stamp_path,
+                    ARGUMENT_READ_MODE_dependency_file_path,
                 };
                 
                 for(int i = 1; i < argument_count; ++i)
@@ -133,14 +514,106 @@ main(int argument_count, char **arguments)
                             global_log_enabled = 1;
                             arguments[i] = 0;
                         }
-                        else
+                        else if(StringMatchCaseInsensitive(arguments[i], "--lazy-symbols"))
+                        {
+                            lazy_symbols = 1;
+                            arguments[i] = 0;
+                        }
+                        else if(StringMatchCaseInsensitive(arguments[i], "--share-nodes"))
                         {
-                            ++expected_number_of_files;
+                            hash_cons = 1;
+                            arguments[i] = 0;
+                        }
+                        else if(StringMatchCaseInsensitive(arguments[i], "--protect-graph"))
+                        {
+                            protect_graph = 1;
+                            arguments[i] = 0;
+                        }
+                        else if(StringMatchCaseInsensitive(arguments[i], "--skim"))
+                        {
+                            skim = 1;
+                            arguments[i] = 0;
+                        }
+                        else if(StringMatchCaseInsensitive(arguments[i], "--streaming"))
+                        {
+                            streaming = 1;
+                            arguments[i] = 0;
+                        }
+                        else if(StringMatchCaseInsensitive(arguments[i], "--cache-dir"))
+                        {
+                            argument_read_mode = ARGUMENT_READ_MODE_cache_dir;
+                            arguments[i] = 0;
+                        }
+                        else if(StringMatchCaseInsensitive(arguments[i], "--watch"))
+                        {
+                            watch = 1;
+                            arguments[i] = 0;
+                        }
+                        else if(StringMatchCaseInsensitive(arguments[i], "--stamp"))
+                        {
+                            argument_read_mode = ARGUMENT_READ_MODE_stamp_path;
+                            arguments[i] = 0;
+                        }
+                        else if(StringMatchCaseInsensitive(arguments[i], "-MD"))
+                        {
+                            write_dependency_file = 1;
+                            arguments[i] = 0;
+                        }
+                        else if(StringMatchCaseInsensitive(arguments[i], "-MF"))
+                        {
+                            write_dependency_file = 1;
+                            argument_read_mode = ARGUMENT_READ_MODE_dependency_file_path;
+                            arguments[i] = 0;
+                        }
+                        else if(StringMatchCaseInsensitive(arguments[i], "--emit-ast"))
+                        {
+                            argument_read_mode = ARGUMENT_READ_MODE_emit_ast_path;
+                            arguments[i] = 0;
+                        }
+                        else if(StringMatchCaseInsensitive(arguments[i], "--roots"))
+                        {
+                            argument_read_mode = ARGUMENT_READ_MODE_roots;
+                            arguments[i] = 0;
+                        }
+                        else if(arguments[i][0] == '-' && arguments[i][1] == 'D' && arguments[i][2])
+                        {
+                            defines[define_count++] = arguments[i] + 2;
+                            arguments[i] = 0;
                         }
                     }
                     else if(argument_read_mode == ARGUMENT_READ_MODE_custom_layer_dll)
                     {
-                        custom_layer_dll_path = arguments[i];
+                        custom_layer_paths[custom_layer_count++] = arguments[i];
+                        arguments[i] = 0;
+                        argument_read_mode = ARGUMENT_READ_MODE_files;
+                    }
+                    else if(argument_read_mode == ARGUMENT_READ_MODE_roots)
+                    {
+                        roots = arguments[i];
+                        arguments[i] = 0;
+                        argument_read_mode = ARGUMENT_READ_MODE_files;
+                    }
+                    else if(argument_read_mode == ARGUMENT_READ_MODE_emit_ast_path)
+                    {
+                        emit_ast_path = arguments[i];
+                        arguments[i] = 0;
+                        argument_read_mode = ARGUMENT_READ_MODE_files;
+                    }
+                    else if(argument_read_mode == ARGUMENT_READ_MODE_cache_dir)
+                    {
+                        cache_dir = arguments[i];
+                        arguments[i] = 0;
+                        argument_read_mode = ARGUMENT_READ_MODE_files;
+                    }
+                    else if(argument_read_mode == ARGUMENT_READ_MODE_stamp_path)
+                    {
+                        stamp_path = arguments[i];
+                        arguments[i] = 0;
+                        argument_read_mode = ARGUMENT_READ_MODE_files;
+                    }
+                    else if(argument_read_mode == ARGUMENT_READ_MODE_dependency_file_path)
+                    {
+                        dependency_file_path = arguments[i];
                         arguments[i] = 0;
                         argument_read_mode = ARGUMENT_READ_MODE_files;
                     }
@@ -149,75 +622,405 @@ main(int argument_count, char **arguments)
             
             Log("Data Desk v" DATA_DESK_VERSION_STRING);
             
-            // NOTE(rjf): Load custom code DLL if needed.
-            if(custom_layer_dll_path)
-            {
-                Log("Loading custom layer from \"%s\".", custom_layer_dll_path);
-                custom = DataDeskCustomLoad(custom_layer_dll_path);
-            }
-            else
-            {
-                LogError("WARNING: No custom layer loaded.");
-            }
-            
-            if(custom.InitCallback)
+            unsigned long long stamp_key = 0;
+            int up_to_date = 0;
+            if(stamp_path)
             {
-                custom.InitCallback();
+                stamp_key = ComputeStampKey(arguments_hash, custom_layer_paths, custom_layer_count);
+                up_to_date = !watch && StampFileIsCurrent(stamp_path, stamp_key);
             }
             
-            ParseContext parse_context = {0};
-            
-            int number_of_parsed_files = 0;
-            struct
+            if(up_to_date)
             {
-                DataDeskNode *root;
-                char *filename;
+                Log("Nothing has changed since \"%s\" was written.", stamp_path);
             }
-            *parsed_files = ParseContextAllocateMemory(&parse_context, sizeof(*parsed_files) * expected_number_of_files);
-            
-            Assert(parsed_files != 0);
-            
-            for(int i = 1; i < argument_count; ++i)
+            else
             {
-                if(arguments[i] != 0)
+                if(cache_dir && !MakeDirectory(cache_dir))
+                {
+                    LogError("WARNING: Could not create the cache directory \"%s\"; parsing without a cache.", cache_dir);
+                    cache_dir = 0;
+                }
+                
+                // With --streaming, there is never a whole graph to write.
+                if(emit_ast_path && streaming)
+                {
+                    LogError("ERROR: --emit-ast can't be used with --streaming.");
+                    emit_ast_path = 0;
+                }
+                
+                ParseCacheMemory memory_cache = {0};
+                Watcher watcher = {0};
+                if(watch && server)
                 {
-                    char *filename = arguments[i];
-                    Log("Processing file at \"%s\".", filename);
-                    char *file = LoadEntireFileAndNullTerminate(filename);
-                    if(file)
+                    LogError("WARNING: --watch can't be used in a request to a server.");
+                    watch = 0;
+                }
+                else if(watch && !WatcherInit(&watcher))
+                {
+                    LogError("WARNING: Could not watch files for changes; running once.");
+                    watch = 0;
+                }
+                
+                // A custom layer that was given twice would be loaded
+                // once, and run twice with the same state (maybe at the same time),
+                // so it's only run once.
+                for(int i = 0; i < custom_layer_count; ++i)
+                {
+                    char *path = CanonicalizePath(custom_layer_paths[i]);
+                    int duplicate = 0;
+                    for(int j = 0; j < i && !duplicate; ++j)
                     {
-                        DataDeskNode *root = ParseFile(&parse_context, file, filename);
-                        parsed_files[number_of_parsed_files].root = root;
-                        parsed_files[number_of_parsed_files].filename = filename;
-                        ++number_of_parsed_files;
+                        char *other_path = CanonicalizePath(custom_layer_paths[j]);
+                        duplicate = (path && other_path ? !strcmp(path, other_path) :
+                                     !strcmp(custom_layer_paths[i], custom_layer_paths[j]));
+                        free(other_path);
+                    }
+                    free(path);
+                    
+                    if(duplicate)
+                    {
+                        LogError("WARNING: The custom layer \"%s\" was given more than once; running it once.", custom_layer_paths[i]);
+                        memmove(custom_layer_paths + i, custom_layer_paths + i + 1, sizeof(char *) * (custom_layer_count - i - 1));
+                        --custom_layer_count;
+                        --i;
+                    }
+                }
+                
+                // Load custom code DLLs if needed. With --watch, copies
+                // are loaded, so that custom layers can be rebuilt and reloaded.
+                // A server keeps custom layers loaded itself.
+                DataDeskCustom *custom_layers = calloc(custom_layer_count + 1, sizeof(DataDeskCustom));
+                Assert(custom_layers != 0);
+                for(int i = 0; i < custom_layer_count; ++i)
+                {
+                    Log("Loading custom layer from \"%s\".", custom_layer_paths[i]);
+                    custom_layers[i] = server ? ServerLoadCustomLayer(server, custom_layer_paths[i]) : DataDeskCustomLoad(custom_layer_paths[i], watch);
+                }
+                if(!custom_layer_count)
+                {
+                    LogError("WARNING: No custom layer loaded.");
+                }
+                
+                OutputFileList outputs = {0};
+                OutputFileList *custom_layer_outputs = calloc(custom_layer_count + 1, sizeof(OutputFileList));
+                DataDeskServices *custom_layer_services = calloc(custom_layer_count + 1, sizeof(DataDeskServices));
+                Assert(custom_layer_outputs != 0 && custom_layer_services != 0);
+                for(int i = 0; i < custom_layer_count; ++i)
+                {
+                    custom_layer_services[i].data = custom_layer_outputs + i;
+                    custom_layer_services[i].AddOutputFile = AddOutputFile;
+                    if(custom_layers[i].ServicesCallback)
+                    {
+                        custom_layers[i].ServicesCallback(custom_layer_services + i);
+                    }
+                }
+                
+                // With --watch, everything is done again for every run,
+                // except when only custom layers have changed. Then, they're
+                // reloaded, and the graph from the last run is sent to the custom
+                // layers again (which needs that graph to be kept until the next
+                // change, and isn't possible with --streaming).
+                ParseContext parse_context = {0};
+                int keep_graph = watch && custom_layer_count && !streaming;
+                int graph_kept = 0;
+                int parallel_custom_layers = custom_layer_count > 1 && !streaming;
+                for(int run = 1; run;)
+                {
+                    WatcherClearFiles(&watcher);
+                    
+                    for(int i = 0; i < custom_layer_count && !parallel_custom_layers; ++i)
+                    {
+                        if(custom_layers[i].InitCallback)
+                        {
+                            custom_layers[i].InitCallback();
+                        }
+                    }
+                    
+                    if(graph_kept)
+                    {
+                        Log("Sending the last run's %i files to the custom layers again.", parse_context.parsed_file_count);
+                        SendParsedFilesToCustomLayers(&parse_context, 0);
                     }
                     else
                     {
-                        LogError("ERROR: Could not load \"%s\".", filename);
+                        MemorySet(&parse_context, 0, sizeof(parse_context));
+                        ParseContextInit(&parse_context);
+                        parse_context.hash_cons = hash_cons;
+                        parse_context.protect_frozen_memory = protect_graph;
+                        parse_context.skim = skim;
+                        parse_context.streaming = streaming;
+                        parse_context.lazy_symbols = lazy_symbols;
+                        parse_context.roots = roots;
+                        parse_context.emit_ast_path = emit_ast_path;
+                        parse_context.cache_dir = cache_dir;
+                        parse_context.stamp_path = stamp_path;
+                        parse_context.watch = watch;
+                        parse_context.memory_cache = server ? &server->memory_cache : watch ? &memory_cache : 0;
+                        parse_context.custom_layer_count = custom_layer_count;
+                        parse_context.custom_layers = custom_layers;
+                        parse_context.parallel_custom_layers = parallel_custom_layers;
+                        for(int i = 0; i < define_count; ++i)
+                        {
+                            ParseContextAddDefine(&parse_context, defines[i]);
+                        }
+                        
+                        for(int i = 1; i < argument_count; ++i)
+                        {
+                            if(arguments[i] != 0)
+                            {
+                                char *filename = arguments[i];
+                                if(!ParseFile(&parse_context, filename))
+                                {
+                                    LogError("ERROR: Could not load \"%s\".", filename);
+                                    ++parse_context.error_count;
+                                    if(watch)
+                                    {
+                                        WatcherAddFile(&watcher, filename, 0, 0);
+                                    }
+                                }
+                            }
+                        }
+                        
+                        if(!streaming)
+                        {
+                            ProcessAndSendParsedFiles(&parse_context, 0);
+                        }
+                        WarnAboutUnmatchedRoots(&parse_context);
+                    }
+                    
+                    for(int i = 0; i < custom_layer_count; ++i)
+                    {
+                        if(custom_layers[i].CleanUpCallback && !parallel_custom_layers)
+                        {
+                            custom_layers[i].CleanUpCallback();
+                        }
+                        MoveOutputFiles(&outputs, custom_layer_outputs + i);
                     }
+                    
+                    // A run with errors never leaves a stamp or dependency
+                    // file behind, so the next run reports them again.
+                    if(stamp_path)
+                    {
+                        if(parse_context.error_count)
+                        {
+                            remove(stamp_path);
+                        }
+                        else if(!WriteStampFile(stamp_path, stamp_key, &parse_context, &outputs))
+                        {
+                            LogError("ERROR: Could not write \"%s\".", stamp_path);
+                            remove(stamp_path);
+                            result = 1;
+                        }
+                    }
+                    
+                    if(write_dependency_file)
+                    {
+                        char *path = dependency_file_path ? dependency_file_path : GetDefaultDependencyFilePath(&outputs);
+                        if(parse_context.error_count)
+                        {
+                            remove(path);
+                        }
+                        else if(!WriteDependencyFile(path, &parse_context, &outputs, custom_layer_paths, custom_layer_count))
+                        {
+                            LogError("ERROR: Could not write \"%s\".", path);
+                            result = 1;
+                        }
+                        if(path != dependency_file_path)
+                        {
+                            free(path);
+                        }
+                    }
+                    
+                    run = 0;
+                    if(watch)
+                    {
+                        for(int i = 1; i <= parse_context.graph.file_count; ++i)
+                        {
+                            WatcherAddFile(&watcher, parse_context.graph.files[i].filename, 1, parse_context.file_hashes[i]);
+                        }
+                        int first_custom_layer_file = watcher.file_count;
+                        for(int i = 0; i < custom_layer_count; ++i)
+                        {
+                            WatcherAddFile(&watcher, custom_layer_paths[i], custom_layers[i].file_exists, custom_layers[i].file_hash);
+                        }
+                        
+                        if(!graph_kept)
+                        {
+                            ParseCacheMemoryDropUnused(&memory_cache);
+                        }
+                        graph_kept = keep_graph;
+                        if(!graph_kept)
+                        {
+                            ParseContextCleanUp(&parse_context);
+                        }
+                        FreeOutputFileList(&outputs);
+                        
+                        Log("Watching %i files for changes.", watcher.file_count);
+                        run = WatcherWaitForChanges(&watcher);
+                        
+                        for(int i = 0; run && i < watcher.file_count; ++i)
+                        {
+                            if(watcher.files[i].changed)
+                            {
+                                if(i >= first_custom_layer_file)
+                                {
+                                    int layer = i - first_custom_layer_file;
+                                    Log("Reloading custom layer from \"%s\".", custom_layer_paths[layer]);
+                                    DataDeskCustomUnload(custom_layers + layer);
+                                    custom_layers[layer] = DataDeskCustomLoad(custom_layer_paths[layer], 1);
+                                    if(custom_layers[layer].ServicesCallback)
+                                    {
+                                        custom_layers[layer].ServicesCallback(custom_layer_services + layer);
+                                    }
+                                    if(stamp_path)
+                                    {
+                                        stamp_key = ComputeStampKey(arguments_hash, custom_layer_paths, custom_layer_count);
+                                    }
+                                }
+                                else if(graph_kept)
+                                {
+                                    ParseContextCleanUp(&parse_context);
+                                    graph_kept = 0;
+                                }
+                            }
+                        }
+                    }
+                }
+                
+                // A run that exits right after this leaves the graph to
+                // the OS, but a server has to free it.
+                if(graph_kept || server)
+                {
+                    ParseContextCleanUp(&parse_context);
+                }
+                for(int i = 0; i < custom_layer_count && !server; ++i)
+                {
+                    DataDeskCustomUnload(custom_layers + i);
                 }
+                free(custom_layers);
+                free(custom_layer_services);
+                free(custom_layer_outputs);
+                if(watch)
+                {
+                    WatcherCleanUp(&watcher);
+                }
+                ParseCacheMemoryFree(&memory_cache);
+                FreeOutputFileList(&outputs);
             }
             
-            for(int i = 0; i < number_of_parsed_files; ++i)
+            free(defines);
+            free(custom_layer_paths);
+        }
+    }
+    else
+    {
+        LogError("USAGE: %s [-c|--custom <path to custom layer DLL>] [-l|--log] [--lazy-symbols] [--share-nodes] [--protect-graph] [--roots <roots>] [--skim] [--streaming] [--emit-ast <path>] [--cache-dir <path>] [--watch] [--serve <socket path>] [--connect <socket path>] [--lsp] [--stamp <path>] [-MD] [-MF <path>] [-DNAME[=value]] <files to process>",
+                 arguments[0]);
+    }
+    
+    return result;
+}
+
+static int
+Serve(char *socket_path)
+{
+    int result = 1;
+    Server server = {0};
+    if(ServerOpen(&server, socket_path))
+    {
+        Log("Serving requests at \"%s\".", socket_path);
+        int log_enabled = global_log_enabled;
+        ServerRequest request = {0};
+        while(ServerAcceptRequest(&server, &request))
+        {
+            int exit_code = 1;
+            if(ServerBeginRequest(&server, &request))
             {
-                ProcessParsedGraph(parsed_files[i].filename, parsed_files[i].root, &parse_context, custom);
+                global_log_enabled = 0;
+                exit_code = RunDataDesk(request.argument_count, request.arguments, &server);
+                global_log_enabled = log_enabled;
             }
-            
-            if(custom.CleanUpCallback)
+            ServerEndRequest(&server, &request, exit_code);
+        }
+        ServerClose(&server);
+    }
+    return result;
+}
+
+int
+main(int argument_count, char **arguments)
+{
+    int result = 0;
+    
+    // --serve, --connect, and --lsp decide where everything else is
+    // run, so they're looked for first (and taken out of the arguments).
+    char *serve_socket_path = 0;
+    char *connect_socket_path = 0;
+    int language_server = 0;
+    int run_argument_count = 0;
+    char **run_arguments = malloc(sizeof(char *) * (argument_count + 1));
+    Assert(run_arguments != 0);
+    for(int i = 0; i < argument_count; ++i)
+    {
+        if(i > 0 && i + 1 < argument_count && StringMatchCaseInsensitive(arguments[i], "--serve"))
+        {
+            serve_socket_path = arguments[++i];
+        }
+        else if(i > 0 && i + 1 < argument_count && StringMatchCaseInsensitive(arguments[i], "--connect"))
+        {
+            connect_socket_path = arguments[++i];
+        }
+        else if(i > 0 && StringMatchCaseInsensitive(arguments[i], "--lsp"))
+        {
+            language_server = 1;
+        }
+        else
+        {
+            run_arguments[run_argument_count++] = arguments[i];
+        }
+    }
+    run_arguments[run_argument_count] = 0;
+    
+    for(int i = 1; i < run_argument_count; ++i)
+    {
+        if(StringMatchCaseInsensitive(run_arguments[i], "-l") ||
+           StringMatchCaseInsensitive(run_arguments[i], "--log"))
+        {
+            global_log_enabled = 1;
+        }
+    }
+    
+    if(language_server)
+    {
+        int define_count = 0;
+        char **defines = malloc(sizeof(char *) * argument_count);
+        Assert(defines != 0);
+        for(int i = 1; i < run_argument_count; ++i)
+        {
+            if(run_arguments[i][0] == '-' && run_arguments[i][1] == 'D' && run_arguments[i][2])
             {
-                custom.CleanUpCallback();
+                defines[define_count++] = run_arguments[i] + 2;
             }
-            
-            DataDeskCustomUnload(&custom);
         }
+        result = RunLanguageServer(define_count, defines);
+        free(defines);
     }
-    else
+    else if(serve_socket_path)
     {
-        LogError("USAGE: %s [-c|--custom <path to custom layer DLL>] [-l|--log] <files to process>",
-                 arguments[0]);
+        result = Serve(serve_socket_path);
+    }
+    else if(!connect_socket_path || !ClientSendRequest(connect_socket_path, run_argument_count, run_arguments, &result))
+    {
+        if(connect_socket_path)
+        {
+            Log("No server is listening at \"%s\"; running here.", connect_socket_path);
+        }
+        result = RunDataDesk(run_argument_count, run_arguments, 0);
     }
     
-    return 0;
+    free(run_arguments);
+    return result;
 }
 
 /*
@@ -20,6 +20,8 @@ struct ParseContextMemoryBlock
     char *memory;
     int memory_size;
     int memory_alloc_position;
+    int page_allocated;
+    int frozen;
     ParseContextMemoryBlock *next;
 };
 
@@ -36,33 +38,264 @@ struct ParseContextSymbolTableValue
     DataDeskNode *root;
 };
 
+typedef struct ParseContextSymbolTable ParseContextSymbolTable;
+struct ParseContextSymbolTable
+{
+    unsigned int max;
+    unsigned int count;
+    ParseContextSymbolTableKey *keys;
+    ParseContextSymbolTableValue *values;
+};
+
+// Scope 0 is the top level; every namespace has its own scope.
+typedef struct ParseContextScope ParseContextScope;
+struct ParseContextScope
+{
+    int parent;
+    DataDeskNode *node;
+    ParseContextSymbolTable symbols;
+    
+    // Results of lookups made from this scope after parsing that
+    // had to look past it (qualified names, and names that are found in an
+    // outer scope or not at all), keyed by the name as it was written.
+    ParseContextSymbolTable lookup_cache;
+    
+    // With --streaming, names that couldn't be resolved from this
+    // scope (with a root of 0; see ParseContextUnresolvedSymbol).
+    ParseContextSymbolTable unresolved;
+};
+
+// With --streaming, a name that a file used but that nothing
+// defined yet. A file that's parsed later and defines it is an error,
+// because the file that used it has already been sent without it.
+typedef struct ParseContextUnresolvedSymbol ParseContextUnresolvedSymbol;
+struct ParseContextUnresolvedSymbol
+{
+    int scope;
+    int file;
+    int reported;
+    char *key;
+    int key_length;
+};
+
+// Where to find the body of a node skimmed with --skim.
+typedef struct ParseContextSkimmedBody ParseContextSkimmedBody;
+struct ParseContextSkimmedBody
+{
+    char *body;
+    int line;
+    int file;
+    int scope;
+};
+
+// What --cache-dir needs to know about the file being parsed, so
+// that loading it from the cache can do what parsing it did (see
+// data_desk_parse_cache.c).
+typedef struct ParseCacheImport ParseCacheImport;
+struct ParseCacheImport
+{
+    int declaration_count;
+    int line;
+    char *path;
+    int path_length;
+};
+
+typedef struct ParseCacheRecorder ParseCacheRecorder;
+struct ParseCacheRecorder
+{
+    // Nodes added to the file's top-level and namespace lists so
+    // far, which is where each @Import happened.
+    int declaration_count;
+    int import_count;
+    int import_max;
+    ParseCacheImport *imports;
+    
+    // Set if an @If/@Unless condition looked up a constant, which
+    // could come from another file, so the result of parsing this file
+    // doesn't only depend on its contents.
+    int uses_constants;
+    int had_errors;
+};
+
+typedef struct ParseCacheMemory ParseCacheMemory;
+typedef struct ParseCacheMemoryEntry ParseCacheMemoryEntry;
+
+typedef struct ParseContextArena ParseContextArena;
+struct ParseContextArena
+{
+    ParseContextMemoryBlock *first_block;
+    ParseContextMemoryBlock *active_block;
+};
+
 #define PARSE_CONTEXT_MEMORY_BLOCK_SIZE_DEFAULT 4096
+
+// Strings and nodes share blocks, so every allocation is rounded up
+// to this, which is enough for anything the graph holds.
+#define PARSE_CONTEXT_MEMORY_ALIGNMENT 16
+#define PARSE_CONTEXT_MEMORY_ALIGN(size) (((size) + PARSE_CONTEXT_MEMORY_ALIGNMENT - 1) & ~(PARSE_CONTEXT_MEMORY_ALIGNMENT - 1))
 typedef struct ParseContext ParseContext;
 struct ParseContext
 {
     ParseContextMemoryBlock *first_block;
     ParseContextMemoryBlock *active_block;
+    
+    // With --streaming, every file is parsed into an arena of its
+    // own, which is released once the file has been sent to the custom layer.
+    // While a file's arena is active, the arena holding everything that has to
+    // outlive it (interned strings and symbol summaries) is parked here.
+    int streaming;
+    int file_arena_depth;
+    ParseContextArena persistent_arena;
+    
     int error_stack_size;
     int error_stack_max;
     ParseError *error_stack;
+    
+    // Errors reported so far, in total.
+    int error_count;
+    
     DataDeskNode *tag_stack_head;
-    unsigned int symbol_table_max;
-    unsigned int symbol_table_count;
-    ParseContextSymbolTableKey *symbol_table_keys;
-    ParseContextSymbolTableValue *symbol_table_values;
+    int scope_count;
+    int scope_max;
+    ParseContextScope *scopes;
+    int current_scope;
+    
+    // Non-zero while parsing the body of a namespace that was left
+    // out with @If/@Unless, so that nothing in it is added to a scope.
+    int exclude_depth;
+    
+    // Indexed by node ID; only allocated with --skim.
+    int skim;
+    int skimmed_body_max;
+    ParseContextSkimmedBody *skimmed_bodies;
+    
+    DataDeskGraph graph;
+    int protect_frozen_memory;
+    int lazy_symbols;
+    char *roots;
+    char *emit_ast_path;
+    char *cache_dir;
+    ParseCacheRecorder *parse_cache_recorder;
+    ParseCacheMemory *memory_cache;
+    char *stamp_path;
+    int watch;
+    int current_file;
+    
+    // With more than one custom layer (and without --streaming),
+    // each one is run on its own thread, once the graph has been frozen.
+    int custom_layer_count;
+    DataDeskCustom *custom_layers;
+    int parallel_custom_layers;
+    
+    // Indexed by file ID; only filled out with --stamp or --watch.
+    int file_hash_max;
+    unsigned long long *file_hashes;
+    
+    // File IDs, in the order that the files finished parsing.
+    int parsed_file_count;
+    int parsed_file_max;
+    int *parsed_files;
+    
+    // Indexed by node ID; only allocated with --roots.
+    unsigned char *reachable_nodes;
+    
+    // One for each of the --roots, set once it has matched
+    // something (in any file, with --streaming).
+    int root_count;
+    unsigned char *matched_roots;
+    
+    // -DNAME=value definitions, used by @If and @Unless.
+    int define_count;
+    int define_max;
+    char **define_names;
+    int *define_name_lengths;
+    int *define_values;
+    
+    int hash_cons;
+    unsigned int hash_cons_table_max;
+    unsigned int hash_cons_count;
+    unsigned long long *hash_cons_keys;
+    DataDeskNode **hash_cons_nodes;
+    int *hash_cons_scopes;
+    
+    int unresolved_symbol_count;
+    int unresolved_symbol_max;
+    ParseContextUnresolvedSymbol *unresolved_symbols;
 };
 
 static void
-ParseContextCleanUp(ParseContext *context)
+ParseContextFreeBlocks(ParseContextMemoryBlock *first_block)
 {
-    for(ParseContextMemoryBlock *block = context->first_block; block;)
+    for(ParseContextMemoryBlock *block = first_block; block;)
     {
         ParseContextMemoryBlock *next = block->next;
+        if(block->page_allocated)
+        {
+            FreePages(block->memory, block->memory_size);
+        }
         free(block);
         block = next;
     }
 }
 
+static void
+ParseContextCleanUp(ParseContext *context)
+{
+    ParseContextFreeBlocks(context->first_block);
+    free(context->error_stack);
+    free(context->file_hashes);
+    
+    for(int i = 1; i <= context->graph.tags.count; ++i)
+    {
+        free(context->graph.tag_infos[i].nodes);
+    }
+    free(context->graph.tag_infos);
+    free(context->graph.tags.strings);
+    free(context->graph.tags.string_lengths);
+    free(context->graph.tags.slots);
+    free(context->graph.atoms.strings);
+    free(context->graph.atoms.string_lengths);
+    free(context->graph.atoms.slots);
+    for(int i = 1; i <= context->graph.file_count; ++i)
+    {
+        free(context->graph.files[i].contents);
+        free(context->graph.files[i].line_offsets);
+        free(context->graph.files[i].canonical_path);
+        free(context->graph.files[i].imports);
+    }
+    free(context->parsed_files);
+    free(context->graph.files);
+    free(context->graph.node_locations);
+    free(context->reachable_nodes);
+    free(context->matched_roots);
+    free(context->define_names);
+    free(context->define_name_lengths);
+    free(context->define_values);
+    free(context->hash_cons_keys);
+    free(context->hash_cons_nodes);
+    free(context->hash_cons_scopes);
+    for(int i = 0; i < context->scope_count; ++i)
+    {
+        free(context->scopes[i].symbols.keys);
+        free(context->scopes[i].symbols.values);
+        free(context->scopes[i].lookup_cache.keys);
+        free(context->scopes[i].lookup_cache.values);
+        free(context->scopes[i].unresolved.keys);
+        free(context->scopes[i].unresolved.values);
+    }
+    for(int i = 0; i < context->unresolved_symbol_count; ++i)
+    {
+        free(context->unresolved_symbols[i].key);
+    }
+    free(context->unresolved_symbols);
+    free(context->scopes);
+    free(context->skimmed_bodies);
+    for(int i = 0; i < DATA_DESK_NODE_TYPE_MAX; ++i)
+    {
+        free(context->graph.type_nodes[i]);
+    }
+}
+
 static unsigned int global_crc32_table[] =
 {
     0x00000000, 0x04c11db7, 0x09823b6e, 0x0d4326d9,
@@ -142,223 +375,1013 @@ ParseContextSymbolTableHash(char *key, int length)
     return crc;
 }
 
+// Returns the slot that holds the key, or the empty slot that it
+// would go in. There always is one, because tables are never allowed to get
+// more than 75% full.
+static unsigned int
+ParseContextSymbolTableFindSlot(ParseContextSymbolTable *table, char *key, int key_length)
+{
+    unsigned int slot = ParseContextSymbolTableHash(key, key_length) % table->max;
+    while(table->keys[slot].key &&
+          !(table->keys[slot].key_length == key_length &&
+            StringMatchCaseSensitiveN(table->keys[slot].key, key, key_length)))
+    {
+        if(++slot >= table->max)
+        {
+            slot = 0;
+        }
+    }
+    return slot;
+}
+
+// found is set to whether the key is in the table at all, because
+// lookup caches also store misses (with a root of 0).
+static DataDeskNode *
+ParseContextSymbolTableLookUp(ParseContextSymbolTable *table, char *key, int key_length, int *found)
+{
+    DataDeskNode *root = 0;
+    int key_found = 0;
+    if(table->max)
+    {
+        unsigned int slot = ParseContextSymbolTableFindSlot(table, key, key_length);
+        if(table->keys[slot].key)
+        {
+            root = table->values[slot].root;
+            key_found = 1;
+        }
+    }
+    if(found)
+    {
+        *found = key_found;
+    }
+    return root;
+}
+
+// Returns 0 if the key was already in the table (in which case it's
+// left alone), or 1 if it was added.
+static int
+ParseContextSymbolTableInsert(ParseContextSymbolTable *table, char *key, int key_length, DataDeskNode *root)
+{
+    // Reallocate the table if necessary (if the count we have is
+    // 75%+ of its allocated size). Most scopes only ever hold a handful of
+    // names, so tables start small (so that they stay in cache), and grow
+    // by a factor of 1.5x (exponentially).
+    if(table->count >= (table->max * 3) / 4)
+    {
+        ParseContextSymbolTable new_table = {0};
+        new_table.max = table->max ? (table->max * 3) / 2 : 16;
+        new_table.keys = calloc(sizeof(ParseContextSymbolTableKey), new_table.max);
+        new_table.values = calloc(sizeof(ParseContextSymbolTableValue), new_table.max);
+        Assert(new_table.keys != 0 && new_table.values != 0);
+        
+        // NOTE(rjf): Re-hash all current keys to the new table memory.
+        for(unsigned int i = 0; i < table->max; ++i)
+        {
+            if(table->keys[i].key)
+            {
+                unsigned int slot = ParseContextSymbolTableFindSlot(&new_table, table->keys[i].key, table->keys[i].key_length);
+                new_table.keys[slot] = table->keys[i];
+                new_table.values[slot] = table->values[i];
+            }
+        }
+        new_table.count = table->count;
+        
+        free(table->keys);
+        free(table->values);
+        *table = new_table;
+    }
+    
+    int added = 0;
+    unsigned int slot = ParseContextSymbolTableFindSlot(table, key, key_length);
+    if(!table->keys[slot].key)
+    {
+        table->keys[slot].key = key;
+        table->keys[slot].key_length = key_length;
+        table->values[slot].root = root;
+        ++table->count;
+        added = 1;
+    }
+    return added;
+}
+
+static int
+ParseContextAddScope(ParseContext *context, int parent, DataDeskNode *node)
+{
+    if(context->scope_count >= context->scope_max)
+    {
+        context->scope_max = context->scope_max ? context->scope_max * 2 : 16;
+        context->scopes = realloc(context->scopes, sizeof(ParseContextScope) * context->scope_max);
+        Assert(context->scopes != 0);
+    }
+    ParseContextScope *scope = context->scopes + context->scope_count;
+    MemorySet(scope, 0, sizeof(*scope));
+    scope->parent = parent;
+    scope->node = node;
+    return context->scope_count++;
+}
+
+// The first part of a (possibly qualified) name is looked up in
+// the passed scope and then the ones around it; every later part is looked up
+// in the namespace that the part before it names.
+static DataDeskNode *
+ParseContextLookUpSymbolFromScope(ParseContext *context, int scope, char *key, int key_length)
+{
+    int part_length = 0;
+    while(part_length < key_length && key[part_length] != '.')
+    {
+        ++part_length;
+    }
+    
+    DataDeskNode *symbol_value = 0;
+    for(;;)
+    {
+        symbol_value = ParseContextSymbolTableLookUp(&context->scopes[scope].symbols, key, part_length, 0);
+        if(symbol_value || scope == 0)
+        {
+            break;
+        }
+        scope = context->scopes[scope].parent;
+    }
+    
+    for(int i = part_length; symbol_value && i < key_length;)
+    {
+        char *part = key + (++i);
+        for(part_length = 0; i < key_length && key[i] != '.'; ++i, ++part_length);
+        
+        if(symbol_value->type == DATA_DESK_NODE_TYPE_namespace_declaration)
+        {
+            ParseContextScope *namespace_scope = context->scopes + symbol_value->namespace_declaration.scope;
+            symbol_value = ParseContextSymbolTableLookUp(&namespace_scope->symbols, part, part_length, 0);
+        }
+        else
+        {
+            symbol_value = 0;
+        }
+    }
+    
+    return symbol_value;
+}
+
+// Used while parsing, from the scope being parsed.
 static DataDeskNode *
 ParseContextLookUpSymbol(ParseContext *context, char *key, int key_length)
+{
+    return ParseContextLookUpSymbolFromScope(context, context->current_scope, key, key_length);
+}
+
+// With --streaming, the file being sent is always the last one
+// that finished parsing.
+static void
+ParseContextRecordUnresolvedSymbol(ParseContext *context, int scope, char *key, int key_length)
+{
+    ParseContextScope *scope_info = context->scopes + scope;
+    int found = 0;
+    ParseContextSymbolTableLookUp(&scope_info->unresolved, key, key_length, &found);
+    if(!found && context->parsed_file_count)
+    {
+        if(context->unresolved_symbol_count >= context->unresolved_symbol_max)
+        {
+            context->unresolved_symbol_max = context->unresolved_symbol_max ? context->unresolved_symbol_max * 2 : 16;
+            context->unresolved_symbols = realloc(context->unresolved_symbols, sizeof(ParseContextUnresolvedSymbol) * context->unresolved_symbol_max);
+            Assert(context->unresolved_symbols != 0);
+        }
+        ParseContextUnresolvedSymbol *symbol = context->unresolved_symbols + context->unresolved_symbol_count++;
+        symbol->scope = scope;
+        symbol->file = context->parsed_files[context->parsed_file_count - 1];
+        symbol->reported = 0;
+        symbol->key = malloc(key_length + 1);
+        Assert(symbol->key != 0);
+        MemoryCopy(symbol->key, key, key_length);
+        symbol->key[key_length] = 0;
+        symbol->key_length = key_length;
+        ParseContextSymbolTableInsert(&scope_info->unresolved, symbol->key, key_length, 0);
+    }
+}
+
+// Used once parsing is done (so that every symbol is known, and
+// misses can be cached too).
+static DataDeskNode *
+ParseContextResolveSymbol(ParseContext *context, int scope, char *key, int key_length)
 {
     DataDeskNode *symbol_value = 0;
+    
+    int qualified = 0;
+    for(int i = 0; i < key_length; ++i)
+    {
+        if(key[i] == '.')
+        {
+            qualified = 1;
+            break;
+        }
+    }
+    
+    // Plain names at the top level only take one probe anyway.
+    if(scope == 0 && !qualified)
+    {
+        symbol_value = ParseContextSymbolTableLookUp(&context->scopes[0].symbols, key, key_length, 0);
+    }
+    else
+    {
+        ParseContextScope *scope_info = context->scopes + scope;
+        int found = 0;
+        if(!qualified)
+        {
+            symbol_value = ParseContextSymbolTableLookUp(&scope_info->symbols, key, key_length, &found);
+        }
+        if(!found)
+        {
+            symbol_value = ParseContextSymbolTableLookUp(&scope_info->lookup_cache, key, key_length, &found);
+        }
+        if(!found)
+        {
+            symbol_value = ParseContextLookUpSymbolFromScope(context, scope, key, key_length);
+            ParseContextSymbolTableInsert(&scope_info->lookup_cache, key, key_length, symbol_value);
+        }
+    }
+    
+    if(!symbol_value && context->streaming)
+    {
+        ParseContextRecordUnresolvedSymbol(context, scope, key, key_length);
+    }
+    
+    return symbol_value;
+}
 
-    if(context->symbol_table_max)
+// Reports every name that an earlier file couldn't resolve, and
+// that the file (which has just been parsed) defines. Returns the number of
+// names reported.
+static int
+ParseContextReportLateDefinitions(ParseContext *context, int file_id)
+{
+    int report_count = 0;
+    for(int i = 0; i < context->unresolved_symbol_count; ++i)
     {
-        unsigned int key_hash = ParseContextSymbolTableHash(key, key_length) % context->symbol_table_max;
-        unsigned int original_hash = key_hash;
+        ParseContextUnresolvedSymbol *symbol = context->unresolved_symbols + i;
+        if(!symbol->reported && symbol->file != file_id &&
+           ParseContextLookUpSymbolFromScope(context, symbol->scope, symbol->key, symbol->key_length))
+        {
+            LogError("ERROR: \"%s\" uses \"%s\", which isn't defined until \"%s\". With --streaming, "
+                     "files have to come after the files that they use (or @Import them).",
+                     context->graph.files[symbol->file].filename, symbol->key,
+                     context->graph.files[file_id].filename);
+            symbol->reported = 1;
+            ++report_count;
+        }
+    }
+    return report_count;
+}
 
-        for(;;)
+// Returns the scope of the namespace that most closely contains
+// the node (using the parents recorded by IndexGraphNodes).
+static int
+ParseContextGetNodeScope(ParseContext *context, DataDeskNode *node)
+{
+    int scope = 0;
+    for(DataDeskNode *parent = DataDeskGetNodeParent(&context->graph, node); parent;
+        parent = DataDeskGetNodeParent(&context->graph, parent))
+    {
+        if(parent->type == DATA_DESK_NODE_TYPE_namespace_declaration)
+        {
+            scope = parent->namespace_declaration.scope;
+            break;
+        }
+    }
+    return scope;
+}
+
+static DataDeskNode *
+GraphLookUpSymbol(DataDeskGraph *graph, DataDeskNode *reference, char *key, int key_length)
+{
+    ParseContext *context = graph->parse_context;
+    return ParseContextResolveSymbol(context, ParseContextGetNodeScope(context, reference), key, key_length);
+}
+
+static int GraphExpandNode(DataDeskGraph *graph, DataDeskNode *node);
+
+static void
+ParseContextInit(ParseContext *context)
+{
+    context->graph.parse_context = context;
+    context->graph.LookUpSymbol = GraphLookUpSymbol;
+    context->graph.ExpandNode = GraphExpandNode;
+    ParseContextAddScope(context, 0, 0);
+}
+
+enum
+{
+    PARSE_CONTEXT_ADD_SYMBOL_MEMORY_FAILURE,
+    PARSE_CONTEXT_ADD_SYMBOL_ALREADY_DEFINED,
+    PARSE_CONTEXT_ADD_SYMBOL_SUCCESS,
+};
+
+// Adds the symbol to the scope being parsed.
+static int
+ParseContextAddSymbol(ParseContext *context, char *key, int key_length, DataDeskNode *root)
+{
+    int result = PARSE_CONTEXT_ADD_SYMBOL_ALREADY_DEFINED;
+    if(ParseContextSymbolTableInsert(&context->scopes[context->current_scope].symbols, key, key_length, root))
+    {
+        result = PARSE_CONTEXT_ADD_SYMBOL_SUCCESS;
+    }
+    return result;
+}
+
+static void *
+ParseContextAllocateMemory(ParseContext *context, unsigned int size)
+{
+    size = PARSE_CONTEXT_MEMORY_ALIGN(size);
+    if(!context->active_block || context->active_block->frozen ||
+       context->active_block->memory_alloc_position + size > context->active_block->memory_size)
+    {
+        unsigned int needed_bytes = PARSE_CONTEXT_MEMORY_BLOCK_SIZE_DEFAULT;
+        if(size > needed_bytes)
+        {
+            needed_bytes = size;
+        }
+
+        ParseContextMemoryBlock *new_block = 0;
+        
+        // When frozen memory is going to be write-protected, block
+        // memory is allocated in whole pages, and block headers live outside
+        // of it, so that they can still be linked together after freezing.
+        if(context->protect_frozen_memory)
+        {
+            unsigned int page_size = GetPageSize();
+            needed_bytes = (needed_bytes + page_size - 1) & ~(page_size - 1);
+            new_block = calloc(1, sizeof(ParseContextMemoryBlock));
+            Assert(new_block != 0);
+            new_block->memory = AllocatePages(needed_bytes);
+            new_block->page_allocated = 1;
+            Assert(new_block->memory != 0);
+        }
+        else
+        {
+            unsigned int header_bytes = PARSE_CONTEXT_MEMORY_ALIGN(sizeof(ParseContextMemoryBlock));
+            new_block = calloc(1, header_bytes + needed_bytes);
+            Assert(new_block != 0);
+            new_block->memory = (char *)new_block + header_bytes;
+        }
+        new_block->memory_size = needed_bytes;
+        new_block->next = 0;
+
+        if(context->active_block)
+        {
+            context->active_block->next = new_block;
+            context->active_block = new_block;
+        }
+        else
+        {
+            context->first_block = new_block;
+            context->active_block = new_block;
+        }
+    }
+
+    Assert(context->active_block &&
+           context->active_block->memory_alloc_position + size <=
+           context->active_block->memory_size);
+
+    void *memory = context->active_block->memory + context->active_block->memory_alloc_position;
+    context->active_block->memory_alloc_position += size;
+    return memory;
+}
+
+// Exchanges the active arena with the parked persistent arena.
+// Only valid while a file arena is active.
+static void
+ParseContextSwapPersistentArena(ParseContext *context)
+{
+    ParseContextArena active = { context->first_block, context->active_block, };
+    context->first_block = context->persistent_arena.first_block;
+    context->active_block = context->persistent_arena.active_block;
+    context->persistent_arena = active;
+}
+
+// For allocations that have to outlive the file being parsed.
+static void *
+ParseContextAllocatePersistentMemory(ParseContext *context, unsigned int size)
+{
+    void *memory = 0;
+    if(context->file_arena_depth)
+    {
+        ParseContextSwapPersistentArena(context);
+        memory = ParseContextAllocateMemory(context, size);
+        ParseContextSwapPersistentArena(context);
+    }
+    else
+    {
+        memory = ParseContextAllocateMemory(context, size);
+    }
+    return memory;
+}
+
+// Starts a new, empty arena for a file, and returns the arena that
+// was active (the importing file's, or the persistent arena), which has to be
+// passed to ParseContextEndFileArena. File arenas nest like imports do.
+static ParseContextArena
+ParseContextBeginFileArena(ParseContext *context)
+{
+    ParseContextArena outer = { context->first_block, context->active_block, };
+    if(context->file_arena_depth++ == 0)
+    {
+        context->persistent_arena = outer;
+    }
+    context->first_block = 0;
+    context->active_block = 0;
+    return outer;
+}
+
+static void
+ParseContextEndFileArena(ParseContext *context, ParseContextArena outer)
+{
+    ParseContextFreeBlocks(context->first_block);
+    
+    // The persistent arena may have grown while it was parked, so
+    // the parked copy is the one to go back to.
+    if(--context->file_arena_depth == 0)
+    {
+        outer = context->persistent_arena;
+        context->persistent_arena.first_block = 0;
+        context->persistent_arena.active_block = 0;
+    }
+    context->first_block = outer.first_block;
+    context->active_block = outer.active_block;
+}
+
+static int
+ParseContextInternString(ParseContext *context, DataDeskStringTable *table, char *string, int string_length)
+{
+    int id = DataDeskStringTableLookUp(table, string, string_length);
+    if(id == 0)
+    {
+        // Grow the string arrays if necessary. Slot 0 is never
+        // used, because 0 is not a valid ID.
+        if(table->count + 1 >= table->string_max)
         {
-            if(context->symbol_table_keys[key_hash].key)
+            int new_string_max = table->string_max ? table->string_max * 2 : 64;
+            table->strings = realloc(table->strings, sizeof(char *) * new_string_max);
+            table->string_lengths = realloc(table->string_lengths, sizeof(int) * new_string_max);
+            Assert(table->strings != 0 && table->string_lengths != 0);
+            table->string_max = new_string_max;
+        }
+        
+        // Keep the table at most half full, so that look-ups from the
+        // custom layer always terminate on an empty slot.
+        if((unsigned int)(table->count + 1) * 2 > table->slot_max)
+        {
+            unsigned int new_slot_max = table->slot_max ? table->slot_max * 2 : 128;
+            int *new_slots = calloc(sizeof(int), new_slot_max);
+            Assert(new_slots != 0);
+            for(int i = 1; i <= table->count; ++i)
             {
-                if(StringMatchCaseSensitiveN(context->symbol_table_keys[key_hash].key, key, key_length))
+                unsigned int slot = DataDeskHashStringN(table->strings[i], table->string_lengths[i]) & (new_slot_max - 1);
+                while(new_slots[slot])
                 {
-                    symbol_value = context->symbol_table_values[key_hash].root;
-                    break;
+                    slot = (slot + 1) & (new_slot_max - 1);
                 }
-                else
+                new_slots[slot] = i;
+            }
+            free(table->slots);
+            table->slots = new_slots;
+            table->slot_max = new_slot_max;
+        }
+        
+        id = ++table->count;
+        table->strings[id] = ParseContextAllocatePersistentMemory(context, string_length + 1);
+        MemoryCopy(table->strings[id], string, string_length);
+        table->strings[id][string_length] = 0;
+        table->string_lengths[id] = string_length;
+        
+        unsigned int slot = DataDeskHashStringN(string, string_length) & (table->slot_max - 1);
+        while(table->slots[slot])
+        {
+            slot = (slot + 1) & (table->slot_max - 1);
+        }
+        table->slots[slot] = id;
+    }
+    
+    return id;
+}
+
+static int
+ParseContextInternTag(ParseContext *context, char *name, int name_length)
+{
+    DataDeskGraph *graph = &context->graph;
+    
+    if(name_length > 0 && name[0] == '@')
+    {
+        ++name;
+        --name_length;
+    }
+    
+    int old_string_max = graph->tags.string_max;
+    int id = ParseContextInternString(context, &graph->tags, name, name_length);
+    
+    // Keep one DataDeskTagInfo per tag string table entry.
+    if(graph->tags.string_max != old_string_max)
+    {
+        graph->tag_infos = realloc(graph->tag_infos, sizeof(DataDeskTagInfo) * graph->tags.string_max);
+        Assert(graph->tag_infos != 0);
+        MemorySet(graph->tag_infos + old_string_max, 0,
+                  sizeof(DataDeskTagInfo) * (graph->tags.string_max - old_string_max));
+    }
+    
+    return id;
+}
+
+static int
+ParseContextInternAtom(ParseContext *context, char *string, int string_length)
+{
+    return ParseContextInternString(context, &context->graph.atoms, string, string_length);
+}
+
+static void
+PushNodeToArray(DataDeskNode ***nodes, int *node_count, int *node_max, DataDeskNode *node)
+{
+    if(*node_count >= *node_max)
+    {
+        *node_max = *node_max ? *node_max * 2 : 16;
+        *nodes = realloc(*nodes, sizeof(DataDeskNode *) * *node_max);
+        Assert(*nodes != 0);
+    }
+    (*nodes)[(*node_count)++] = node;
+}
+
+static void
+ParseContextAddTaggedNode(ParseContext *context, int tag_id, DataDeskNode *node)
+{
+    DataDeskTagInfo *info = context->graph.tag_infos + tag_id;
+    
+    // A node can have the same tag more than once; it should only
+    // be listed once.
+    if(info->node_count == 0 || info->nodes[info->node_count - 1] != node)
+    {
+        PushNodeToArray(&info->nodes, &info->node_count, &info->node_max, node);
+    }
+}
+
+static void
+ParseContextAddTypedNode(ParseContext *context, DataDeskNode *node)
+{
+    DataDeskGraph *graph = &context->graph;
+    if(node->type > DATA_DESK_NODE_TYPE_invalid && node->type < DATA_DESK_NODE_TYPE_MAX)
+    {
+        PushNodeToArray(&graph->type_nodes[node->type], &graph->type_node_counts[node->type],
+                        &graph->type_node_maxes[node->type], node);
+    }
+}
+
+static int
+ParseContextAddSourceFile(ParseContext *context, char *filename, char *contents, int contents_length)
+{
+    DataDeskGraph *graph = &context->graph;
+    
+    // File IDs start at 1, so files[0] is never used.
+    if(graph->file_count + 1 >= graph->file_max)
+    {
+        graph->file_max = graph->file_max ? graph->file_max * 2 : 16;
+        graph->files = realloc(graph->files, sizeof(DataDeskSourceFile) * graph->file_max);
+        Assert(graph->files != 0);
+    }
+    
+    int file_id = ++graph->file_count;
+    DataDeskSourceFile *file = graph->files + file_id;
+    MemorySet(file, 0, sizeof(*file));
+    file->filename = filename;
+    file->contents = contents;
+    file->contents_length = contents_length;
+    
+    int line_count = 1;
+    for(int i = 0; i < contents_length; ++i)
+    {
+        if(contents[i] == '\n')
+        {
+            ++line_count;
+        }
+    }
+    file->line_count = line_count;
+    file->line_offsets = malloc(sizeof(int) * line_count);
+    Assert(file->line_offsets != 0);
+    file->line_offsets[0] = 0;
+    for(int i = 0, line = 1; i < contents_length; ++i)
+    {
+        if(contents[i] == '\n')
+        {
+            file->line_offsets[line++] = i + 1;
+        }
+    }
+    
+    return file_id;
+}
+
+// Most source ranges are worked out from the tokens stored in
+// nodes when the graph is indexed. These are for nodes that start or end with
+// a token that isn't stored anywhere (like a '*' or a closing brace).
+static void
+ParseContextSetNodeStart(ParseContext *context, char *start, DataDeskNode *node)
+{
+    if(context->current_file)
+    {
+        DataDeskSourceFile *file = context->graph.files + context->current_file;
+        context->graph.node_locations[node->id].file = context->current_file;
+        context->graph.node_locations[node->id].start_offset = (int)(start - file->contents);
+    }
+}
+
+static void
+ParseContextSetNodeEnd(ParseContext *context, Tokenizer *tokenizer, DataDeskNode *node)
+{
+    if(context->current_file)
+    {
+        DataDeskSourceFile *file = context->graph.files + context->current_file;
+        context->graph.node_locations[node->id].end_offset = (int)(tokenizer->at - file->contents);
+    }
+}
+
+static DataDeskNode *
+ParseContextAllocateNode(ParseContext *context)
+{
+    DataDeskNode *node = ParseContextAllocateMemory(context, sizeof(DataDeskNode));
+    MemorySet(node, 0, sizeof(*node));
+    
+    DataDeskGraph *graph = &context->graph;
+    node->id = ++graph->node_count;
+    if(node->id >= graph->node_location_max)
+    {
+        int new_node_location_max = graph->node_location_max ? graph->node_location_max * 2 : 4096;
+        graph->node_locations = realloc(graph->node_locations, sizeof(DataDeskNodeLocation) * new_node_location_max);
+        Assert(graph->node_locations != 0);
+        graph->node_location_max = new_node_location_max;
+    }
+    
+    // IDs can be reused when nodes are thrown away (see
+    // ParseContextRollBackToMemoryMark), so always clear the entry.
+    MemorySet(graph->node_locations + node->id, 0, sizeof(DataDeskNodeLocation));
+    
+    return node;
+}
+
+typedef struct ParseContextMemoryMark ParseContextMemoryMark;
+struct ParseContextMemoryMark
+{
+    ParseContextMemoryBlock *block;
+    int memory_alloc_position;
+    int node_count;
+    unsigned int hash_cons_count;
+    int error_stack_size;
+};
+
+static ParseContextMemoryMark
+ParseContextGetMemoryMark(ParseContext *context)
+{
+    ParseContextMemoryMark mark = {0};
+    mark.block = context->active_block;
+    mark.memory_alloc_position = context->active_block ? context->active_block->memory_alloc_position : 0;
+    mark.node_count = context->graph.node_count;
+    mark.hash_cons_count = context->hash_cons_count;
+    mark.error_stack_size = context->error_stack_size;
+    return mark;
+}
+
+static void
+ParseContextRollBackToMemoryMark(ParseContext *context, ParseContextMemoryMark mark)
+{
+    // Only roll back within a single block, and only if nothing
+    // allocated since the mark is still referred to (by the hash-consing table
+    // or by an error message); otherwise, the memory is simply left unused.
+    if(mark.block && mark.block == context->active_block &&
+       mark.hash_cons_count == context->hash_cons_count &&
+       mark.error_stack_size == context->error_stack_size)
+    {
+        context->active_block->memory_alloc_position = mark.memory_alloc_position;
+        context->graph.node_count = mark.node_count;
+    }
+}
+
+// This is a purely syntactic hash (unlike DataDeskGetNodeHash, it
+// doesn't depend on symbol resolution), because it's used during parsing,
+// before every symbol is known.
+static unsigned long long
+HashConsKey(DataDeskNode *node)
+{
+    unsigned long long hash = 0;
+    if(node)
+    {
+        hash = _DataDeskHashMix(0, (unsigned long long)node->type);
+        hash = _DataDeskHashBytes(hash, node->string, node->string ? node->string_length : 0);
+        switch(node->type)
+        {
+            case DATA_DESK_NODE_TYPE_unary_operator:
+            {
+                hash = _DataDeskHashMix(hash, (unsigned long long)node->unary_operator.type);
+                hash = _DataDeskHashMix(hash, HashConsKey(node->unary_operator.operand));
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_binary_operator:
+            {
+                hash = _DataDeskHashMix(hash, (unsigned long long)node->binary_operator.type);
+                hash = _DataDeskHashMix(hash, HashConsKey(node->binary_operator.left));
+                hash = _DataDeskHashMix(hash, HashConsKey(node->binary_operator.right));
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_type_usage:
+            {
+                hash = _DataDeskHashMix(hash, (unsigned long long)node->type_usage.pointer_count);
+                for(DataDeskNode *array = node->type_usage.first_array_size_expression; array; array = array->next)
+                {
+                    hash = _DataDeskHashMix(hash, HashConsKey(array));
+                }
+                break;
+            }
+            default: break;
+        }
+    }
+    return hash;
+}
+
+static int
+NodesAreStructurallyEqual(DataDeskNode *a, DataDeskNode *b)
+{
+    int equal = 0;
+    if(a == b)
+    {
+        equal = 1;
+    }
+    else if(a && b && a->type == b->type && a->string_length == b->string_length &&
+            !a->first_tag && !b->first_tag &&
+            (!a->string || !b->string || StringMatchCaseSensitiveN(a->string, b->string, a->string_length)) &&
+            (!a->string == !b->string))
+    {
+        switch(a->type)
+        {
+            case DATA_DESK_NODE_TYPE_identifier:
+            case DATA_DESK_NODE_TYPE_numeric_constant:
+            case DATA_DESK_NODE_TYPE_string_constant:
+            case DATA_DESK_NODE_TYPE_char_constant:
+            {
+                equal = 1;
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_unary_operator:
+            {
+                equal = (a->unary_operator.type == b->unary_operator.type &&
+                         NodesAreStructurallyEqual(a->unary_operator.operand, b->unary_operator.operand));
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_binary_operator:
+            {
+                equal = (a->binary_operator.type == b->binary_operator.type &&
+                         NodesAreStructurallyEqual(a->binary_operator.left, b->binary_operator.left) &&
+                         NodesAreStructurallyEqual(a->binary_operator.right, b->binary_operator.right));
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_type_usage:
+            {
+                if(a->type_usage.pointer_count == b->type_usage.pointer_count &&
+                   !a->type_usage.struct_declaration && !b->type_usage.struct_declaration &&
+                   !a->type_usage.union_declaration && !b->type_usage.union_declaration)
                 {
-                    if(++key_hash >= context->symbol_table_max)
+                    DataDeskNode *array_a = a->type_usage.first_array_size_expression;
+                    DataDeskNode *array_b = b->type_usage.first_array_size_expression;
+                    for(; array_a && array_b; array_a = array_a->next, array_b = array_b->next)
                     {
-                        key_hash = 0;
+                        if(!NodesAreStructurallyEqual(array_a, array_b))
+                        {
+                            break;
+                        }
                     }
-                    if(key_hash == original_hash)
+                    equal = !array_a && !array_b;
+                }
+                break;
+            }
+            default: break;
+        }
+    }
+    return equal;
+}
+
+// Returns the shared node that is structurally identical to the
+// passed node, registering the passed node as the shared one if there is
+// none yet. Only nodes that are never linked into a list by their "next"
+// pointer can be passed here.
+static DataDeskNode *
+ParseContextHashCons(ParseContext *context, DataDeskNode *node)
+{
+    DataDeskNode *result = node;
+    
+    if(node && !node->first_tag && !node->next)
+    {
+        if(context->hash_cons_count * 2 >= context->hash_cons_table_max)
+        {
+            unsigned int new_table_max = context->hash_cons_table_max ? context->hash_cons_table_max * 2 : 1024;
+            unsigned long long *new_keys = calloc(sizeof(unsigned long long), new_table_max);
+            DataDeskNode **new_nodes = calloc(sizeof(DataDeskNode *), new_table_max);
+            int *new_scopes = calloc(sizeof(int), new_table_max);
+            Assert(new_keys != 0 && new_nodes != 0 && new_scopes != 0);
+            for(unsigned int i = 0; i < context->hash_cons_table_max; ++i)
+            {
+                if(context->hash_cons_nodes[i])
+                {
+                    unsigned int slot = (unsigned int)context->hash_cons_keys[i] & (new_table_max - 1);
+                    while(new_nodes[slot])
                     {
-                        break;
+                        slot = (slot + 1) & (new_table_max - 1);
                     }
+                    new_keys[slot] = context->hash_cons_keys[i];
+                    new_nodes[slot] = context->hash_cons_nodes[i];
+                    new_scopes[slot] = context->hash_cons_scopes[i];
                 }
             }
-            else
+            free(context->hash_cons_keys);
+            free(context->hash_cons_nodes);
+            free(context->hash_cons_scopes);
+            context->hash_cons_keys = new_keys;
+            context->hash_cons_nodes = new_nodes;
+            context->hash_cons_scopes = new_scopes;
+            context->hash_cons_table_max = new_table_max;
+        }
+        
+        // Names can mean different things in different namespaces,
+        // so nodes are only shared within the scope they were parsed in.
+        unsigned long long key = _DataDeskHashMix(HashConsKey(node), (unsigned long long)context->current_scope);
+        unsigned int slot = (unsigned int)key & (context->hash_cons_table_max - 1);
+        for(;;)
+        {
+            DataDeskNode *candidate = context->hash_cons_nodes[slot];
+            if(!candidate)
+            {
+                node->flags |= DATA_DESK_NODE_FLAG_shared;
+                context->hash_cons_keys[slot] = key;
+                context->hash_cons_nodes[slot] = node;
+                context->hash_cons_scopes[slot] = context->current_scope;
+                ++context->hash_cons_count;
+                break;
+            }
+            else if(context->hash_cons_keys[slot] == key && context->hash_cons_scopes[slot] == context->current_scope &&
+                    NodesAreStructurallyEqual(candidate, node))
             {
+                result = candidate;
                 break;
             }
+            slot = (slot + 1) & (context->hash_cons_table_max - 1);
         }
     }
-
-    return symbol_value;
+    
+    return result;
 }
 
-enum
+// Forgets every shared node (for --streaming, where files are
+// released one at a time, and nodes are only shared within a file).
+static void
+ParseContextResetHashCons(ParseContext *context)
 {
-    PARSE_CONTEXT_ADD_SYMBOL_MEMORY_FAILURE,
-    PARSE_CONTEXT_ADD_SYMBOL_ALREADY_DEFINED,
-    PARSE_CONTEXT_ADD_SYMBOL_SUCCESS,
-};
+    if(context->hash_cons_table_max)
+    {
+        MemorySet(context->hash_cons_nodes, 0, sizeof(DataDeskNode *) * context->hash_cons_table_max);
+        context->hash_cons_count = 0;
+    }
+}
 
-static int
-ParseContextAddSymbol(ParseContext *context, char *key, int key_length, DataDeskNode *root)
+// definition has the form NAME or NAME=value (where value is an
+// integer); NAME on its own is defined as 1, like in C compilers.
+static void
+ParseContextAddDefine(ParseContext *context, char *definition)
 {
-    int result = PARSE_CONTEXT_ADD_SYMBOL_MEMORY_FAILURE;
-
-    // NOTE(rjf): Reallocate symbol table if necessary (if the count we have is 75%+ of
-    // the allocated size of the symbol table).
-    if(context->symbol_table_count >= (context->symbol_table_max * 3) / 4)
+    if(context->define_count >= context->define_max)
+    {
+        context->define_max = context->define_max ? context->define_max * 2 : 16;
+        context->define_names = realloc(context->define_names, sizeof(char *) * context->define_max);
+        context->define_name_lengths = realloc(context->define_name_lengths, sizeof(int) * context->define_max);
+        context->define_values = realloc(context->define_values, sizeof(int) * context->define_max);
+        Assert(context->define_names != 0 && context->define_name_lengths != 0 && context->define_values != 0);
+    }
+    
+    int name_length = 0;
+    while(definition[name_length] && definition[name_length] != '=')
+    {
+        ++name_length;
+    }
+    
+    int value = 1;
+    if(definition[name_length] == '=')
     {
-        // NOTE(rjf): If we're resizing, increase size by a factor of 1.5x (exponentially),
-        // and fall back on 1024 (this case happens if this is the first add ever).
-        unsigned int new_symbol_table_max = (context->symbol_table_max * 3) / 2;
-        if(new_symbol_table_max == 0)
+        char *value_string = definition + name_length + 1;
+        value = DataDeskCStringToInt(value_string);
+        if(value_string[0] == '-')
         {
-            new_symbol_table_max = 1024;
+            value = -value;
         }
+    }
+    
+    context->define_names[context->define_count] = definition;
+    context->define_name_lengths[context->define_count] = name_length;
+    context->define_values[context->define_count] = value;
+    ++context->define_count;
+}
 
-        ParseContextSymbolTableKey *new_symbol_table_keys = calloc(sizeof(ParseContextSymbolTableKey), new_symbol_table_max);
-        ParseContextSymbolTableValue *new_symbol_table_values = calloc(sizeof(ParseContextSymbolTableValue), new_symbol_table_max);
-
-        // NOTE(rjf): Re-hash all current keys to the new table memory.
-        // TODO(rjf): Can this be done more intelligently?
-        for(unsigned int i = 0; i < context->symbol_table_max; ++i)
+static int
+EvaluateConditionExpression(ParseContext *context, DataDeskNode *root, int depth)
+{
+    int result = 0;
+    
+    // The depth limit stops constants that are defined in terms of
+    // themselves from recursing forever.
+    if(root && depth < 64)
+    {
+        switch(root->type)
         {
-            if(context->symbol_table_keys[i].key)
+            case DATA_DESK_NODE_TYPE_numeric_constant:
             {
-                char *old_key = context->symbol_table_keys[i].key;
-                int old_key_length = context->symbol_table_keys[i].key_length;
-                DataDeskNode *old_root = context->symbol_table_values[i].root;
-
-                unsigned int new_hash = ParseContextSymbolTableHash(old_key, old_key_length) % new_symbol_table_max;
-                unsigned int original_new_hash = new_hash;
-
-                for(;;)
+                result = DataDeskCStringToInt(root->string);
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_identifier:
+            {
+                // Identifiers are looked up in the -D definitions
+                // first (later ones win), then in the constants parsed so far.
+                // Anything else is 0.
+                int found = 0;
+                for(int i = context->define_count - 1; i >= 0; --i)
                 {
-                    if(new_symbol_table_keys[new_hash].key)
+                    if(context->define_name_lengths[i] == root->string_length &&
+                       StringMatchCaseSensitiveN(context->define_names[i], root->string, root->string_length))
                     {
-                        if(StringMatchCaseSensitive(new_symbol_table_keys[new_hash].key, old_key))
-                        {
-                            new_symbol_table_values[new_hash].root = old_root;
-                            break;
-                        }
-                        else
-                        {
-                            if(++new_hash >= new_symbol_table_max)
-                            {
-                                new_hash = 0;
-                            }
-
-                            if(new_hash == original_new_hash)
-                            {
-                                // NOTE(rjf): This case should really never happen, when we don't find
-                                // an open slot in the *resized* hash table.
-                                Assert("Resized hash table doesn't have space...?" == 0);
-                                break;
-                            }
-                        }
+                        result = context->define_values[i];
+                        found = 1;
+                        break;
                     }
-                    else
+                }
+                if(!found)
+                {
+                    if(context->parse_cache_recorder)
                     {
-                        new_symbol_table_keys[new_hash].key = old_key;
-                        new_symbol_table_keys[new_hash].key_length = old_key_length;
-                        new_symbol_table_values[new_hash].root = old_root;
-                        break;
+                        context->parse_cache_recorder->uses_constants = 1;
+                    }
+                    DataDeskNode *constant = ParseContextLookUpSymbol(context, root->string, root->string_length);
+                    if(constant && constant->type == DATA_DESK_NODE_TYPE_constant_definition)
+                    {
+                        result = EvaluateConditionExpression(context, constant->constant_definition.expression, depth + 1);
                     }
                 }
+                break;
             }
-        }
-
-        free(context->symbol_table_keys);
-        free(context->symbol_table_values);
-        context->symbol_table_keys   = new_symbol_table_keys;
-        context->symbol_table_values = new_symbol_table_values;
-        context->symbol_table_max    = new_symbol_table_max;
-    }
-
-    unsigned int key_hash = ParseContextSymbolTableHash(key, key_length) % context->symbol_table_max;
-    unsigned int original_hash = key_hash;
-
-    for(;;)
-    {
-        if(context->symbol_table_keys[key_hash].key)
-        {
-            if(StringMatchCaseSensitiveN(context->symbol_table_keys[key_hash].key, key, key_length))
+            case DATA_DESK_NODE_TYPE_unary_operator:
             {
-                if(context->symbol_table_values[key_hash].root)
-                {
-                    result = PARSE_CONTEXT_ADD_SYMBOL_ALREADY_DEFINED;
-                }
-                else
+                int operand = EvaluateConditionExpression(context, root->unary_operator.operand, depth + 1);
+                switch(root->unary_operator.type)
                 {
-                    result = PARSE_CONTEXT_ADD_SYMBOL_SUCCESS;
-                    context->symbol_table_keys[key_hash].key = key;
-                    context->symbol_table_values[key_hash].root = root;
-                    ++context->symbol_table_count;
+                    case DATA_DESK_UNARY_OPERATOR_TYPE_not:            { result = !operand; break; }
+                    case DATA_DESK_UNARY_OPERATOR_TYPE_negative:       { result = -operand; break; }
+                    case DATA_DESK_UNARY_OPERATOR_TYPE_bitwise_negate: { result = ~operand; break; }
+                    default: break;
                 }
                 break;
             }
-            else
+            case DATA_DESK_NODE_TYPE_binary_operator:
             {
-                if(++key_hash >= context->symbol_table_max)
-                {
-                    key_hash = 0;
-                }
-                if(key_hash == original_hash)
+                int left = EvaluateConditionExpression(context, root->binary_operator.left, depth + 1);
+                int right = EvaluateConditionExpression(context, root->binary_operator.right, depth + 1);
+                switch(root->binary_operator.type)
                 {
-                    break;
+                    case DATA_DESK_BINARY_OPERATOR_TYPE_add:            { result = left + right; break; }
+                    case DATA_DESK_BINARY_OPERATOR_TYPE_subtract:       { result = left - right; break; }
+                    case DATA_DESK_BINARY_OPERATOR_TYPE_multiply:       { result = left * right; break; }
+                    case DATA_DESK_BINARY_OPERATOR_TYPE_divide:         { result = right ? left / right : 0; break; }
+                    case DATA_DESK_BINARY_OPERATOR_TYPE_modulus:        { result = right ? left % right : 0; break; }
+                    case DATA_DESK_BINARY_OPERATOR_TYPE_bitshift_left:  { result = left << right; break; }
+                    case DATA_DESK_BINARY_OPERATOR_TYPE_bitshift_right: { result = left >> right; break; }
+                    case DATA_DESK_BINARY_OPERATOR_TYPE_bitwise_and:    { result = left & right; break; }
+                    case DATA_DESK_BINARY_OPERATOR_TYPE_bitwise_or:     { result = left | right; break; }
+                    case DATA_DESK_BINARY_OPERATOR_TYPE_boolean_and:    { result = left && right; break; }
+                    case DATA_DESK_BINARY_OPERATOR_TYPE_boolean_or:     { result = left || right; break; }
+                    default: break;
                 }
+                break;
             }
-        }
-        else
-        {
-            context->symbol_table_keys[key_hash].key = key;
-            context->symbol_table_values[key_hash].root = root;
-            result = PARSE_CONTEXT_ADD_SYMBOL_SUCCESS;
-            ++context->symbol_table_count;
-            break;
+            default: break;
         }
     }
-
+    
     return result;
 }
 
-static void *
-ParseContextAllocateMemory(ParseContext *context, unsigned int size)
+// Returns 1 if an @If tag in the list has a condition that is 0,
+// or an @Unless tag has one that isn't.
+static int
+ParseContextTagsExcludeNode(ParseContext *context, DataDeskNode *tag_list)
 {
-    if(!context->active_block ||
-       context->active_block->memory_alloc_position + size > context->active_block->memory_size)
+    int excluded = 0;
+    for(DataDeskNode *tag = tag_list; tag && !excluded; tag = tag->next)
     {
-        unsigned int needed_bytes = PARSE_CONTEXT_MEMORY_BLOCK_SIZE_DEFAULT;
-        if(size > needed_bytes)
-        {
-            needed_bytes = size;
-        }
-
-        ParseContextMemoryBlock *new_block = 0;
-        new_block = calloc(1, sizeof(ParseContextMemoryBlock) + needed_bytes);
-        Assert(new_block != 0);
-        new_block->memory = (char *)new_block + sizeof(ParseContextMemoryBlock);
-        new_block->memory_size = needed_bytes;
-        new_block->next = 0;
-
-        if(context->active_block)
+        if(tag->string_length == 3 && StringMatchCaseSensitiveN(tag->string, "@If", 3))
         {
-            context->active_block->next = new_block;
-            context->active_block = new_block;
+            excluded = !EvaluateConditionExpression(context, tag->tag.first_tag_parameter, 0);
         }
-        else
+        else if(tag->string_length == 7 && StringMatchCaseSensitiveN(tag->string, "@Unless", 7))
         {
-            context->first_block = new_block;
-            context->active_block = new_block;
+            excluded = !!EvaluateConditionExpression(context, tag->tag.first_tag_parameter, 0);
         }
     }
-
-    Assert(context->active_block &&
-           context->active_block->memory_alloc_position + size <=
-           context->active_block->memory_size);
-
-    void *memory = context->active_block->memory + context->active_block->memory_alloc_position;
-    context->active_block->memory_alloc_position += size;
-    return memory;
-}
-
-static DataDeskNode *
-ParseContextAllocateNode(ParseContext *context)
-{
-    DataDeskNode *node = ParseContextAllocateMemory(context, sizeof(DataDeskNode));
-    MemorySet(node, 0, sizeof(*node));
-    return node;
+    return excluded;
 }
 
 static void
@@ -548,11 +1571,18 @@ ParseContextAllocateStringCopyUpperCamelCase(ParseContext *context, char *string
 static void
 ParseContextPushError(ParseContext *context, Tokenizer *tokenizer, char *msg, ...)
 {
+    if(context->parse_cache_recorder)
+    {
+        context->parse_cache_recorder->had_errors = 1;
+    }
+    
+    // The error stack is reused between files, and can be pushed
+    // to after the graph has been frozen, so it doesn't live in the arena.
     if(!context->error_stack)
     {
         context->error_stack_max = 16;
-        context->error_stack = ParseContextAllocateMemory(context,
-                                                          sizeof(ParseError) * context->error_stack_max);
+        context->error_stack = calloc(sizeof(ParseError), context->error_stack_max);
+        Assert(context->error_stack != 0);
     }
 
     if(context->error_stack_size < context->error_stack_max)
@@ -606,11 +1636,13 @@ ParseTagList(ParseContext *context, Tokenizer *tokenizer)
                     }
                     if(RequireToken(tokenizer, ")", 0))
                     {
+                        ParseContextSetNodeEnd(context, tokenizer, tag_node);
                         break;
                     }
                     if(!RequireToken(tokenizer, ",", 0))
                     {
                         ParseContextPushError(context, tokenizer, "Expected ','.");
+                        break;
                     }
                 }
             }
@@ -673,6 +1705,19 @@ UnaryOperatorPrecedence(int type)
     return precedence;
 }
 
+// Extends the name over every ".Name" that directly follows it
+// (like Render.Vertex), which names something inside a namespace.
+static void
+ParseQualifiedName(Tokenizer *tokenizer, Token *name)
+{
+    while(tokenizer->at[0] == '.' && (CharIsAlpha(tokenizer->at[1]) || tokenizer->at[1] == '_'))
+    {
+        NextToken(tokenizer);
+        Token part = NextToken(tokenizer);
+        name->string_length = (int)(part.string + part.string_length - name->string);
+    }
+}
+
 static DataDeskNode *
 ParseUnaryExpression(ParseContext *context, Tokenizer *tokenizer)
 {
@@ -700,6 +1745,7 @@ ParseUnaryExpression(ParseContext *context, Tokenizer *tokenizer)
     else if(token.type == TOKEN_alphanumeric_block)
     {
         NextToken(tokenizer);
+        ParseQualifiedName(tokenizer, &token);
         expression = ParseContextAllocateNode(context);
         expression->type = DATA_DESK_NODE_TYPE_identifier;
         expression->string = token.string;
@@ -728,6 +1774,7 @@ ParseUnaryExpression(ParseContext *context, Tokenizer *tokenizer)
 static DataDeskNode *
 ParseExpression_(ParseContext *context, Tokenizer *tokenizer, int precedence_in)
 {
+    char *start = PeekToken(tokenizer).string;
     DataDeskNode *expression = ParseUnaryExpression(context, tokenizer);
 
     if(!expression)
@@ -768,11 +1815,18 @@ ParseExpression_(ParseContext *context, Tokenizer *tokenizer, int precedence_in)
                     goto end_parse;
                 }
                 DataDeskNode *existing_expression = expression;
+                if(context->hash_cons)
+                {
+                    existing_expression = ParseContextHashCons(context, existing_expression);
+                    right = ParseContextHashCons(context, right);
+                }
                 expression = ParseContextAllocateNode(context);
                 expression->type = DATA_DESK_NODE_TYPE_binary_operator;
                 expression->binary_operator.type = operator_type;
                 expression->binary_operator.left = existing_expression;
                 expression->binary_operator.right = right;
+                ParseContextSetNodeStart(context, start, expression);
+                ParseContextSetNodeEnd(context, tokenizer, expression);
             }
         }
     }
@@ -787,17 +1841,25 @@ ParseExpression(ParseContext *context, Tokenizer *tokenizer)
     return ParseExpression_(context, tokenizer, 1);
 }
 
+// Loading files is up to the program using the parser, so this is
+// defined alongside the rest of the file handling code.
+static int ImportFile(ParseContext *context, Tokenizer *tokenizer, char *path, int path_length);
+
 static DataDeskNode *ParseDeclarationBody     (ParseContext *context, Tokenizer *tokenizer, Token name);
 static DataDeskNode *ParseStructBody          (ParseContext *context, Tokenizer *tokenizer, Token name);
 static DataDeskNode *ParseUnionBody           (ParseContext *context, Tokenizer *tokenizer, Token name);
 static DataDeskNode *ParseEnumBody            (ParseContext *context, Tokenizer *tokenizer, Token name);
 static DataDeskNode *ParseFlagsBody           (ParseContext *context, Tokenizer *tokenizer, Token name);
 static DataDeskNode *ParseProcedureHeaderBody (ParseContext *context, Tokenizer *tokenizer, Token name);
+static DataDeskNode *ParseNamespaceBody       (ParseContext *context, Tokenizer *tokenizer, Token name);
+static DataDeskNode *SkimBody                 (ParseContext *context, Tokenizer *tokenizer, Token name, DataDeskNodeType type);
 
 static DataDeskNode *
 ParseTypeUsage(ParseContext *context, Tokenizer *tokenizer)
 {
     DataDeskNode *type = 0;
+    ParseContextMemoryMark memory_mark = ParseContextGetMemoryMark(context);
+    char *start = PeekToken(tokenizer).string;
 
     // NOTE(rjf): Find number of layers of indirection.
     int pointer_count = 0;
@@ -830,6 +1892,7 @@ ParseTypeUsage(ParseContext *context, Tokenizer *tokenizer)
             ParseContextPushError(context, tokenizer, "Missing type name.");
             goto end_parse;
         }
+        ParseQualifiedName(tokenizer, &type_name);
         type_name_string = type_name.string;
         type_name_string_length = type_name.string_length;
     }
@@ -861,6 +1924,22 @@ ParseTypeUsage(ParseContext *context, Tokenizer *tokenizer)
             break;
         }
     }
+    
+    ParseContextSetNodeStart(context, start, type);
+    ParseContextSetNodeEnd(context, tokenizer, type);
+    
+    // If this type usage is identical to one we've already seen,
+    // use that one instead, and give back the memory used by this one (so
+    // long as nothing allocated while parsing it needs to stick around).
+    if(context->hash_cons && !struct_declaration && !union_declaration)
+    {
+        DataDeskNode *shared_type = ParseContextHashCons(context, type);
+        if(shared_type != type)
+        {
+            ParseContextRollBackToMemoryMark(context, memory_mark);
+            type = shared_type;
+        }
+    }
 
     end_parse:;
     return type;
@@ -875,8 +1954,42 @@ ParseCode(ParseContext *context, Tokenizer *tokenizer)
 
     do
     {
+        ParseContextMemoryMark memory_mark = ParseContextGetMemoryMark(context);
+        DataDeskNode **previous_node_store_target = node_store_target;
         ParseTagList(context, tokenizer);
         DataDeskNode *tag_list = ParseContextPopAllTags(context);
+        
+        // Declarations excluded by @If/@Unless are still parsed (so
+        // that we know where they end), but they're never added to the graph
+        // or the symbol table, and their memory is given back afterwards.
+        int excluded = ParseContextTagsExcludeNode(context, tag_list) || context->exclude_depth;
+        
+        // @Import("path") tags don't belong to the declaration after
+        // them (if there is one); they parse another file.
+        int imported = 0;
+        for(DataDeskNode **tag_store_target = &tag_list; *tag_store_target;)
+        {
+            DataDeskNode *tag = *tag_store_target;
+            if(tag->string_length == 7 && StringMatchCaseSensitiveN(tag->string, "@Import", 7))
+            {
+                *tag_store_target = tag->next;
+                imported = 1;
+                
+                DataDeskNode *path = tag->tag.first_tag_parameter;
+                if(!path || path->type != DATA_DESK_NODE_TYPE_string_constant || path->string_length < 2)
+                {
+                    ParseContextPushError(context, tokenizer, "@Import expects a path string.");
+                }
+                else if(!excluded)
+                {
+                    ImportFile(context, tokenizer, path->string + 1, path->string_length - 2);
+                }
+            }
+            else
+            {
+                tag_store_target = &tag->next;
+            }
+        }
 
         token = PeekToken(tokenizer);
 
@@ -884,6 +1997,11 @@ ParseCode(ParseContext *context, Tokenizer *tokenizer)
         {
             break;
         }
+        
+        if(imported && RequireToken(tokenizer, ";", 0))
+        {
+            continue;
+        }
 
         DataDeskNode *new_node = 0;
 
@@ -899,25 +2017,29 @@ ParseCode(ParseContext *context, Tokenizer *tokenizer)
                 // NOTE(rjf): Struct.
                 if(RequireToken(tokenizer, "struct", 0))
                 {
-                    new_node = ParseStructBody(context, tokenizer, name);
+                    new_node = (context->skim ? SkimBody(context, tokenizer, name, DATA_DESK_NODE_TYPE_struct_declaration) :
+                                ParseStructBody(context, tokenizer, name));
                 }
 
                 // NOTE(rjf): Union.
                 else if(RequireToken(tokenizer, "union", 0))
                 {
-                    new_node = ParseUnionBody(context, tokenizer, name);
+                    new_node = (context->skim ? SkimBody(context, tokenizer, name, DATA_DESK_NODE_TYPE_union_declaration) :
+                                ParseUnionBody(context, tokenizer, name));
                 }
 
                 // NOTE(rjf): Enum.
                 else if(RequireToken(tokenizer, "enum", 0))
                 {
-                    new_node = ParseEnumBody(context, tokenizer, name);
+                    new_node = (context->skim ? SkimBody(context, tokenizer, name, DATA_DESK_NODE_TYPE_enum_declaration) :
+                                ParseEnumBody(context, tokenizer, name));
                 }
 
                 // NOTE(rjf): Flags.
                 else if(RequireToken(tokenizer, "flags", 0))
                 {
-                    new_node = ParseFlagsBody(context, tokenizer, name);
+                    new_node = (context->skim ? SkimBody(context, tokenizer, name, DATA_DESK_NODE_TYPE_flags_declaration) :
+                                ParseFlagsBody(context, tokenizer, name));
                 }
 
                 // NOTE(rjf): Procedure header.
@@ -926,6 +2048,14 @@ ParseCode(ParseContext *context, Tokenizer *tokenizer)
                     new_node = ParseProcedureHeaderBody(context, tokenizer, name);
                 }
 
+                // Namespace.
+                else if(RequireToken(tokenizer, "namespace", 0))
+                {
+                    context->exclude_depth += excluded;
+                    new_node = ParseNamespaceBody(context, tokenizer, name);
+                    context->exclude_depth -= excluded;
+                }
+
                 // NOTE(rjf): Some constant expression.
                 else
                 {
@@ -941,12 +2071,20 @@ ParseCode(ParseContext *context, Tokenizer *tokenizer)
                 if(new_node != 0)
                 {
                     new_node->first_tag = tag_list;
-                    if(ParseContextAddSymbol(context, new_node->string, new_node->string_length, new_node) == PARSE_CONTEXT_ADD_SYMBOL_ALREADY_DEFINED)
+                    if(!excluded)
                     {
-                        ParseContextPushError(context, tokenizer, "\"%.*s\" has already been defined.", new_node->string_length, new_node->string);
+                        // A namespace that is opened again shares the
+                        // scope of the first one, which is the one in the symbol table.
+                        int reopened_namespace = (new_node->type == DATA_DESK_NODE_TYPE_namespace_declaration &&
+                                                  context->scopes[new_node->namespace_declaration.scope].node != new_node);
+                        if(!reopened_namespace &&
+                           ParseContextAddSymbol(context, new_node->string, new_node->string_length, new_node) == PARSE_CONTEXT_ADD_SYMBOL_ALREADY_DEFINED)
+                        {
+                            ParseContextPushError(context, tokenizer, "\"%.*s\" has already been defined.", new_node->string_length, new_node->string);
+                        }
+                        *node_store_target = new_node;
+                        node_store_target = &(*node_store_target)->next;
                     }
-                    *node_store_target = new_node;
-                    node_store_target = &(*node_store_target)->next;
                 }
                 else
                 {
@@ -972,12 +2110,15 @@ ParseCode(ParseContext *context, Tokenizer *tokenizer)
                     if(RequireToken(tokenizer, ";", 0))
                     {
                         new_node->first_tag = tag_list;
-                        if(ParseContextAddSymbol(context, new_node->string, new_node->string_length, new_node) == PARSE_CONTEXT_ADD_SYMBOL_ALREADY_DEFINED)
+                        if(!excluded)
                         {
-                            ParseContextPushError(context, tokenizer, "\"%.*s\" has already been defined.", new_node->string_length, new_node->string);
+                            if(ParseContextAddSymbol(context, new_node->string, new_node->string_length, new_node) == PARSE_CONTEXT_ADD_SYMBOL_ALREADY_DEFINED)
+                            {
+                                ParseContextPushError(context, tokenizer, "\"%.*s\" has already been defined.", new_node->string_length, new_node->string);
+                            }
+                            *node_store_target = new_node;
+                            node_store_target = &(*node_store_target)->next;
                         }
-                        *node_store_target = new_node;
-                        node_store_target = &(*node_store_target)->next;
                     }
                     else
                     {
@@ -1007,14 +2148,27 @@ ParseCode(ParseContext *context, Tokenizer *tokenizer)
                     ParseContextPushError(context, tokenizer, "Expected ';'.");
                 }
                 new_node->first_tag = tag_list;
-                *node_store_target = new_node;
-                node_store_target = &(*node_store_target)->next;
+                if(!excluded)
+                {
+                    *node_store_target = new_node;
+                    node_store_target = &(*node_store_target)->next;
+                }
             }
             else
             {
                 break;
             }
         }
+        
+        if(node_store_target != previous_node_store_target && context->parse_cache_recorder)
+        {
+            ++context->parse_cache_recorder->declaration_count;
+        }
+        
+        if(excluded)
+        {
+            ParseContextRollBackToMemoryMark(context, memory_mark);
+        }
 
         if(context->error_stack_size)
         {
@@ -1034,6 +2188,7 @@ ParseDeclarationBody(ParseContext *context, Tokenizer *tokenizer, Token name)
     root->string = name.string;
     root->string_length = name.string_length;
     root->declaration.type = ParseTypeUsage(context, tokenizer);
+    ParseContextSetNodeEnd(context, tokenizer, root);
     return root;
 }
 
@@ -1049,8 +2204,10 @@ ParseDeclarationList(ParseContext *context, Tokenizer *tokenizer)
             break;
         }
 
+        ParseContextMemoryMark memory_mark = ParseContextGetMemoryMark(context);
         ParseTagList(context, tokenizer);
         DataDeskNode *tag_list = ParseContextPopAllTags(context);
+        int excluded = ParseContextTagsExcludeNode(context, tag_list);
 
         Token name = {0};
         if(RequireTokenType(tokenizer, TOKEN_alphanumeric_block, &name) &&
@@ -1058,8 +2215,15 @@ ParseDeclarationList(ParseContext *context, Tokenizer *tokenizer)
         {
             DataDeskNode *declaration = ParseDeclarationBody(context, tokenizer, name);
             declaration->first_tag = tag_list;
-            *target = declaration;
-            target = &(*target)->next;
+            if(excluded)
+            {
+                ParseContextRollBackToMemoryMark(context, memory_mark);
+            }
+            else
+            {
+                *target = declaration;
+                target = &(*target)->next;
+            }
 
             if(!(TokenMatch(PeekToken(tokenizer), "}") || TokenMatch(PeekToken(tokenizer), ")")) &&
                !RequireToken(tokenizer, ";", 0) && !RequireToken(tokenizer, ",", 0))
@@ -1089,19 +2253,28 @@ ParseIdentifierList(ParseContext *context, Tokenizer *tokenizer)
             break;
         }
 
+        ParseContextMemoryMark memory_mark = ParseContextGetMemoryMark(context);
         ParseTagList(context, tokenizer);
         DataDeskNode *tag_list = ParseContextPopAllTags(context);
+        int excluded = ParseContextTagsExcludeNode(context, tag_list);
 
         Token name = {0};
         if(RequireTokenType(tokenizer, TOKEN_alphanumeric_block, &name))
         {
-            DataDeskNode *identifier = ParseContextAllocateNode(context);
-            identifier->type = DATA_DESK_NODE_TYPE_identifier;
-            identifier->string = name.string;
-            identifier->string_length = name.string_length;
-            identifier->first_tag = tag_list;
-            *target = identifier;
-            target = &(*target)->next;
+            if(excluded)
+            {
+                ParseContextRollBackToMemoryMark(context, memory_mark);
+            }
+            else
+            {
+                DataDeskNode *identifier = ParseContextAllocateNode(context);
+                identifier->type = DATA_DESK_NODE_TYPE_identifier;
+                identifier->string = name.string;
+                identifier->string_length = name.string_length;
+                identifier->first_tag = tag_list;
+                *target = identifier;
+                target = &(*target)->next;
+            }
 
             if(!RequireToken(tokenizer, ";", 0) && !RequireToken(tokenizer, ",", 0))
             {
@@ -1139,6 +2312,7 @@ ParseStructBody(ParseContext *context, Tokenizer *tokenizer, Token name)
         ParseContextPushError(context, tokenizer, "Expected '}'.");
         goto end_parse;
     }
+    ParseContextSetNodeEnd(context, tokenizer, root);
 
     end_parse:;
     return root;
@@ -1165,6 +2339,7 @@ ParseUnionBody(ParseContext *context, Tokenizer *tokenizer, Token name)
         ParseContextPushError(context, tokenizer, "Expected '}'.");
         goto end_parse;
     }
+    ParseContextSetNodeEnd(context, tokenizer, root);
 
     end_parse:;
     return root;
@@ -1191,6 +2366,7 @@ ParseEnumBody(ParseContext *context, Tokenizer *tokenizer, Token name)
         ParseContextPushError(context, tokenizer, "Expected '}'.");
         goto end_parse;
     }
+    ParseContextSetNodeEnd(context, tokenizer, root);
 
     end_parse:;
     return root;
@@ -1217,6 +2393,7 @@ ParseFlagsBody(ParseContext *context, Tokenizer *tokenizer, Token name)
         ParseContextPushError(context, tokenizer, "Expected '}'.");
         goto end_parse;
     }
+    ParseContextSetNodeEnd(context, tokenizer, root);
 
     end_parse:;
     return root;
@@ -1243,16 +2420,154 @@ ParseProcedureHeaderBody(ParseContext *context, Tokenizer *tokenizer, Token name
         ParseContextPushError(context, tokenizer, "Expected ')'.");
         goto end_parse;
     }
+    ParseContextSetNodeEnd(context, tokenizer, root);
 
+    // The return type can be shared (with --share-nodes), and then it isn't
+    // merged into this range, so the end is recorded here.
     if(RequireToken(tokenizer, "->", 0))
     {
         root->procedure_header.return_type = ParseTypeUsage(context, tokenizer);
+        ParseContextSetNodeEnd(context, tokenizer, root);
+    }
+
+    end_parse:;
+    return root;
+}
+
+static DataDeskNode *
+ParseNamespaceBody(ParseContext *context, Tokenizer *tokenizer, Token name)
+{
+    DataDeskNode *root = ParseContextAllocateNode(context);
+    root->type = DATA_DESK_NODE_TYPE_namespace_declaration;
+    root->string = name.string;
+    root->string_length = name.string_length;
+
+    if(!RequireToken(tokenizer, "{", 0))
+    {
+        ParseContextPushError(context, tokenizer, "Expected '{'.");
+        goto end_parse;
+    }
+
+    DataDeskNode *existing = ParseContextSymbolTableLookUp(&context->scopes[context->current_scope].symbols,
+                                                           name.string, name.string_length, 0);
+    if(existing && existing->type == DATA_DESK_NODE_TYPE_namespace_declaration)
+    {
+        root->namespace_declaration.scope = existing->namespace_declaration.scope;
+    }
+    else
+    {
+        root->namespace_declaration.scope = ParseContextAddScope(context, context->current_scope, root);
+    }
+
+    int parent_scope = context->current_scope;
+    context->current_scope = root->namespace_declaration.scope;
+    root->namespace_declaration.first_member = ParseCode(context, tokenizer);
+    context->current_scope = parent_scope;
+
+    // ParseCode stops at the first error, which has already been
+    // reported.
+    if(context->error_stack_size)
+    {
+        goto end_parse;
+    }
+
+    if(!RequireToken(tokenizer, "}", 0))
+    {
+        ParseContextPushError(context, tokenizer, "Expected '}'.");
+        goto end_parse;
+    }
+    ParseContextSetNodeEnd(context, tokenizer, root);
+
+    end_parse:;
+    return root;
+}
+
+// Used with --skim instead of ParseStructBody, ParseUnionBody,
+// ParseEnumBody, and ParseFlagsBody. The body is only matched up to its
+// closing brace; ParseSkimmedBody parses it later.
+static DataDeskNode *
+SkimBody(ParseContext *context, Tokenizer *tokenizer, Token name, DataDeskNodeType type)
+{
+    DataDeskNode *root = ParseContextAllocateNode(context);
+    root->type = type;
+    root->string = name.string;
+    root->string_length = name.string_length;
+
+    if(!RequireToken(tokenizer, "{", 0))
+    {
+        ParseContextPushError(context, tokenizer, "Expected '{'.");
+        goto end_parse;
+    }
+
+    if(root->id >= context->skimmed_body_max)
+    {
+        int new_skimmed_body_max = context->graph.node_location_max;
+        context->skimmed_bodies = realloc(context->skimmed_bodies, sizeof(ParseContextSkimmedBody) * new_skimmed_body_max);
+        Assert(context->skimmed_bodies != 0);
+        context->skimmed_body_max = new_skimmed_body_max;
+    }
+    ParseContextSkimmedBody *skimmed_body = context->skimmed_bodies + root->id;
+    skimmed_body->body = tokenizer->at;
+    skimmed_body->line = tokenizer->line;
+    skimmed_body->file = context->current_file;
+    skimmed_body->scope = context->current_scope;
+
+    if(!SkipBracedBlock(tokenizer))
+    {
+        ParseContextPushError(context, tokenizer, "Expected '}'.");
+        goto end_parse;
     }
+    ParseContextSetNodeEnd(context, tokenizer, root);
+    root->flags |= DATA_DESK_NODE_FLAG_skimmed;
 
     end_parse:;
     return root;
 }
 
+// Parses the body of a skimmed node, from just after its '{' to
+// its '}', in the file and scope that it was skimmed in. Returns the first
+// node in the body.
+static DataDeskNode *
+ParseSkimmedBody(ParseContext *context, DataDeskNode *root)
+{
+    DataDeskNode *first = 0;
+    ParseContextSkimmedBody *skimmed_body = context->skimmed_bodies + root->id;
+
+    Tokenizer tokenizer = {0};
+    {
+        tokenizer.at = skimmed_body->body;
+        tokenizer.filename = context->graph.files[skimmed_body->file].filename;
+        tokenizer.line = skimmed_body->line;
+    }
+
+    int parent_scope = context->current_scope;
+    context->current_scope = skimmed_body->scope;
+    switch(root->type)
+    {
+        case DATA_DESK_NODE_TYPE_struct_declaration:
+        case DATA_DESK_NODE_TYPE_union_declaration:
+        {
+            first = ParseDeclarationList(context, &tokenizer);
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_enum_declaration:
+        case DATA_DESK_NODE_TYPE_flags_declaration:
+        {
+            first = ParseIdentifierList(context, &tokenizer);
+            break;
+        }
+        default: break;
+    }
+    context->current_scope = parent_scope;
+
+    if(!context->error_stack_size && !RequireToken(&tokenizer, "}", 0))
+    {
+        ParseContextPushError(context, &tokenizer, "Expected '}'.");
+    }
+
+    return first;
+}
+
 /*
 Copyright 2019 Ryan Fleury
 
@@ -0,0 +1,886 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Data Desk
+
+Author  : Ryan Fleury
+Updated : 5 December 2019
+License : MIT, at end of file.
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// With --cache-dir, the nodes that ParseCode produces for a file
+// are stored in the cache directory, under a key made from the file's
+// contents, the Data Desk version, and the options that change how files
+// are parsed. When a file with the same key is parsed again, its nodes are
+// loaded from there instead, and everything else that parsing it would have
+// done (adding symbols and scopes, and importing files) is done by walking
+// the loaded nodes. Nothing after parsing (indexing, symbol patching, and so
+// on) is cached, so it still runs over every file.
+//
+// Files aren't cached if parsing them reported an error, or if an @If or
+// @Unless condition in them looked up a constant (which could come from
+// another file).
+
+#define PARSE_CACHE_MAGIC   0x43504444 /* "DDPC" */
+#define PARSE_CACHE_VERSION 3
+
+typedef struct ParseCacheHeader ParseCacheHeader;
+struct ParseCacheHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned long long key;
+    unsigned int contents_length;
+    unsigned int node_count;
+    unsigned int import_count;
+    unsigned int string_pool_size;
+};
+
+enum
+{
+    PARSE_CACHE_STRING_none,
+    PARSE_CACHE_STRING_contents,
+    PARSE_CACHE_STRING_pool,
+};
+
+// Strings point either into the file's contents (which are loaded
+// anyway, to compute the key) or into the entry's string pool.
+typedef struct ParseCacheString ParseCacheString;
+struct ParseCacheString
+{
+    unsigned int source;
+    unsigned int offset;
+    unsigned int length;
+};
+
+// Nodes refer to each other by index; index 0 means "no node", and
+// the file's first top-level node is index 1. Locations are stored as they
+// were left by parsing, before the graph is indexed, which can set an end
+// (like a closing brace) without a start; location_flags says which are set.
+enum
+{
+    PARSE_CACHE_LOCATION_start = (1<<0),
+    PARSE_CACHE_LOCATION_end   = (1<<1),
+};
+
+typedef struct ParseCacheNode ParseCacheNode;
+struct ParseCacheNode
+{
+    unsigned int type;
+    unsigned int flags;
+    unsigned int next;
+    unsigned int first_tag;
+    ParseCacheString string;
+    unsigned int references[4];
+    int value;
+    unsigned int location_flags;
+    unsigned int start_offset;
+    unsigned int end_offset;
+    unsigned int skimmed_body;
+    unsigned int skimmed_line;
+};
+
+typedef struct ParseCacheImportRecord ParseCacheImportRecord;
+struct ParseCacheImportRecord
+{
+    int declaration_count;
+    int line;
+    ParseCacheString path;
+};
+
+// Returns the addresses of the fields of a node that refer to
+// other nodes (other than next and first_tag), and of the one that holds a
+// value that isn't filled out later (if any). Symbols, tag IDs, and
+// namespace scopes are filled out later, so they're never stored.
+static int
+ParseCacheGetNodeFields(DataDeskNode *node, DataDeskNode **references[4], int **value)
+{
+    int reference_count = 0;
+    *value = 0;
+    switch(node->type)
+    {
+        case DATA_DESK_NODE_TYPE_unary_operator:
+        {
+            *value = (int *)&node->unary_operator.type;
+            references[reference_count++] = &node->unary_operator.operand;
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_binary_operator:
+        {
+            *value = (int *)&node->binary_operator.type;
+            references[reference_count++] = &node->binary_operator.left;
+            references[reference_count++] = &node->binary_operator.right;
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_struct_declaration:
+        {
+            references[reference_count++] = &node->struct_declaration.first_member;
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_union_declaration:
+        {
+            references[reference_count++] = &node->union_declaration.first_member;
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_enum_declaration:
+        {
+            references[reference_count++] = &node->enum_declaration.first_constant;
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_flags_declaration:
+        {
+            references[reference_count++] = &node->flags_declaration.first_flag;
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_declaration:
+        {
+            references[reference_count++] = &node->declaration.type;
+            references[reference_count++] = &node->declaration.initialization;
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_type_usage:
+        {
+            *value = &node->type_usage.pointer_count;
+            references[reference_count++] = &node->type_usage.first_array_size_expression;
+            references[reference_count++] = &node->type_usage.struct_declaration;
+            references[reference_count++] = &node->type_usage.union_declaration;
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_tag:
+        {
+            references[reference_count++] = &node->tag.first_tag_parameter;
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_constant_definition:
+        {
+            references[reference_count++] = &node->constant_definition.expression;
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_procedure_header:
+        {
+            references[reference_count++] = &node->procedure_header.return_type;
+            references[reference_count++] = &node->procedure_header.first_parameter;
+            break;
+        }
+        case DATA_DESK_NODE_TYPE_namespace_declaration:
+        {
+            references[reference_count++] = &node->namespace_declaration.first_member;
+            break;
+        }
+        default: break;
+    }
+    return reference_count;
+}
+
+static unsigned long long
+ParseCacheKey(ParseContext *context, DataDeskSourceFile *file)
+{
+    char *version = DATA_DESK_VERSION_STRING;
+    unsigned long long key = _DataDeskHashBytes(0, version, CalculateCStringLength(version));
+    key = _DataDeskHashMix(key, PARSE_CACHE_VERSION);
+    key = _DataDeskHashMix(key, (unsigned long long)context->skim);
+    key = _DataDeskHashMix(key, (unsigned long long)context->hash_cons);
+    for(int i = 0; i < context->define_count; ++i)
+    {
+        key = _DataDeskHashBytes(key, context->define_names[i], context->define_name_lengths[i]);
+        key = _DataDeskHashMix(key, (unsigned long long)context->define_values[i]);
+    }
+    key = _DataDeskHashBytes(key, file->contents, file->contents_length);
+    return key;
+}
+
+static char *
+ParseCacheGetEntryPath(ParseContext *context, unsigned long long key)
+{
+    int path_size = CalculateCStringLength(context->cache_dir) + 32;
+    char *path = malloc(path_size);
+    Assert(path != 0);
+    snprintf(path, path_size, "%s/%016llx.ddc", context->cache_dir, key);
+    return path;
+}
+
+static void
+ParseCacheRecordImport(ParseContext *context, Tokenizer *tokenizer, char *path, int path_length)
+{
+    ParseCacheRecorder *recorder = context->parse_cache_recorder;
+    if(recorder)
+    {
+        if(recorder->import_count >= recorder->import_max)
+        {
+            recorder->import_max = recorder->import_max ? recorder->import_max * 2 : 8;
+            recorder->imports = realloc(recorder->imports, sizeof(ParseCacheImport) * recorder->import_max);
+            Assert(recorder->imports != 0);
+        }
+        ParseCacheImport *import = recorder->imports + recorder->import_count++;
+        import->declaration_count = recorder->declaration_count;
+        import->line = tokenizer->line;
+        import->path = path;
+        import->path_length = path_length;
+    }
+}
+
+typedef struct ParseCacheWriter ParseCacheWriter;
+struct ParseCacheWriter
+{
+    DataDeskSourceFile *file;
+
+    // Indexed by node ID; holds each node's index in the entry.
+    unsigned int *node_indices;
+
+    unsigned int node_count;
+    unsigned int node_max;
+    DataDeskNode **nodes;
+
+    unsigned int string_pool_size;
+    unsigned int string_pool_max;
+    char *string_pool;
+};
+
+static unsigned int
+ParseCacheWriterAddNode(ParseCacheWriter *writer, DataDeskNode *node)
+{
+    unsigned int index = 0;
+    if(node)
+    {
+        index = writer->node_indices[node->id];
+        if(!index)
+        {
+            if(writer->node_count + 1 >= writer->node_max)
+            {
+                writer->node_max = writer->node_max ? writer->node_max * 2 : 1024;
+                writer->nodes = realloc(writer->nodes, sizeof(DataDeskNode *) * writer->node_max);
+                Assert(writer->nodes != 0);
+            }
+            index = ++writer->node_count;
+            writer->nodes[index] = node;
+            writer->node_indices[node->id] = index;
+        }
+    }
+    return index;
+}
+
+static ParseCacheString
+ParseCacheWriterAddString(ParseCacheWriter *writer, char *string, int string_length)
+{
+    ParseCacheString result = {0};
+    if(string)
+    {
+        result.length = string_length;
+        if(string >= writer->file->contents && string + string_length <= writer->file->contents + writer->file->contents_length)
+        {
+            result.source = PARSE_CACHE_STRING_contents;
+            result.offset = (unsigned int)(string - writer->file->contents);
+        }
+        else
+        {
+            while(writer->string_pool_size + string_length > writer->string_pool_max)
+            {
+                writer->string_pool_max = writer->string_pool_max ? writer->string_pool_max * 2 : 1024;
+                writer->string_pool = realloc(writer->string_pool, writer->string_pool_max);
+                Assert(writer->string_pool != 0);
+            }
+            result.source = PARSE_CACHE_STRING_pool;
+            result.offset = writer->string_pool_size;
+            MemoryCopy(writer->string_pool + writer->string_pool_size, string, string_length);
+            writer->string_pool_size += string_length;
+        }
+    }
+    return result;
+}
+
+// Returns a heap-allocated entry holding the nodes that were just
+// parsed for the current file.
+static char *
+ParseCacheBuildEntry(ParseContext *context, unsigned long long key, DataDeskNode *root, ParseCacheRecorder *recorder,
+                     unsigned int *entry_size)
+{
+    ParseCacheWriter writer = {0};
+    writer.file = context->graph.files + context->current_file;
+    writer.node_indices = calloc(context->graph.node_count + 1, sizeof(unsigned int));
+    Assert(writer.node_indices != 0);
+
+    // Nodes are numbered in the order they're found, starting with
+    // the top-level list, so the first top-level node is always index 1.
+    // Shared nodes (see --share-nodes) are only stored once.
+    ParseCacheWriterAddNode(&writer, root);
+    ParseCacheNode *records = 0;
+    for(unsigned int i = 1; i <= writer.node_count; ++i)
+    {
+        DataDeskNode *node = writer.nodes[i];
+        ParseCacheWriterAddNode(&writer, node->next);
+        ParseCacheWriterAddNode(&writer, node->first_tag);
+        DataDeskNode **references[4];
+        int *value = 0;
+        int reference_count = ParseCacheGetNodeFields(node, references, &value);
+        for(int j = 0; j < reference_count; ++j)
+        {
+            ParseCacheWriterAddNode(&writer, *references[j]);
+        }
+    }
+
+    records = calloc(writer.node_count + 1, sizeof(ParseCacheNode));
+    Assert(records != 0);
+    for(unsigned int i = 1; i <= writer.node_count; ++i)
+    {
+        DataDeskNode *node = writer.nodes[i];
+        ParseCacheNode *record = records + i;
+        DataDeskNodeLocation *location = context->graph.node_locations + node->id;
+        record->type = node->type;
+        record->flags = node->flags & (DATA_DESK_NODE_FLAG_shared | DATA_DESK_NODE_FLAG_skimmed);
+        record->next = writer.node_indices[node->next ? node->next->id : 0];
+        record->first_tag = writer.node_indices[node->first_tag ? node->first_tag->id : 0];
+        record->string = ParseCacheWriterAddString(&writer, node->string, node->string_length);
+
+        DataDeskNode **references[4];
+        int *value = 0;
+        int reference_count = ParseCacheGetNodeFields(node, references, &value);
+        for(int j = 0; j < reference_count; ++j)
+        {
+            record->references[j] = *references[j] ? writer.node_indices[(*references[j])->id] : 0;
+        }
+        record->value = value ? *value : 0;
+
+        if(location->file == context->current_file)
+        {
+            record->location_flags = PARSE_CACHE_LOCATION_start | PARSE_CACHE_LOCATION_end;
+            record->start_offset = location->start_offset;
+            record->end_offset = location->end_offset;
+        }
+        else if(!location->file && location->end_offset)
+        {
+            record->location_flags = PARSE_CACHE_LOCATION_end;
+            record->end_offset = location->end_offset;
+        }
+
+        if(node->flags & DATA_DESK_NODE_FLAG_skimmed)
+        {
+            ParseContextSkimmedBody *skimmed_body = context->skimmed_bodies + node->id;
+            record->skimmed_body = (unsigned int)(skimmed_body->body - writer.file->contents);
+            record->skimmed_line = skimmed_body->line;
+        }
+    }
+
+    ParseCacheImportRecord *imports = calloc(recorder->import_count + 1, sizeof(ParseCacheImportRecord));
+    Assert(imports != 0);
+    for(int i = 0; i < recorder->import_count; ++i)
+    {
+        imports[i].declaration_count = recorder->imports[i].declaration_count;
+        imports[i].line = recorder->imports[i].line;
+        imports[i].path = ParseCacheWriterAddString(&writer, recorder->imports[i].path, recorder->imports[i].path_length);
+    }
+
+    ParseCacheHeader header = {0};
+    header.magic = PARSE_CACHE_MAGIC;
+    header.version = PARSE_CACHE_VERSION;
+    header.key = key;
+    header.contents_length = writer.file->contents_length;
+    header.node_count = writer.node_count;
+    header.import_count = recorder->import_count;
+    header.string_pool_size = writer.string_pool_size;
+
+    unsigned int records_size = sizeof(ParseCacheNode) * writer.node_count;
+    unsigned int imports_size = sizeof(ParseCacheImportRecord) * recorder->import_count;
+    *entry_size = sizeof(header) + records_size + imports_size + writer.string_pool_size;
+    char *entry = malloc(*entry_size);
+    Assert(entry != 0);
+    MemoryCopy(entry, &header, sizeof(header));
+    MemoryCopy(entry + sizeof(header), records + 1, records_size);
+    MemoryCopy(entry + sizeof(header) + records_size, imports, imports_size);
+    if(writer.string_pool_size)
+    {
+        MemoryCopy(entry + sizeof(header) + records_size + imports_size, writer.string_pool, writer.string_pool_size);
+    }
+
+    free(imports);
+    free(records);
+    free(writer.node_indices);
+    free(writer.nodes);
+    free(writer.string_pool);
+    return entry;
+}
+
+static void
+ParseCacheWriteEntry(char *path, char *entry, unsigned int entry_size)
+{
+    // Entries are written to a file of their own first, and then
+    // moved into place, so that runs that share a cache directory never read
+    // a partly written entry.
+    int temporary_path_size = CalculateCStringLength(path) + 32;
+    char *temporary_path = malloc(temporary_path_size);
+    Assert(temporary_path != 0);
+    snprintf(temporary_path, temporary_path_size, "%s.%u.tmp", path, GetProcessID());
+
+    FILE *file = fopen(temporary_path, "wb");
+    if(file)
+    {
+        fwrite(entry, 1, entry_size, file);
+        int success = !ferror(file);
+        success = !fclose(file) && success;
+        if(!success || !ReplaceFileWith(path, temporary_path))
+        {
+            remove(temporary_path);
+            LogError("WARNING: Could not write parse cache entry \"%s\".", path);
+        }
+    }
+    else
+    {
+        LogError("WARNING: Could not write parse cache entry \"%s\".", path);
+    }
+
+    free(temporary_path);
+}
+
+static char *
+ParseCacheReadEntry(char *path, unsigned int *entry_size)
+{
+    char *entry = 0;
+    FILE *file = fopen(path, "rb");
+    if(file)
+    {
+        fseek(file, 0, SEEK_END);
+        *entry_size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        entry = malloc(*entry_size ? *entry_size : 1);
+        if(entry && fread(entry, 1, *entry_size, file) != *entry_size)
+        {
+            free(entry);
+            entry = 0;
+        }
+        fclose(file);
+    }
+    return entry;
+}
+
+static int
+ParseCacheStringIsValid(ParseCacheString string, unsigned int contents_length, unsigned int string_pool_size)
+{
+    int valid = 0;
+    switch(string.source)
+    {
+        case PARSE_CACHE_STRING_none:     { valid = 1; break; }
+        case PARSE_CACHE_STRING_contents: { valid = string.offset <= contents_length && string.length <= contents_length - string.offset; break; }
+        case PARSE_CACHE_STRING_pool:     { valid = string.offset <= string_pool_size && string.length <= string_pool_size - string.offset; break; }
+        default: break;
+    }
+    return valid;
+}
+
+static char *
+ParseCacheGetString(ParseCacheString string, char *contents, char *string_pool)
+{
+    char *result = 0;
+    switch(string.source)
+    {
+        case PARSE_CACHE_STRING_contents: { result = contents + string.offset; break; }
+        case PARSE_CACHE_STRING_pool:     { result = string_pool + string.offset; break; }
+        default: break;
+    }
+    return result;
+}
+
+typedef struct ParseCacheReplay ParseCacheReplay;
+struct ParseCacheReplay
+{
+    Tokenizer *tokenizer;
+    int declaration_count;
+    int import_count;
+    int next_import;
+    ParseCacheImport *imports;
+};
+
+// Imports the files that were imported before the current
+// declaration when the file was parsed.
+static void
+ParseCacheReplayImports(ParseContext *context, ParseCacheReplay *replay)
+{
+    while(replay->next_import < replay->import_count &&
+          replay->imports[replay->next_import].declaration_count <= replay->declaration_count)
+    {
+        ParseCacheImport *import = replay->imports + replay->next_import++;
+        replay->tokenizer->line = import->line;
+        ImportFile(context, replay->tokenizer, import->path, import->path_length);
+    }
+}
+
+// Does what ParseCode does with each node it adds to a list, in
+// the same order.
+static void
+ParseCacheReplayDeclarations(ParseContext *context, ParseCacheReplay *replay, DataDeskNode *first)
+{
+    for(DataDeskNode *node = first; node; node = node->next)
+    {
+        ParseCacheReplayImports(context, replay);
+
+        int adds_symbol = 0;
+        switch(node->type)
+        {
+            case DATA_DESK_NODE_TYPE_struct_declaration:
+            case DATA_DESK_NODE_TYPE_union_declaration:
+            case DATA_DESK_NODE_TYPE_enum_declaration:
+            case DATA_DESK_NODE_TYPE_flags_declaration:
+            case DATA_DESK_NODE_TYPE_declaration:
+            case DATA_DESK_NODE_TYPE_constant_definition:
+            case DATA_DESK_NODE_TYPE_procedure_header:
+            {
+                adds_symbol = 1;
+                break;
+            }
+            case DATA_DESK_NODE_TYPE_namespace_declaration:
+            {
+                DataDeskNode *existing = ParseContextSymbolTableLookUp(&context->scopes[context->current_scope].symbols,
+                                                                       node->string, node->string_length, 0);
+                if(existing && existing->type == DATA_DESK_NODE_TYPE_namespace_declaration)
+                {
+                    node->namespace_declaration.scope = existing->namespace_declaration.scope;
+                }
+                else
+                {
+                    node->namespace_declaration.scope = ParseContextAddScope(context, context->current_scope, node);
+                }
+
+                int parent_scope = context->current_scope;
+                context->current_scope = node->namespace_declaration.scope;
+                ParseCacheReplayDeclarations(context, replay, node->namespace_declaration.first_member);
+                ParseCacheReplayImports(context, replay);
+                context->current_scope = parent_scope;
+
+                adds_symbol = context->scopes[node->namespace_declaration.scope].node == node;
+                break;
+            }
+            default: break;
+        }
+
+        if(node->flags & DATA_DESK_NODE_FLAG_skimmed)
+        {
+            context->skimmed_bodies[node->id].scope = context->current_scope;
+        }
+
+        if(adds_symbol &&
+           ParseContextAddSymbol(context, node->string, node->string_length, node) == PARSE_CONTEXT_ADD_SYMBOL_ALREADY_DEFINED)
+        {
+            replay->tokenizer->line = DataDeskGetNodeLocation(&context->graph, node).line;
+            ParseContextPushError(context, replay->tokenizer, "\"%.*s\" has already been defined.", node->string_length, node->string);
+        }
+
+        ++replay->declaration_count;
+    }
+}
+
+// Returns 1 (and the file's first top-level node) if the entry
+// holds the current file's nodes.
+static int
+ParseCacheLoadEntry(ParseContext *context, Tokenizer *tokenizer, char *entry, unsigned int entry_size,
+                    unsigned long long key, DataDeskNode **root)
+{
+    int loaded = 0;
+    DataDeskSourceFile *source_file = context->graph.files + context->current_file;
+    unsigned int contents_length = source_file->contents_length;
+
+    // Entries are checked in full before anything is built from
+    // them, so a damaged entry is just a miss.
+    ParseCacheHeader *header = (ParseCacheHeader *)entry;
+    int valid = (entry && entry_size >= sizeof(ParseCacheHeader) &&
+                 header->magic == PARSE_CACHE_MAGIC &&
+                 header->version == PARSE_CACHE_VERSION &&
+                 header->key == key &&
+                 header->contents_length == contents_length &&
+                 header->node_count <= (entry_size - sizeof(ParseCacheHeader)) / sizeof(ParseCacheNode));
+
+    ParseCacheNode *records = 0;
+    ParseCacheImportRecord *import_records = 0;
+    char *string_pool = 0;
+    if(valid)
+    {
+        unsigned int remaining = entry_size - sizeof(ParseCacheHeader) - header->node_count * sizeof(ParseCacheNode);
+        valid = (header->import_count <= remaining / sizeof(ParseCacheImportRecord) &&
+                 header->string_pool_size == remaining - header->import_count * sizeof(ParseCacheImportRecord));
+
+        // Records are numbered from 1.
+        records = (ParseCacheNode *)(entry + sizeof(ParseCacheHeader)) - 1;
+        import_records = (ParseCacheImportRecord *)(entry + sizeof(ParseCacheHeader) + header->node_count * sizeof(ParseCacheNode));
+        string_pool = (char *)(import_records + header->import_count);
+    }
+
+    for(unsigned int i = 1; valid && i <= header->node_count; ++i)
+    {
+        ParseCacheNode *record = records + i;
+        valid = (record->type > DATA_DESK_NODE_TYPE_invalid && record->type < DATA_DESK_NODE_TYPE_MAX &&
+                 record->next <= header->node_count && record->first_tag <= header->node_count &&
+                 record->start_offset <= contents_length && record->end_offset <= contents_length &&
+                 record->skimmed_body <= contents_length &&
+                 ParseCacheStringIsValid(record->string, contents_length, header->string_pool_size));
+        for(int j = 0; valid && j < 4; ++j)
+        {
+            valid = record->references[j] <= header->node_count;
+        }
+    }
+    for(unsigned int i = 0; valid && i < header->import_count; ++i)
+    {
+        valid = ParseCacheStringIsValid(import_records[i].path, contents_length, header->string_pool_size);
+    }
+
+    if(valid)
+    {
+        char *persistent_string_pool = ParseContextAllocateMemory(context, header->string_pool_size + 1);
+        MemoryCopy(persistent_string_pool, string_pool, header->string_pool_size);
+
+        DataDeskNode **nodes = malloc(sizeof(DataDeskNode *) * (header->node_count + 1));
+        Assert(nodes != 0);
+        nodes[0] = 0;
+        for(unsigned int i = 1; i <= header->node_count; ++i)
+        {
+            nodes[i] = ParseContextAllocateNode(context);
+        }
+
+        for(unsigned int i = 1; i <= header->node_count; ++i)
+        {
+            ParseCacheNode *record = records + i;
+            DataDeskNode *node = nodes[i];
+            node->type = record->type;
+            node->flags = record->flags;
+            node->next = nodes[record->next];
+            node->first_tag = nodes[record->first_tag];
+            node->string = ParseCacheGetString(record->string, source_file->contents, persistent_string_pool);
+            node->string_length = record->string.length;
+
+            DataDeskNode **references[4];
+            int *value = 0;
+            int reference_count = ParseCacheGetNodeFields(node, references, &value);
+            for(int j = 0; j < reference_count; ++j)
+            {
+                *references[j] = nodes[record->references[j]];
+            }
+            if(value)
+            {
+                *value = record->value;
+            }
+
+            DataDeskNodeLocation *location = context->graph.node_locations + node->id;
+            if(record->location_flags & PARSE_CACHE_LOCATION_start)
+            {
+                location->file = context->current_file;
+                location->start_offset = record->start_offset;
+            }
+            if(record->location_flags & PARSE_CACHE_LOCATION_end)
+            {
+                location->end_offset = record->end_offset;
+            }
+
+            if(node->flags & DATA_DESK_NODE_FLAG_skimmed)
+            {
+                if(node->id >= context->skimmed_body_max)
+                {
+                    int new_skimmed_body_max = context->graph.node_location_max;
+                    context->skimmed_bodies = realloc(context->skimmed_bodies, sizeof(ParseContextSkimmedBody) * new_skimmed_body_max);
+                    Assert(context->skimmed_bodies != 0);
+                    context->skimmed_body_max = new_skimmed_body_max;
+                }
+                ParseContextSkimmedBody *skimmed_body = context->skimmed_bodies + node->id;
+                skimmed_body->body = source_file->contents + record->skimmed_body;
+                skimmed_body->line = record->skimmed_line;
+                skimmed_body->file = context->current_file;
+                skimmed_body->scope = context->current_scope;
+            }
+        }
+
+        ParseCacheImport *imports = calloc(header->import_count + 1, sizeof(ParseCacheImport));
+        Assert(imports != 0);
+        for(unsigned int i = 0; i < header->import_count; ++i)
+        {
+            imports[i].declaration_count = import_records[i].declaration_count;
+            imports[i].line = import_records[i].line;
+            imports[i].path = ParseCacheGetString(import_records[i].path, source_file->contents, persistent_string_pool);
+            imports[i].path_length = import_records[i].path.length;
+        }
+
+        ParseCacheReplay replay = {0};
+        replay.tokenizer = tokenizer;
+        replay.import_count = header->import_count;
+        replay.imports = imports;
+        ParseCacheReplayDeclarations(context, &replay, nodes[1 <= header->node_count ? 1 : 0]);
+        ParseCacheReplayImports(context, &replay);
+
+        *root = nodes[1 <= header->node_count ? 1 : 0];
+        loaded = 1;
+        free(imports);
+        free(nodes);
+    }
+
+    return loaded;
+}
+
+// With --watch (or --serve), entries are also kept in memory
+// between runs, so only the files that changed are parsed again. Entries that
+// a run didn't use are dropped after it (or, with --serve, after a number of
+// requests that didn't use them).
+struct ParseCacheMemory
+{
+    int entry_count;
+    int entry_max;
+    ParseCacheMemoryEntry *entries;
+};
+
+struct ParseCacheMemoryEntry
+{
+    unsigned long long key;
+    unsigned int size;
+    int used;
+    char *data;
+};
+
+static ParseCacheMemoryEntry *
+ParseCacheMemoryLookUp(ParseCacheMemory *memory, unsigned long long key)
+{
+    ParseCacheMemoryEntry *entry = 0;
+    for(int i = 0; i < memory->entry_count; ++i)
+    {
+        if(memory->entries[i].key == key)
+        {
+            entry = memory->entries + i;
+            break;
+        }
+    }
+    return entry;
+}
+
+// Takes ownership of data.
+static void
+ParseCacheMemoryAdd(ParseCacheMemory *memory, unsigned long long key, char *data, unsigned int size)
+{
+    if(memory->entry_count >= memory->entry_max)
+    {
+        memory->entry_max = memory->entry_max ? memory->entry_max * 2 : 16;
+        memory->entries = realloc(memory->entries, sizeof(ParseCacheMemoryEntry) * memory->entry_max);
+        Assert(memory->entries != 0);
+    }
+    ParseCacheMemoryEntry *entry = memory->entries + memory->entry_count++;
+    entry->key = key;
+    entry->size = size;
+    entry->used = 1;
+    entry->data = data;
+}
+
+static void
+ParseCacheMemoryDropUnused(ParseCacheMemory *memory)
+{
+    int kept_count = 0;
+    for(int i = 0; i < memory->entry_count; ++i)
+    {
+        if(memory->entries[i].used)
+        {
+            memory->entries[kept_count] = memory->entries[i];
+            memory->entries[kept_count].used = 0;
+            ++kept_count;
+        }
+        else
+        {
+            free(memory->entries[i].data);
+        }
+    }
+    memory->entry_count = kept_count;
+}
+
+static void
+ParseCacheMemoryFree(ParseCacheMemory *memory)
+{
+    for(int i = 0; i < memory->entry_count; ++i)
+    {
+        free(memory->entries[i].data);
+    }
+    free(memory->entries);
+    MemorySet(memory, 0, sizeof(*memory));
+}
+
+// Parses the current file (whose contents the tokenizer is at the
+// start of), or loads it from the cache with --cache-dir or --watch.
+static DataDeskNode *
+ParseFileCode(ParseContext *context, Tokenizer *tokenizer)
+{
+    DataDeskNode *root = 0;
+    if(context->cache_dir || context->memory_cache)
+    {
+        unsigned long long key = ParseCacheKey(context, context->graph.files + context->current_file);
+        char *path = context->cache_dir ? ParseCacheGetEntryPath(context, key) : 0;
+        int loaded = 0;
+
+        ParseCacheMemoryEntry *memory_entry = context->memory_cache ? ParseCacheMemoryLookUp(context->memory_cache, key) : 0;
+        if(memory_entry)
+        {
+            loaded = ParseCacheLoadEntry(context, tokenizer, memory_entry->data, memory_entry->size, key, &root);
+            memory_entry->used = 1;
+        }
+
+        if(!loaded && path)
+        {
+            unsigned int entry_size = 0;
+            char *entry = ParseCacheReadEntry(path, &entry_size);
+            loaded = entry && ParseCacheLoadEntry(context, tokenizer, entry, entry_size, key, &root);
+            if(loaded && context->memory_cache)
+            {
+                ParseCacheMemoryAdd(context->memory_cache, key, entry, entry_size);
+            }
+            else
+            {
+                free(entry);
+            }
+        }
+
+        if(loaded)
+        {
+            Log("Loaded \"%s\" from the parse cache.", tokenizer->filename);
+        }
+        else
+        {
+            ParseCacheRecorder recorder = {0};
+            ParseCacheRecorder *importing_recorder = context->parse_cache_recorder;
+            context->parse_cache_recorder = &recorder;
+            root = ParseCode(context, tokenizer);
+            context->parse_cache_recorder = importing_recorder;
+
+            if(!recorder.had_errors && !recorder.uses_constants)
+            {
+                unsigned int entry_size = 0;
+                char *entry = ParseCacheBuildEntry(context, key, root, &recorder, &entry_size);
+                if(path)
+                {
+                    ParseCacheWriteEntry(path, entry, entry_size);
+                }
+                if(context->memory_cache)
+                {
+                    ParseCacheMemoryAdd(context->memory_cache, key, entry, entry_size);
+                }
+                else
+                {
+                    free(entry);
+                }
+            }
+            free(recorder.imports);
+        }
+        free(path);
+    }
+    else
+    {
+        root = ParseCode(context, tokenizer);
+    }
+    return root;
+}
+
+/*
+Copyright 2019 Ryan Fleury
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,575 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Data Desk
+
+Author  : Ryan Fleury
+Updated : 5 December 2019
+License : MIT, at end of file.
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// With --serve <socket path>, Data Desk stays resident and runs
+// requests that come in over a Unix domain socket, one at a time. Parsed files
+// are kept in memory between requests (as parse cache entries, which are keyed
+// by the contents of the file, so an edited file is always parsed again), and
+// so are custom layers (which are reloaded when they're rebuilt).
+//
+// With --connect <socket path>, Data Desk sends the rest of its command line
+// (and its working directory) to a server instead of running it. The client's
+// standard output and error are passed along with the request, so everything
+// the server and the custom layer print goes straight to them, and the client
+// exits with the exit code of the run. If there's no server, the client runs
+// the request itself.
+//
+// A request is a ServerRequestHeader (sent with the two file descriptors),
+// followed by the working directory and then each argument, all
+// null-terminated. The reply is a ServerReply.
+
+#define SERVER_PROTOCOL_MAGIC   0x52534444
+#define SERVER_PROTOCOL_VERSION 1
+#define SERVER_REQUEST_MAX_SIZE (16*1024*1024)
+
+// Every so many requests, parsed files that no request has used
+// since the last time are dropped.
+#define SERVER_PARSE_CACHE_SWEEP_INTERVAL 64
+
+typedef struct ServerRequestHeader ServerRequestHeader;
+struct ServerRequestHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int argument_count;
+    unsigned int size;
+};
+
+typedef struct ServerReply ServerReply;
+struct ServerReply
+{
+    int exit_code;
+};
+
+typedef struct ServerRequest ServerRequest;
+struct ServerRequest
+{
+    char *data;
+    char *working_directory;
+    int argument_count;
+    char **arguments;
+
+#if BUILD_LINUX
+    int connection;
+    int output_file;
+    int error_file;
+#endif
+};
+
+typedef struct ServerCustomLayer ServerCustomLayer;
+struct ServerCustomLayer
+{
+    char *canonical_path;
+    DataDeskCustom custom;
+};
+
+typedef struct Server Server;
+struct Server
+{
+    char *socket_path;
+    int request_count;
+    ParseCacheMemory memory_cache;
+
+    int custom_layer_count;
+    int custom_layer_max;
+    ServerCustomLayer *custom_layers;
+
+#if BUILD_LINUX
+    int socket;
+    int saved_output_file;
+    int saved_error_file;
+    char *working_directory;
+#endif
+};
+
+#if BUILD_LINUX
+
+static int
+SocketSendAll(int socket, void *data, unsigned int size)
+{
+    char *bytes = data;
+    while(size > 0)
+    {
+        ssize_t bytes_sent = send(socket, bytes, size, MSG_NOSIGNAL);
+        if(bytes_sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(bytes_sent <= 0)
+        {
+            break;
+        }
+        bytes += bytes_sent;
+        size -= (unsigned int)bytes_sent;
+    }
+    return size == 0;
+}
+
+static int
+SocketReceiveAll(int socket, void *data, unsigned int size)
+{
+    char *bytes = data;
+    while(size > 0)
+    {
+        ssize_t bytes_received = recv(socket, bytes, size, 0);
+        if(bytes_received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(bytes_received <= 0)
+        {
+            break;
+        }
+        bytes += bytes_received;
+        size -= (unsigned int)bytes_received;
+    }
+    return size == 0;
+}
+
+// Returns 0 if the path doesn't fit in a socket address.
+static int
+SocketMakeAddress(char *socket_path, struct sockaddr_un *address)
+{
+    int success = 0;
+    int path_length = CalculateCStringLength(socket_path);
+    MemorySet(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if(path_length < (int)sizeof(address->sun_path))
+    {
+        MemoryCopy(address->sun_path, socket_path, path_length + 1);
+        success = 1;
+    }
+    else
+    {
+        LogError("ERROR: The socket path \"%s\" is too long.", socket_path);
+    }
+    return success;
+}
+
+static int
+SocketConnect(char *socket_path)
+{
+    int connection = -1;
+    struct sockaddr_un address;
+    if(SocketMakeAddress(socket_path, &address))
+    {
+        connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(connection >= 0 && connect(connection, (struct sockaddr *)&address, sizeof(address)) != 0)
+        {
+            close(connection);
+            connection = -1;
+        }
+    }
+    return connection;
+}
+
+#endif
+
+static int
+ServerOpen(Server *server, char *socket_path)
+{
+    int success = 0;
+    MemorySet(server, 0, sizeof(*server));
+    server->socket_path = socket_path;
+
+#if BUILD_WIN32
+    LogError("ERROR: --serve is only supported on Linux.");
+#elif BUILD_LINUX
+    server->socket = -1;
+    struct sockaddr_un address;
+    if(SocketMakeAddress(socket_path, &address))
+    {
+        // A socket file that nothing is listening on is left over
+        // from a server that didn't exit cleanly, so it's replaced.
+        int existing_server = SocketConnect(socket_path);
+        if(existing_server >= 0)
+        {
+            close(existing_server);
+            LogError("ERROR: A server is already listening at \"%s\".", socket_path);
+        }
+        else
+        {
+            unlink(socket_path);
+            server->socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if(server->socket >= 0 &&
+               bind(server->socket, (struct sockaddr *)&address, sizeof(address)) == 0 &&
+               listen(server->socket, SOMAXCONN) == 0)
+            {
+                server->saved_output_file = dup(1);
+                server->saved_error_file = dup(2);
+                server->working_directory = getcwd(0, 0);
+                signal(SIGPIPE, SIG_IGN);
+                success = server->saved_output_file >= 0 && server->saved_error_file >= 0 && server->working_directory;
+            }
+            if(!success)
+            {
+                LogError("ERROR: Could not listen at \"%s\".", socket_path);
+            }
+        }
+    }
+#endif
+
+    return success;
+}
+
+static void
+ServerClose(Server *server)
+{
+    for(int i = 0; i < server->custom_layer_count; ++i)
+    {
+        DataDeskCustomUnload(&server->custom_layers[i].custom);
+        free(server->custom_layers[i].canonical_path);
+    }
+    free(server->custom_layers);
+    ParseCacheMemoryFree(&server->memory_cache);
+
+#if BUILD_LINUX
+    if(server->socket >= 0)
+    {
+        close(server->socket);
+        unlink(server->socket_path);
+    }
+    free(server->working_directory);
+#endif
+
+    MemorySet(server, 0, sizeof(*server));
+}
+
+static void
+ServerFreeRequest(ServerRequest *request)
+{
+#if BUILD_LINUX
+    if(request->connection >= 0)
+    {
+        close(request->connection);
+    }
+    if(request->output_file >= 0)
+    {
+        close(request->output_file);
+    }
+    if(request->error_file >= 0)
+    {
+        close(request->error_file);
+    }
+#endif
+    free(request->data);
+    free(request->arguments);
+    MemorySet(request, 0, sizeof(*request));
+}
+
+// Waits for the next well-formed request. Returns 0 if the server
+// can't accept any more.
+static int
+ServerAcceptRequest(Server *server, ServerRequest *request)
+{
+    int success = 0;
+    MemorySet(request, 0, sizeof(*request));
+
+#if BUILD_LINUX
+    while(!success)
+    {
+        request->connection = accept(server->socket, 0, 0);
+        request->output_file = -1;
+        request->error_file = -1;
+        if(request->connection < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            break;
+        }
+
+        ServerRequestHeader header = {0};
+        struct iovec header_vector = {&header, sizeof(header)};
+        union
+        {
+            struct cmsghdr header;
+            char buffer[CMSG_SPACE(sizeof(int) * 2)];
+        }
+        control;
+        struct msghdr message = {0};
+        message.msg_iov = &header_vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+
+        if(recvmsg(request->connection, &message, MSG_CMSG_CLOEXEC) == sizeof(header))
+        {
+            struct cmsghdr *control_message = CMSG_FIRSTHDR(&message);
+            if(control_message && control_message->cmsg_level == SOL_SOCKET &&
+               control_message->cmsg_type == SCM_RIGHTS &&
+               control_message->cmsg_len == CMSG_LEN(sizeof(int) * 2))
+            {
+                int files[2];
+                MemoryCopy(files, CMSG_DATA(control_message), sizeof(files));
+                request->output_file = files[0];
+                request->error_file = files[1];
+            }
+        }
+
+        if(request->output_file >= 0 &&
+           header.magic == SERVER_PROTOCOL_MAGIC &&
+           header.version == SERVER_PROTOCOL_VERSION &&
+           header.size > 0 && header.size <= SERVER_REQUEST_MAX_SIZE &&
+           header.argument_count > 0 && header.argument_count < header.size)
+        {
+            request->data = malloc(header.size);
+            request->arguments = malloc(sizeof(char *) * (header.argument_count + 1));
+            Assert(request->data != 0 && request->arguments != 0);
+            if(SocketReceiveAll(request->connection, request->data, header.size) &&
+               request->data[header.size - 1] == 0)
+            {
+                // The working directory, and then the arguments.
+                int string_count = 0;
+                for(unsigned int i = 0; i < header.size; ++string_count)
+                {
+                    char *string = request->data + i;
+                    if(string_count == 0)
+                    {
+                        request->working_directory = string;
+                    }
+                    else if(string_count <= (int)header.argument_count)
+                    {
+                        request->arguments[string_count - 1] = string;
+                    }
+                    i += CalculateCStringLength(string) + 1;
+                }
+
+                if(string_count == (int)header.argument_count + 1)
+                {
+                    request->argument_count = header.argument_count;
+                    request->arguments[request->argument_count] = 0;
+                    success = 1;
+                }
+            }
+        }
+
+        if(!success)
+        {
+            Log("Ignoring a malformed request.");
+            ServerFreeRequest(request);
+        }
+    }
+#endif
+
+    return success;
+}
+
+// Moves into the client's working directory, and sends everything
+// that's printed to the client, until ServerEndRequest.
+static int
+ServerBeginRequest(Server *server, ServerRequest *request)
+{
+    int success = 0;
+#if BUILD_LINUX
+    fflush(stdout);
+    fflush(stderr);
+    success = chdir(request->working_directory) == 0;
+    if(success)
+    {
+        dup2(request->output_file, 1);
+        dup2(request->error_file, 2);
+    }
+    else
+    {
+        char *message = "ERROR: The server could not change to the working directory.\n";
+        write(request->error_file, message, CalculateCStringLength(message));
+    }
+#endif
+    return success;
+}
+
+static void
+ServerEndRequest(Server *server, ServerRequest *request, int exit_code)
+{
+#if BUILD_LINUX
+    fflush(stdout);
+    fflush(stderr);
+    dup2(server->saved_output_file, 1);
+    dup2(server->saved_error_file, 2);
+    if(chdir(server->working_directory) != 0)
+    {
+        LogError("WARNING: Could not change back to \"%s\".", server->working_directory);
+    }
+
+    ServerReply reply = {0};
+    reply.exit_code = exit_code;
+    SocketSendAll(request->connection, &reply, sizeof(reply));
+#endif
+    ServerFreeRequest(request);
+
+    if(++server->request_count % SERVER_PARSE_CACHE_SWEEP_INTERVAL == 0)
+    {
+        ParseCacheMemoryDropUnused(&server->memory_cache);
+    }
+}
+
+// Custom layers stay loaded between requests. One that has been
+// rebuilt since it was loaded is loaded again (from a new copy, see
+// DataDeskCustomLoad).
+static DataDeskCustom
+ServerLoadCustomLayer(Server *server, char *custom_dll_path)
+{
+    ServerCustomLayer *layer = 0;
+    char *canonical_path = CanonicalizePath(custom_dll_path);
+    if(canonical_path)
+    {
+        for(int i = 0; i < server->custom_layer_count; ++i)
+        {
+            if(!strcmp(server->custom_layers[i].canonical_path, canonical_path))
+            {
+                layer = server->custom_layers + i;
+                break;
+            }
+        }
+
+        if(layer)
+        {
+            unsigned long long hash = 0;
+            if(HashFileContents(canonical_path, &hash) && hash == layer->custom.file_hash)
+            {
+                Log("Custom layer \"%s\" is already loaded.", custom_dll_path);
+            }
+            else
+            {
+                Log("Reloading custom layer from \"%s\".", custom_dll_path);
+                DataDeskCustomUnload(&layer->custom);
+                layer->custom = DataDeskCustomLoad(canonical_path, 1);
+            }
+            free(canonical_path);
+        }
+        else
+        {
+            if(server->custom_layer_count >= server->custom_layer_max)
+            {
+                server->custom_layer_max = server->custom_layer_max ? server->custom_layer_max * 2 : 8;
+                server->custom_layers = realloc(server->custom_layers, sizeof(ServerCustomLayer) * server->custom_layer_max);
+                Assert(server->custom_layers != 0);
+            }
+            layer = server->custom_layers + server->custom_layer_count++;
+            layer->canonical_path = canonical_path;
+            layer->custom = DataDeskCustomLoad(canonical_path, 1);
+        }
+    }
+
+    DataDeskCustom custom = {0};
+    if(layer)
+    {
+        custom = layer->custom;
+    }
+    else
+    {
+        LogError("WARNING: Could not find the custom layer \"%s\".", custom_dll_path);
+    }
+    return custom;
+}
+
+// Returns 0 if there's no server to send the request to. Otherwise,
+// the request has been run (or the server was lost), and exit_code is set.
+static int
+ClientSendRequest(char *socket_path, int argument_count, char **arguments, int *exit_code)
+{
+    int sent = 0;
+
+#if BUILD_LINUX
+    int connection = SocketConnect(socket_path);
+    if(connection >= 0)
+    {
+        char *working_directory = getcwd(0, 0);
+        if(working_directory)
+        {
+            ServerRequestHeader header = {0};
+            header.magic = SERVER_PROTOCOL_MAGIC;
+            header.version = SERVER_PROTOCOL_VERSION;
+            header.argument_count = argument_count;
+            header.size = CalculateCStringLength(working_directory) + 1;
+            for(int i = 0; i < argument_count; ++i)
+            {
+                header.size += CalculateCStringLength(arguments[i]) + 1;
+            }
+
+            char *data = malloc(header.size);
+            Assert(data != 0);
+            int data_size = CalculateCStringLength(working_directory) + 1;
+            MemoryCopy(data, working_directory, data_size);
+            for(int i = 0; i < argument_count; ++i)
+            {
+                int argument_size = CalculateCStringLength(arguments[i]) + 1;
+                MemoryCopy(data + data_size, arguments[i], argument_size);
+                data_size += argument_size;
+            }
+
+            int files[2] = {1, 2};
+            struct iovec header_vector = {&header, sizeof(header)};
+            union
+            {
+                struct cmsghdr header;
+                char buffer[CMSG_SPACE(sizeof(files))];
+            }
+            control;
+            MemorySet(&control, 0, sizeof(control));
+            struct msghdr message = {0};
+            message.msg_iov = &header_vector;
+            message.msg_iovlen = 1;
+            message.msg_control = control.buffer;
+            message.msg_controllen = sizeof(control.buffer);
+            struct cmsghdr *control_message = CMSG_FIRSTHDR(&message);
+            control_message->cmsg_level = SOL_SOCKET;
+            control_message->cmsg_type = SCM_RIGHTS;
+            control_message->cmsg_len = CMSG_LEN(sizeof(files));
+            MemoryCopy(CMSG_DATA(control_message), files, sizeof(files));
+
+            fflush(stdout);
+            fflush(stderr);
+
+            ServerReply reply = {0};
+            if(sendmsg(connection, &message, MSG_NOSIGNAL) == sizeof(header) &&
+               SocketSendAll(connection, data, header.size) &&
+               SocketReceiveAll(connection, &reply, sizeof(reply)))
+            {
+                *exit_code = reply.exit_code;
+            }
+            else
+            {
+                LogError("ERROR: Lost the connection to the server at \"%s\".", socket_path);
+                *exit_code = 1;
+            }
+            sent = 1;
+
+            free(data);
+            free(working_directory);
+        }
+        close(connection);
+    }
+#endif
+
+    return sent;
+}
+
+/*
+Copyright 2019 Ryan Fleury
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,343 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Data Desk
+
+Author  : Ryan Fleury
+Updated : 5 December 2019
+License : MIT, at end of file.
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// With --stamp <path>, a successful run writes a stamp file that
+// lists every file it read and every file the custom layer generated (see
+// DataDeskServices), with a hash of each one's contents, under a key made
+// from the Data Desk version, the command line, and the custom layer binaries.
+// The next run with the same key exits right away if every one of those
+// files still has the same contents, without loading the custom layer, so
+// generated files aren't rewritten (and things that depend on them aren't
+// rebuilt) when nothing has changed.
+//
+// A stamp file looks like this:
+//
+//     data-desk-stamp 1 <key>
+//     input <hash> <path>
+//     output <hash> <path>
+//     ...
+//
+// -MD (and -MF <path>) write the same lists as a Make-style dependency file
+// instead, for build systems that track dependencies themselves.
+
+#define STAMP_FILE_VERSION 1
+
+typedef struct OutputFileList OutputFileList;
+struct OutputFileList
+{
+    int count;
+    int max;
+    char **paths;
+};
+
+static void
+AddOutputFilePath(OutputFileList *list, char *path)
+{
+    if(path)
+    {
+        int already_added = 0;
+        for(int i = 0; i < list->count; ++i)
+        {
+            if(StringMatchCaseSensitive(list->paths[i], path) &&
+               CalculateCStringLength(list->paths[i]) == CalculateCStringLength(path))
+            {
+                already_added = 1;
+                break;
+            }
+        }
+
+        if(!already_added)
+        {
+            if(list->count >= list->max)
+            {
+                list->max = list->max ? list->max * 2 : 16;
+                list->paths = realloc(list->paths, sizeof(char *) * list->max);
+                Assert(list->paths != 0);
+            }
+            int path_length = CalculateCStringLength(path);
+            char *path_copy = malloc(path_length + 1);
+            Assert(path_copy != 0);
+            MemoryCopy(path_copy, path, path_length + 1);
+            list->paths[list->count++] = path_copy;
+        }
+    }
+}
+
+static void
+AddOutputFile(DataDeskServices *services, char *path)
+{
+    AddOutputFilePath(services->data, path);
+}
+
+static void
+FreeOutputFileList(OutputFileList *list)
+{
+    for(int i = 0; i < list->count; ++i)
+    {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+    MemorySet(list, 0, sizeof(*list));
+}
+
+// Every custom layer has a list of its own, so that custom layers
+// running on different threads never add to the same one. They're moved into
+// one list after the custom layers have cleaned up.
+static void
+MoveOutputFiles(OutputFileList *list, OutputFileList *source)
+{
+    for(int i = 0; i < source->count; ++i)
+    {
+        AddOutputFilePath(list, source->paths[i]);
+    }
+    FreeOutputFileList(source);
+}
+
+// Called with each file's contents as it's loaded, so that the
+// stamp (and --watch) has the hash of what was actually parsed.
+static void
+RecordFileHash(ParseContext *context, int file_id, char *contents, int contents_length)
+{
+    if(context->stamp_path || context->watch)
+    {
+        if(file_id >= context->file_hash_max)
+        {
+            context->file_hash_max = context->graph.file_max;
+            context->file_hashes = realloc(context->file_hashes, sizeof(unsigned long long) * context->file_hash_max);
+            Assert(context->file_hashes != 0);
+        }
+        context->file_hashes[file_id] = _DataDeskHashBytes(0, contents, contents_length);
+    }
+}
+
+// The arguments must be hashed before they're read, because
+// reading them zeroes the ones that aren't files.
+static unsigned long long
+HashArguments(int argument_count, char **arguments)
+{
+    char *version = DATA_DESK_VERSION_STRING;
+    unsigned long long hash = _DataDeskHashBytes(0, version, CalculateCStringLength(version));
+    hash = _DataDeskHashMix(hash, STAMP_FILE_VERSION);
+    for(int i = 1; i < argument_count; ++i)
+    {
+        hash = _DataDeskHashBytes(hash, arguments[i], CalculateCStringLength(arguments[i]));
+    }
+    return hash;
+}
+
+static unsigned long long
+ComputeStampKey(unsigned long long arguments_hash, char **custom_layer_paths, int custom_layer_count)
+{
+    unsigned long long key = arguments_hash;
+    for(int i = 0; i < custom_layer_count; ++i)
+    {
+        unsigned long long custom_layer_hash = 0;
+        HashFileContents(custom_layer_paths[i], &custom_layer_hash);
+        key = _DataDeskHashMix(key, custom_layer_hash);
+    }
+    return key;
+}
+
+static int
+StampFileIsCurrent(char *stamp_path, unsigned long long key)
+{
+    int current = 0;
+    FILE *file = fopen(stamp_path, "rb");
+    if(file)
+    {
+        char line[4096];
+        int version = 0;
+        unsigned long long stamp_key = 0;
+        if(fgets(line, sizeof(line), file) &&
+           sscanf(line, "data-desk-stamp %d %llx", &version, &stamp_key) == 2 &&
+           version == STAMP_FILE_VERSION && stamp_key == key)
+        {
+            current = 1;
+            while(current && fgets(line, sizeof(line), file))
+            {
+                int line_length = CalculateCStringLength(line);
+                unsigned long long hash = 0;
+                int path_offset = 0;
+                current = 0;
+                if(line_length > 0 && line[line_length-1] == '\n')
+                {
+                    line[line_length-1] = 0;
+                    if(sscanf(line, "%*s %llx %n", &hash, &path_offset) == 1 && path_offset)
+                    {
+                        unsigned long long file_hash = 0;
+                        current = HashFileContents(line + path_offset, &file_hash) && file_hash == hash;
+                    }
+                }
+            }
+        }
+        fclose(file);
+    }
+    return current;
+}
+
+// Must be called after the custom layer has cleaned up, so that the
+// files it generated have been written. Returns 0 (and writes nothing) if a
+// generated file can't be read.
+static int
+WriteStampFile(char *stamp_path, unsigned long long key, ParseContext *context, OutputFileList *outputs)
+{
+    int success = 0;
+
+    int temporary_path_size = CalculateCStringLength(stamp_path) + 32;
+    char *temporary_path = malloc(temporary_path_size);
+    Assert(temporary_path != 0);
+    snprintf(temporary_path, temporary_path_size, "%s.%u.tmp", stamp_path, GetProcessID());
+
+    FILE *file = fopen(temporary_path, "wb");
+    if(file)
+    {
+        success = 1;
+        fprintf(file, "data-desk-stamp %d %016llx\n", STAMP_FILE_VERSION, key);
+        for(int i = 1; i <= context->graph.file_count; ++i)
+        {
+            fprintf(file, "input %016llx %s\n", context->file_hashes[i], context->graph.files[i].filename);
+        }
+        for(int i = 0; success && i < outputs->count; ++i)
+        {
+            unsigned long long hash = 0;
+            success = HashFileContents(outputs->paths[i], &hash);
+            fprintf(file, "output %016llx %s\n", hash, outputs->paths[i]);
+        }
+        success = !ferror(file) && success;
+        success = !fclose(file) && success;
+        success = success && ReplaceFileWith(stamp_path, temporary_path);
+        if(!success)
+        {
+            remove(temporary_path);
+        }
+    }
+
+    free(temporary_path);
+    return success;
+}
+
+static void
+FWriteMakePath(FILE *file, char *path)
+{
+    for(int i = 0; path[i]; ++i)
+    {
+        // A drive letter's colon is left alone, as Windows builds of make
+        // expect it that way.
+        int drive_colon = 0;
+#if BUILD_WIN32
+        drive_colon = (i == 1 && CharIsAlpha(path[0]) && (path[2] == '\\' || path[2] == '/'));
+#endif
+        if(path[i] == ' ' || path[i] == '#' || (path[i] == ':' && !drive_colon))
+        {
+            fputc('\\', file);
+        }
+        else if(path[i] == '$')
+        {
+            fputc('$', file);
+        }
+        fputc(path[i], file);
+    }
+}
+
+// Without -MF, the dependency file is named after the first file
+// that the custom layer generated, like a compiler's is named after its
+// output.
+static char *
+GetDefaultDependencyFilePath(OutputFileList *outputs)
+{
+    char *base = outputs->count ? outputs->paths[0] : "data_desk";
+    int base_length = CalculateCStringLength(base);
+    for(int i = base_length - 1; i >= 0 && base[i] != '/' && base[i] != '\\'; --i)
+    {
+        if(base[i] == '.')
+        {
+            base_length = i;
+            break;
+        }
+    }
+    char *path = malloc(base_length + 3);
+    Assert(path != 0);
+    MemoryCopy(path, base, base_length);
+    MemoryCopy(path + base_length, ".d", 3);
+    return path;
+}
+
+// The targets are the generated files (and the stamp file, if
+// there is one); they depend on every file that was read, and on the custom
+// layers.
+static int
+WriteDependencyFile(char *path, ParseContext *context, OutputFileList *outputs, char **custom_layer_paths, int custom_layer_count)
+{
+    int success = 0;
+
+    int temporary_path_size = CalculateCStringLength(path) + 32;
+    char *temporary_path = malloc(temporary_path_size);
+    Assert(temporary_path != 0);
+    snprintf(temporary_path, temporary_path_size, "%s.%u.tmp", path, GetProcessID());
+
+    FILE *file = fopen(temporary_path, "wb");
+    if(file)
+    {
+        int target_count = 0;
+        if(context->stamp_path)
+        {
+            FWriteMakePath(file, context->stamp_path);
+            ++target_count;
+        }
+        for(int i = 0; i < outputs->count; ++i)
+        {
+            fprintf(file, target_count++ ? " " : "");
+            FWriteMakePath(file, outputs->paths[i]);
+        }
+        fprintf(file, ":");
+        for(int i = 1; i <= context->graph.file_count; ++i)
+        {
+            fprintf(file, " \\\n  ");
+            FWriteMakePath(file, context->graph.files[i].filename);
+        }
+        for(int i = 0; i < custom_layer_count; ++i)
+        {
+            fprintf(file, " \\\n  ");
+            FWriteMakePath(file, custom_layer_paths[i]);
+        }
+        fprintf(file, "\n");
+
+        success = !ferror(file);
+        success = !fclose(file) && success;
+        success = success && ReplaceFileWith(path, temporary_path);
+        if(!success)
+        {
+            remove(temporary_path);
+        }
+    }
+
+    free(temporary_path);
+    return success;
+}
+
+/*
+Copyright 2019 Ryan Fleury
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
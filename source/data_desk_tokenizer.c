@@ -322,6 +322,87 @@ RequireTokenType(Tokenizer *tokenizer, int type, Token *token_ptr)
     return match;
 }
 
+// Skips to just past the '}' that matches a '{' that has already
+// been read, without making tokens out of anything in between. Comments,
+// strings, and character constants are skipped the same way that
+// GetNextTokenFromBuffer skips them, so braces inside of them don't count.
+// Returns 0 if the buffer ends first.
+static int
+SkipBracedBlock(Tokenizer *tokenizer)
+{
+    int depth = 1;
+    int line = tokenizer->line;
+    char *at = tokenizer->at;
+    
+    while(*at && depth > 0)
+    {
+        char *end = 0;
+        int nest_level = 0;
+        
+        if(at[0] == '/' && at[1] == '/')
+        {
+            for(end = at + 2; *end && *end != '\n'; ++end);
+        }
+        else if(at[0] == '/' && at[1] == '*')
+        {
+            for(end = at + 2, nest_level = 1; *end && nest_level; ++end)
+            {
+                if(end[0] == '/' && end[1] == '*')
+                {
+                    ++nest_level;
+                    ++end;
+                }
+                else if(end[0] == '*' && end[1] == '/')
+                {
+                    --nest_level;
+                    ++end;
+                }
+            }
+        }
+        else if(at[0] == '"' && at[1] == '"' && at[2] == '"')
+        {
+            for(end = at + 3; *end && !(end[0] == '"' && end[1] == '"' && end[2] == '"'); ++end);
+            end += *end ? 3 : 0;
+        }
+        else if(at[0] == '"' || at[0] == '\'')
+        {
+            for(end = at + 1; *end && *end != at[0]; ++end);
+            end += *end ? 1 : 0;
+        }
+        else
+        {
+            if(at[0] == '{')
+            {
+                ++depth;
+            }
+            else if(at[0] == '}')
+            {
+                --depth;
+            }
+            else if(at[0] == '\n')
+            {
+                ++line;
+            }
+            ++at;
+        }
+        
+        if(end)
+        {
+            for(; at < end; ++at)
+            {
+                if(*at == '\n')
+                {
+                    ++line;
+                }
+            }
+        }
+    }
+    
+    tokenizer->at = at;
+    tokenizer->line = line;
+    return depth == 0;
+}
+
 static char *
 GetBinaryOperatorStringFromType(int type)
 {
@@ -96,6 +96,7 @@ CharIsSymbol(int c)
             c == '%' ||
             c == '^' ||
             c == '&' ||
+            c == '|' ||
             c == '*' ||
             c == '(' ||
             c == ')' ||
@@ -159,6 +160,257 @@ LoadEntireFileAndNullTerminate(char *filename)
     return result;
 }
 
+// Returns a heap-allocated absolute path with no "." or ".."
+// components (and, on Linux, no symbolic links), or 0 if there is no file at
+// the path.
+static char *
+CanonicalizePath(char *path)
+{
+    char *result = 0;
+#if BUILD_WIN32
+    DWORD length = GetFullPathNameA(path, 0, 0, 0);
+    if(length)
+    {
+        result = malloc(length);
+        if(result && (!GetFullPathNameA(path, length, result, 0) ||
+                      GetFileAttributesA(result) == INVALID_FILE_ATTRIBUTES))
+        {
+            free(result);
+            result = 0;
+        }
+    }
+#elif BUILD_LINUX
+    result = realpath(path, 0);
+#endif
+    return result;
+}
+
+static unsigned int
+GetPageSize(void)
+{
+    unsigned int page_size = 4096;
+#if BUILD_WIN32
+    SYSTEM_INFO system_info = {0};
+    GetSystemInfo(&system_info);
+    page_size = system_info.dwPageSize;
+#elif BUILD_LINUX
+    page_size = (unsigned int)sysconf(_SC_PAGESIZE);
+#endif
+    return page_size;
+}
+
+// Page allocations are only used when memory needs to be
+// write-protected later; size must be a multiple of the page size.
+static void *
+AllocatePages(unsigned int size)
+{
+    void *memory = 0;
+#if BUILD_WIN32
+    memory = VirtualAlloc(0, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#elif BUILD_LINUX
+    memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED)
+    {
+        memory = 0;
+    }
+#endif
+    return memory;
+}
+
+static void
+FreePages(void *memory, unsigned int size)
+{
+#if BUILD_WIN32
+    VirtualFree(memory, 0, MEM_RELEASE);
+#elif BUILD_LINUX
+    munmap(memory, size);
+#endif
+}
+
+static void
+MakePagesReadOnly(void *memory, unsigned int size)
+{
+#if BUILD_WIN32
+    DWORD old_protect = 0;
+    VirtualProtect(memory, size, PAGE_READONLY, &old_protect);
+#elif BUILD_LINUX
+    mprotect(memory, size, PROT_READ);
+#endif
+}
+
+// Succeeds if the directory already exists.
+static int
+MakeDirectory(char *path)
+{
+    int success = 0;
+#if BUILD_WIN32
+    success = CreateDirectoryA(path, 0) || GetLastError() == ERROR_ALREADY_EXISTS;
+#elif BUILD_LINUX
+    success = mkdir(path, 0777) == 0 || errno == EEXIST;
+#endif
+    return success;
+}
+
+static unsigned int
+GetProcessID(void)
+{
+    unsigned int id = 0;
+#if BUILD_WIN32
+    id = (unsigned int)GetCurrentProcessId();
+#elif BUILD_LINUX
+    id = (unsigned int)getpid();
+#endif
+    return id;
+}
+
+// Moves a file over another one (which may or may not exist) in
+// one step, so that readers never see a partly written file.
+static int
+ReplaceFileWith(char *path, char *new_file_path)
+{
+    int success = 0;
+#if BUILD_WIN32
+    success = !!MoveFileExA(new_file_path, path, MOVEFILE_REPLACE_EXISTING);
+#elif BUILD_LINUX
+    success = rename(new_file_path, path) == 0;
+#endif
+    return success;
+}
+
+static int
+CopyFileTo(char *path, char *new_path)
+{
+    int success = 0;
+#if BUILD_WIN32
+    success = !!CopyFileA(path, new_path, FALSE);
+#elif BUILD_LINUX
+    FILE *source = fopen(path, "rb");
+    if(source)
+    {
+        FILE *destination = fopen(new_path, "wb");
+        if(destination)
+        {
+            char buffer[65536];
+            size_t bytes_read = 0;
+            success = 1;
+            while(success && (bytes_read = fread(buffer, 1, sizeof(buffer), source)) > 0)
+            {
+                success = fwrite(buffer, 1, bytes_read, destination) == bytes_read;
+            }
+            success = !ferror(source) && success;
+            success = !fclose(destination) && success;
+            if(!success)
+            {
+                remove(new_path);
+            }
+        }
+        fclose(source);
+    }
+#endif
+    return success;
+}
+
+// Threads are only used to run several custom layers at once.
+#if BUILD_WIN32
+typedef HANDLE Thread;
+#define THREAD_PROCEDURE(name) DWORD WINAPI name(LPVOID data)
+typedef DWORD WINAPI ThreadProcedure(LPVOID data);
+#elif BUILD_LINUX
+typedef pthread_t Thread;
+#define THREAD_PROCEDURE(name) void *name(void *data)
+typedef void *ThreadProcedure(void *data);
+#endif
+
+static int
+ThreadStart(Thread *thread, ThreadProcedure *procedure, void *data)
+{
+    int success = 0;
+#if BUILD_WIN32
+    *thread = CreateThread(0, 0, procedure, data, 0, 0);
+    success = *thread != 0;
+#elif BUILD_LINUX
+    success = pthread_create(thread, 0, procedure, data) == 0;
+#endif
+    return success;
+}
+
+static void
+ThreadJoin(Thread *thread)
+{
+#if BUILD_WIN32
+    WaitForSingleObject(*thread, INFINITE);
+    CloseHandle(*thread);
+#elif BUILD_LINUX
+    pthread_join(*thread, 0);
+#endif
+}
+
+// Hashes a file's contents (with _DataDeskHashBytes, so that it
+// matches hashing the contents after loading them), mapping the file rather
+// than reading it. Returns 0 if the file can't be opened.
+static int
+HashFileContents(char *path, unsigned long long *hash)
+{
+    int success = 0;
+#if BUILD_WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if(file != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER size = {0};
+        if(GetFileSizeEx(file, &size) && size.QuadPart < 0x7fffffff)
+        {
+            if(size.QuadPart == 0)
+            {
+                *hash = _DataDeskHashBytes(0, "", 0);
+                success = 1;
+            }
+            else
+            {
+                HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+                if(mapping)
+                {
+                    char *contents = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    if(contents)
+                    {
+                        *hash = _DataDeskHashBytes(0, contents, (int)size.QuadPart);
+                        success = 1;
+                        UnmapViewOfFile(contents);
+                    }
+                    CloseHandle(mapping);
+                }
+            }
+        }
+        CloseHandle(file);
+    }
+#elif BUILD_LINUX
+    int file = open(path, O_RDONLY);
+    if(file >= 0)
+    {
+        struct stat file_status = {0};
+        if(fstat(file, &file_status) == 0 && file_status.st_size < 0x7fffffff)
+        {
+            if(file_status.st_size == 0)
+            {
+                *hash = _DataDeskHashBytes(0, "", 0);
+                success = 1;
+            }
+            else
+            {
+                char *contents = mmap(0, file_status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+                if(contents != MAP_FAILED)
+                {
+                    *hash = _DataDeskHashBytes(0, contents, (int)file_status.st_size);
+                    success = 1;
+                    munmap(contents, file_status.st_size);
+                }
+            }
+        }
+        close(file);
+    }
+#endif
+    return success;
+}
+
 /*
 Copyright 2019 Ryan Fleury
 
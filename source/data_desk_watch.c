@@ -0,0 +1,311 @@
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Data Desk
+
+Author  : Ryan Fleury
+Updated : 5 December 2019
+License : MIT, at end of file.
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+// With --watch, Data Desk runs again whenever one of the files
+// that the last run read changes. The directories holding those files are
+// watched, rather than the files, because editors often save by writing a
+// new file and renaming it over the old one. A burst of changes (like an
+// editor saving several files) is waited out before anything is checked, and
+// files only count as changed if their contents did, so one run handles
+// everything that was saved together.
+
+#define WATCH_QUIET_MILLISECONDS 100
+
+typedef struct WatchedFile WatchedFile;
+struct WatchedFile
+{
+    char *path;
+    int exists;
+    unsigned long long hash;
+    int changed;
+};
+
+typedef struct Watcher Watcher;
+struct Watcher
+{
+    int file_count;
+    int file_max;
+    WatchedFile *files;
+
+    int directory_count;
+    int directory_max;
+    char **directories;
+
+#if BUILD_WIN32
+    HANDLE *notifications;
+#elif BUILD_LINUX
+    int inotify;
+#endif
+};
+
+static int
+WatcherInit(Watcher *watcher)
+{
+    MemorySet(watcher, 0, sizeof(*watcher));
+    int success = 1;
+#if BUILD_LINUX
+    watcher->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    success = watcher->inotify >= 0;
+#endif
+    return success;
+}
+
+static void
+WatcherCleanUp(Watcher *watcher)
+{
+    for(int i = 0; i < watcher->file_count; ++i)
+    {
+        free(watcher->files[i].path);
+    }
+    for(int i = 0; i < watcher->directory_count; ++i)
+    {
+#if BUILD_WIN32
+        FindCloseChangeNotification(watcher->notifications[i]);
+#endif
+        free(watcher->directories[i]);
+    }
+#if BUILD_WIN32
+    free(watcher->notifications);
+#elif BUILD_LINUX
+    if(watcher->inotify >= 0)
+    {
+        close(watcher->inotify);
+    }
+#endif
+    free(watcher->files);
+    free(watcher->directories);
+    MemorySet(watcher, 0, sizeof(*watcher));
+}
+
+static void
+WatcherAddDirectory(Watcher *watcher, char *path, int path_length)
+{
+    char *directory = malloc(path_length + 2);
+    Assert(directory != 0);
+    if(path_length)
+    {
+        MemoryCopy(directory, path, path_length);
+        directory[path_length] = 0;
+    }
+    else
+    {
+        MemoryCopy(directory, ".", 2);
+    }
+
+    int already_watched = 0;
+    for(int i = 0; i < watcher->directory_count; ++i)
+    {
+        if(!strcmp(watcher->directories[i], directory))
+        {
+            already_watched = 1;
+            break;
+        }
+    }
+
+    int watching = 0;
+    if(!already_watched)
+    {
+        if(watcher->directory_count >= watcher->directory_max)
+        {
+            watcher->directory_max = watcher->directory_max ? watcher->directory_max * 2 : 16;
+            watcher->directories = realloc(watcher->directories, sizeof(char *) * watcher->directory_max);
+            Assert(watcher->directories != 0);
+#if BUILD_WIN32
+            watcher->notifications = realloc(watcher->notifications, sizeof(HANDLE) * watcher->directory_max);
+            Assert(watcher->notifications != 0);
+#endif
+        }
+
+#if BUILD_WIN32
+        // WaitForMultipleObjects can only wait on so many handles.
+        if(watcher->directory_count < MAXIMUM_WAIT_OBJECTS)
+        {
+            HANDLE notification = FindFirstChangeNotificationA(directory, FALSE,
+                                                               FILE_NOTIFY_CHANGE_FILE_NAME |
+                                                               FILE_NOTIFY_CHANGE_LAST_WRITE);
+            if(notification != INVALID_HANDLE_VALUE)
+            {
+                watcher->notifications[watcher->directory_count] = notification;
+                watching = 1;
+            }
+        }
+#elif BUILD_LINUX
+        watching = inotify_add_watch(watcher->inotify, directory,
+                                     IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE | IN_DELETE) >= 0;
+#endif
+
+        if(watching)
+        {
+            watcher->directories[watcher->directory_count++] = directory;
+        }
+        else
+        {
+            LogError("WARNING: Could not watch \"%s\" for changes.", directory);
+        }
+    }
+
+    if(!watching)
+    {
+        free(directory);
+    }
+}
+
+// hash is the hash of the contents that were used (see
+// RecordFileHash), so that a change made while Data Desk was running is
+// still noticed afterwards. Files that couldn't be loaded are watched too, so
+// that creating them counts as a change.
+static void
+WatcherAddFile(Watcher *watcher, char *path, int exists, unsigned long long hash)
+{
+    if(watcher->file_count >= watcher->file_max)
+    {
+        watcher->file_max = watcher->file_max ? watcher->file_max * 2 : 16;
+        watcher->files = realloc(watcher->files, sizeof(WatchedFile) * watcher->file_max);
+        Assert(watcher->files != 0);
+    }
+    int path_length = CalculateCStringLength(path);
+    WatchedFile *file = watcher->files + watcher->file_count++;
+    file->path = malloc(path_length + 1);
+    Assert(file->path != 0);
+    MemoryCopy(file->path, path, path_length + 1);
+    file->exists = exists;
+    file->hash = hash;
+    file->changed = 0;
+
+    int directory_length = 0;
+    for(int i = 0; i < path_length; ++i)
+    {
+        if(path[i] == '/' || path[i] == '\\')
+        {
+            directory_length = i ? i : 1;
+        }
+    }
+    WatcherAddDirectory(watcher, path, directory_length);
+}
+
+// Forgets the files (but keeps watching their directories), so
+// that the next run's files can be added.
+static void
+WatcherClearFiles(Watcher *watcher)
+{
+    for(int i = 0; i < watcher->file_count; ++i)
+    {
+        free(watcher->files[i].path);
+    }
+    watcher->file_count = 0;
+}
+
+static int
+WatcherFilesChanged(Watcher *watcher)
+{
+    int changed = 0;
+    for(int i = 0; i < watcher->file_count; ++i)
+    {
+        unsigned long long hash = 0;
+        int exists = HashFileContents(watcher->files[i].path, &hash);
+        watcher->files[i].changed = exists != watcher->files[i].exists || (exists && hash != watcher->files[i].hash);
+        if(watcher->files[i].changed)
+        {
+            Log("\"%s\" has changed.", watcher->files[i].path);
+            changed = 1;
+        }
+    }
+    return changed;
+}
+
+// Blocks until a change in any of the watched directories, and then
+// until nothing has changed for WATCH_QUIET_MILLISECONDS. Returns 0 if there
+// is no way to wait.
+static int
+WatcherWaitForActivity(Watcher *watcher)
+{
+    int success = 0;
+#if BUILD_WIN32
+    if(watcher->directory_count)
+    {
+        DWORD timeout = INFINITE;
+        for(;;)
+        {
+            DWORD result = WaitForMultipleObjects(watcher->directory_count, watcher->notifications, FALSE, timeout);
+            if(result >= WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + watcher->directory_count)
+            {
+                FindNextChangeNotification(watcher->notifications[result - WAIT_OBJECT_0]);
+                timeout = WATCH_QUIET_MILLISECONDS;
+                success = 1;
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+#elif BUILD_LINUX
+    if(watcher->directory_count)
+    {
+        int timeout = -1;
+        for(;;)
+        {
+            struct pollfd poll_file = {0};
+            poll_file.fd = watcher->inotify;
+            poll_file.events = POLLIN;
+            int result = poll(&poll_file, 1, timeout);
+            if(result > 0)
+            {
+                char events[4096];
+                while(read(watcher->inotify, events, sizeof(events)) > 0);
+                timeout = WATCH_QUIET_MILLISECONDS;
+                success = 1;
+            }
+            else if(result < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+#endif
+    return success;
+}
+
+// Returns once a watched file has changed (and marks the ones that
+// have), or 0 if watching isn't possible.
+static int
+WatcherWaitForChanges(Watcher *watcher)
+{
+    int changed = 0;
+    while(!changed && WatcherWaitForActivity(watcher))
+    {
+        changed = WatcherFilesChanged(watcher);
+    }
+    return changed;
+}
+
+/*
+Copyright 2019 Ryan Fleury
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
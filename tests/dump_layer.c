@@ -0,0 +1,65 @@
+// Prints every node that the custom layer is sent, with its location,
+// tags, what it resolves to, and its hash. Used by smoke.sh, which diffs
+// this output between runs with different options.
+
+#include <stdio.h>
+#include "data_desk.h"
+
+static DataDeskGraph *global_graph = 0;
+
+DATA_DESK_FUNC void
+DataDeskCustomGraphCallback(DataDeskGraph *graph)
+{
+	global_graph = graph;
+}
+
+static void
+DumpNode(DataDeskNode *node, int depth)
+{
+	DataDeskSourceLocation location = DataDeskGetNodeLocation(global_graph, node);
+	printf("%*s%d \"%s\" [%d, %d) %d:%d", depth * 2, "", node->type, node->string ? node->string : "",
+		   location.start_offset, location.end_offset, location.line, location.column);
+
+	for(DataDeskNode *tag = node->first_tag; tag; tag = tag->next)
+	{
+		printf(" %s(%d)", tag->string, tag->child_count);
+	}
+
+	if(node->type == DATA_DESK_NODE_TYPE_declaration)
+	{
+		DataDeskNode *type = node->declaration.type;
+		DataDeskNode *definition = DataDeskGetTypeDefinition(global_graph, node);
+		printf(" type=%s%s ptr=%d array=%d def=%s", type->string ? type->string : "",
+			   type->type_usage.struct_declaration ? "(struct)" : type->type_usage.union_declaration ? "(union)" : "",
+			   type->type_usage.pointer_count, type->type_usage.first_array_size_expression != 0,
+			   definition ? definition->string : "-");
+	}
+
+	printf(" hash=%016llx\n", DataDeskGetNodeHash(global_graph, node));
+
+	if(node->type == DATA_DESK_NODE_TYPE_declaration)
+	{
+		DataDeskNode *type = node->declaration.type;
+		if(type->type_usage.struct_declaration)
+		{
+			DumpNode(type->type_usage.struct_declaration, depth + 1);
+		}
+		if(type->type_usage.union_declaration)
+		{
+			DumpNode(type->type_usage.union_declaration, depth + 1);
+		}
+	}
+
+	for(int i = 0; i < node->child_count; ++i)
+	{
+		DumpNode(node->children[i], depth + 1);
+	}
+}
+
+DATA_DESK_FUNC void
+DataDeskCustomParseCallback(DataDeskNode *root, char *filename)
+{
+	printf("%s:\n", filename);
+	DataDeskExpandNode(global_graph, root);
+	DumpNode(root, 1);
+}
@@ -0,0 +1,67 @@
+#!/bin/bash
+
+# Runs tests/fixture.ds through Data Desk with each option that shouldn't
+# change what a custom layer sees, and diffs what tests/dump_layer.c prints
+# against a run with no options. Run from anywhere; set CC to pick a compiler
+# (clang, like build.sh, if it is installed).
+
+cd "$(dirname "$0")/.."
+CC=${CC:-$(command -v clang || echo cc)}
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+$CC source/data_desk_main.c -DBUILD_LINUX=1 -DBUILD_WIN32=0 -o $OUT/data_desk -ldl -lpthread || exit 1
+$CC -shared -fPIC -I source tests/dump_layer.c -o $OUT/dump_layer.so || exit 1
+
+failures=0
+
+# Runs Data Desk with the given options, and compares its output to the
+# default run's.
+check()
+{
+    name="$1"
+    shift
+    $OUT/data_desk -c $OUT/dump_layer.so "$@" tests/fixture.ds > "$OUT/$name.txt" 2> "$OUT/$name.err"
+    status=$?
+    if [ $status -ne 0 ]; then
+        echo "FAILED: $name (exit status $status)"
+        cat "$OUT/$name.err"
+        failures=$((failures + 1))
+    elif [ -s "$OUT/$name.err" ]; then
+        echo "FAILED: $name (errors were reported)"
+        cat "$OUT/$name.err"
+        failures=$((failures + 1))
+    elif ! diff -u "$OUT/default.txt" "$OUT/$name.txt"; then
+        echo "FAILED: $name (output differs from the default run)"
+        failures=$((failures + 1))
+    else
+        echo "ok: $name"
+    fi
+}
+
+if ! $OUT/data_desk -c $OUT/dump_layer.so tests/fixture.ds > "$OUT/default.txt" || [ ! -s "$OUT/default.txt" ]; then
+    echo "FAILED: default run"
+    exit 1
+fi
+
+check lazy-symbols --lazy-symbols
+check share-nodes --share-nodes
+check skim --skim
+check protect-graph --protect-graph
+check streaming --streaming
+check skim-lazy-symbols --skim --lazy-symbols
+check share-nodes-lazy-symbols --share-nodes --lazy-symbols
+check all --skim --share-nodes --lazy-symbols --protect-graph
+check cache-dir-cold --cache-dir $OUT/cache
+check cache-dir-warm --cache-dir $OUT/cache
+check cache-dir-share-nodes --cache-dir $OUT/cache-share-nodes --share-nodes
+check cache-dir-share-nodes-warm --cache-dir $OUT/cache-share-nodes --share-nodes
+check emit-ast --emit-ast $OUT/fixture.ast
+check stamp --stamp $OUT/fixture.stamp
+check dependency-file -MF $OUT/fixture.d
+
+if [ $failures -ne 0 ]; then
+    echo "$failures failed."
+    exit 1
+fi
+echo "All passed."